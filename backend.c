@@ -0,0 +1,70 @@
+/* The real process backend, see backend.h */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "backend.h"
+#include "launcher.h"
+
+#define CONTINUED_STATUS 0xffff   /* the wait status of a continued child */
+
+static pid_t os_spawn(const char *cmdline, void (*child)(void *), void *arg) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        child(arg);
+        exit(0);
+    }
+    return pid;
+}
+
+static int os_signal(pid_t pid, int sig) {
+    return kill(pid, sig);
+}
+
+static pid_t os_reap(pid_t pid, int *status, int options, struct rusage *usage) {
+    if (!launcher_reaping() || pid > 0) {
+        return wait4(pid, status, options, usage);
+    }
+
+    // the launchers' children are the reaper thread's to reap: only this
+    // thread's own are waited for, then those it has reaped are taken
+    pid_t found = wait4(pid, status, options | __WNOTHREAD, usage);
+    if (found > 0 || (found < 0 && errno != ECHILD)) {
+        return found;
+    }
+    pid_t reaped = launcher_reap(status, usage);
+    if (reaped > 0) {
+        return reaped;
+    }
+
+    // their stops and continues leave them to the reaper, so they come here
+    siginfo_t info;
+    info.si_pid = 0;
+    int which = (options & WUNTRACED ? WSTOPPED : 0) | (options & WCONTINUED);
+    if (which && !waitid(P_ALL, 0, &info, which | WNOHANG) && info.si_pid) {
+        *status = info.si_code == CLD_CONTINUED ? CONTINUED_STATUS : W_STOPCODE(info.si_status);
+        if (usage) {
+            memset(usage, 0, sizeof(*usage));
+        }
+        return info.si_pid;
+    }
+    return found;
+}
+
+static void os_idle(unsigned int seconds) {
+    // the current mask without SIGCHLD, swapped in atomically for the wait
+    sigset_t mask;
+    sigprocmask(SIG_BLOCK, NULL, &mask);
+    sigdelset(&mask, SIGCHLD);
+    struct timespec limit = { seconds, 0 };
+    ppoll(NULL, 0, &limit, &mask);
+}
+
+proc_backend os_backend = { "os", os_spawn, os_signal, os_reap, os_idle };
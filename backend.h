@@ -0,0 +1,61 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* Process backends: how the controller spawns, signals and reaps tasks.
+ *
+ * os_backend does it for real with fork(), kill() and wait4().  Once
+ * launcher threads have been started (see launcher.h), the children they
+ * spawn are reaped by the reaper thread, and reap() takes them from it.
+ *
+ * sim_backend never forks.  Each task is simulated in memory from its
+ * command line, read as workload(1) steps (see workload.c): cpu=MS and
+ * sleep=MS take virtual time, stop stops the task until it is resumed,
+ * exit=CODE or exit=A-B ends it, and seed=N seeds exit=A-B.  Other
+ * arguments take no time, and a task that runs out of steps exits 0.
+ * Virtual time only moves when the controller asks (sim_advance(),
+ * sim_run(), or a foreground wait), so every run of a script is the same.
+ * Status changes are queued as wait statuses and announced by raising
+ * SIGCHLD, so the controller's reapers handle them like real children.
+ */
+
+typedef struct proc_backend {
+    const char *name;
+
+    /* Starts a task for cmdline.  The os backend forks and runs child(arg)
+     * in the child, which must not return.  Returns the pid, or -1. */
+    pid_t (*spawn)(const char *cmdline, void (*child)(void *), void *arg);
+
+    /* Sends sig to pid, like kill(). */
+    int (*signal)(pid_t pid, int sig);
+
+    /* Reaps a status change, like wait4(): usage (if not NULL) gets the
+     * resources used by a child that ended. */
+    pid_t (*reap)(pid_t pid, int *status, int options, struct rusage *usage);
+
+    /* Waits up to seconds or until a child changes state, like sleep().
+     * SIGCHLD is let in for the wait even if the caller blocks it, so a
+     * caller can check for a change and wait without missing one. */
+    void (*idle)(unsigned int seconds);
+} proc_backend;
+
+extern proc_backend os_backend;
+extern proc_backend sim_backend;
+
+/* Simulator controls */
+
+/* Moves virtual time forward by ms, running every event due meanwhile. */
+void sim_advance(long ms);
+
+/* Runs events until no task is left running. */
+void sim_run(void);
+
+/* Current virtual time in ms, and the number of tasks running and stopped. */
+void sim_stats(long *now, long *running, long *stopped);
+
+/* Drops every simulated task and rewinds virtual time to 0. */
+void sim_reset(void);
+
+#endif /*BACKEND_H*/
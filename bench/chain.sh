@@ -0,0 +1,50 @@
+#!/bin/bash
+# Chains run by the controller: "true && true && ..." as one task, against
+# the same steps registered as separate tasks and exec'd one by one.
+#   chain      per-step turnaround of a foreground chain of STEPS steps
+#   separate   per-exec turnaround of the same steps as separate tasks
+#   chain_bg   per-step turnaround of the chain in the background, steps
+#              launched by the main loop as each is reaped (includes the
+#              metrics round trips that wait for the chain to end)
+#
+# Usage: bench/chain.sh [csv|json] [RUNS]   (default: 200 runs)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+RUNS=${2:-200}
+STEPS=12    # as many as fit in one command line
+
+per_step() {
+    awk -v s="$(elapsed "$1" "$2")" -v n="$3" 'BEGIN { printf "%.3f", s * 1000 / n }'
+}
+
+line="true"
+for ((i = 1; i < STEPS; i++)); do line="$line && true"; done
+
+start
+send "$line"
+send "true"
+barrier
+
+t0=$(now)
+for ((r = 0; r < RUNS; r++)); do send "exec 0"; done
+barrier
+result chain "$STEPS" "$(per_step "$t0" "$(now)" $((RUNS * STEPS)))" ms/step
+
+t0=$(now)
+for ((r = 0; r < RUNS * STEPS; r++)); do send "exec 1"; done
+barrier
+result separate "$STEPS" "$(per_step "$t0" "$(now)" $((RUNS * STEPS)))" ms/step
+
+# one background run at a time: the next bg waits for the chain to finish
+t0=$(now)
+for ((r = 0; r < RUNS; r++)); do
+    send "bg 0"
+    barrier
+    while [ "$(metric 'kitc_tasks{state="running"}')" != 0 ]; do barrier; done
+done
+result chain_bg "$STEPS" "$(per_step "$t0" "$(now)" $((RUNS * STEPS)))" ms/step
+stop
+
+report "$FORMAT"
@@ -0,0 +1,44 @@
+#!/bin/bash
+# Control-socket throughput: C clients connect to one controller at once and
+# each sends R instructions in turn (list of a small task table, and cache),
+# waiting for every response before the next request.
+#   control    instructions answered per second over all clients
+#
+# Usage: bench/control.sh [csv|json] [R] [C...]   (default: 500 requests, 1 and 64 clients)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+REQUESTS=${2:-500}
+shift 2 2>/dev/null || shift $#
+CLIENTS=${*:-1 64}
+
+make -s taskctl-ctl >/dev/null || exit 1
+SOCK=$(mktemp -u /tmp/kitc-bench.XXXXXX.sock)
+REQS=$(mktemp)
+trap 'rm -f "$REQS" "$SOCK"' EXIT
+for ((i = 0; i < REQUESTS; i++)); do
+    if ((i % 2)); then echo "cache"; else echo "list"; fi
+done > "$REQS"
+
+start
+send "control $SOCK"
+for ((i = 0; i < 16; i++)); do send "my_echo $i"; done
+barrier
+
+for c in $CLIENTS; do
+    t0=$(now)
+    pids=()
+    for ((i = 0; i < c; i++)); do
+        ./taskctl-ctl "$SOCK" < "$REQS" > /dev/null &
+        pids+=($!)
+    done
+    failed=0
+    for pid in "${pids[@]}"; do wait "$pid" || failed=1; done
+    s=$(elapsed "$t0" "$(now)")
+    [ "$failed" = 0 ] || echo "control.sh: a client failed with $c clients" >&2
+    result control "$c" "$(rate $((c * REQUESTS)) "$s")" requests/s
+done
+
+stop
+report "$FORMAT"
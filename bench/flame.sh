@@ -0,0 +1,80 @@
+#!/bin/bash
+# A spawn-to-reap flame graph from the controller's USDT probes (see trace.h):
+# N bg launches of COMMAND are traced with bpftrace and each one's time is
+# split into
+#   spawn;setup     launch begun to the child's exec (fork, placement, redirects)
+#   spawn;run       exec to the SIGCHLD handler entered for it
+#   spawn;reap      handler entry to the child reaped
+#   spawn;report    reaped to its status logged
+# in microseconds, summed over the launches and folded by launch path (inline
+# or launcher threads). The folded stacks go to OUT.folded, and are rendered
+# to OUT.svg if flamegraph.pl (github.com/brendangregg/FlameGraph) is on PATH.
+#
+# Needs taskctl built with <sys/sdt.h> (systemtap-sdt-dev) and bpftrace, as root.
+# Usage: bench/flame.sh [N] [COMMAND] [OUT] [LAUNCHERS]
+#        (default: 1000 launches of "sleep 0.1", flame, inline)
+
+. "$(dirname "$0")/lib.sh"
+N=${1:-1000}
+COMMAND=${2:-sleep 0.1}
+OUT=${3:-flame}
+LAUNCHERS=${4:-0}
+EVENTS=$(mktemp)
+
+if ! readelf -n taskctl 2>/dev/null | grep -q 'Provider: kitc'; then
+    echo "taskctl has no probes: install systemtap-sdt-dev and rebuild" >&2
+    exit 1
+fi
+
+# One line per event; uprobes on the binary cover its forked children too
+bpftrace -e '
+usdt:./taskctl:kitc:exec       { printf("exec %d %d %lld %lld\n", arg0, arg1, arg2, arg3); }
+usdt:./taskctl:kitc:signal     /arg0 == 17/ { printf("signal %d %lld\n", arg0, arg2); }
+usdt:./taskctl:kitc:reap       { printf("reap %d %d %d %lld\n", arg0, arg1, arg2, arg3); }
+usdt:./taskctl:kitc:status_log /arg2 <= 1/ { printf("log %d %d %d %lld\n", arg0, arg1, arg2, arg3); }
+' > "$EVENTS" 2>&1 &
+TRACER=$!
+for ((i = 0; i < 100; i++)); do grep -q Attaching "$EVENTS" && break; sleep 0.1; done
+
+start
+for ((i = 0; i < N; i++)); do send "$COMMAND"; done
+[ "$LAUNCHERS" -gt 0 ] && send "launchers $LAUNCHERS"
+barrier
+f0=$(metric 'kitc_tasks{state="finished"}')
+for ((i = 0; i < N; i++)); do send "bg $i"; done
+while :; do
+    barrier
+    [ $(($(metric 'kitc_tasks{state="finished"}') - f0)) -ge "$N" ] && break
+    sleep 0.05
+done
+stop
+kill -INT "$TRACER"
+wait "$TRACER"
+
+# Events are per cpu, so put them back in time order first
+path=$([ "$LAUNCHERS" -gt 0 ] && echo launchers || echo inline)
+awk '/^(exec|signal|reap|log) / { print $NF, $0 }' "$EVENTS" | sort -n | cut -d" " -f2- |
+awk -v path="$path" '
+    $1 == "exec"   { begun[$3] = $4; exec[$3] = $5 }
+    $1 == "signal" { signal = $3 }
+    $1 == "reap" && ($3 in exec) {
+        entered = signal > exec[$3] ? signal : $5
+        t["setup"] += exec[$3] - begun[$3]
+        t["run"] += entered - exec[$3]
+        t["reap"] += $5 - entered
+        reaped[$3] = $5
+    }
+    $1 == "log" && ($3 in reaped) {
+        t["report"] += $5 - reaped[$3]
+        delete reaped[$3]; delete exec[$3]; delete begun[$3]
+    }
+    END { for (s in t) printf "%s;spawn;%s %d\n", path, s, t[s] / 1000 }
+' > "$OUT.folded"
+rm -f "$EVENTS"
+
+if command -v flamegraph.pl >/dev/null; then
+    flamegraph.pl --title "spawn to reap ($N x $COMMAND)" --countname us < "$OUT.folded" > "$OUT.svg"
+    echo "$OUT.svg"
+else
+    cat "$OUT.folded"
+fi
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Task-table journal: the cost of keeping it, and how fast a restart gets
+# the table back.
+#   register   task-registration throughput with the journal on
+#   recover    start to first answer after kill -9: snapshot plus journal tail
+#   restart    the same after a quit, which leaves everything in the snapshot
+#
+# Usage: bench/journal.sh [csv|json] [N...]   (default: 1000 and 10000 tasks)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+shift 2>/dev/null
+SIZES=${*:-1000 10000}
+
+DIR=$(mktemp -d /tmp/kitc-journal.XXXXXX)
+trap 'rm -rf "$DIR"' EXIT
+
+# Starts a controller on the journal and times it up to its first answer,
+# in ms, kept in START_MS.
+time_start() {
+    local t0; t0=$(now)
+    start -j "$DIR/tab"
+    barrier
+    START_MS=$(elapsed "$t0" "$(now)" | awk '{ printf "%.2f", $1 * 1000 }')
+}
+
+for n in $SIZES; do
+    rm -f "$DIR"/tab*
+    start -j "$DIR/tab"
+    t0=$(now)
+    for ((i = 0; i < n; i++)); do send "my_echo $i"; done
+    barrier
+    result register "$n" "$(rate "$n" "$(elapsed "$t0" "$(now)")")" tasks/s
+    kill -9 "$CTL_PID"
+    wait "$CTL_PID" 2>/dev/null
+
+    time_start
+    result recover "$n" "$START_MS" ms
+    stop
+
+    time_start
+    result restart "$n" "$START_MS" ms
+    stop
+done
+
+report "$FORMAT"
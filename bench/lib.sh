@@ -0,0 +1,106 @@
+# Shared helpers for the bench scripts. Source from a script in bench/.
+
+cd "$(dirname "$0")/.." || exit 1
+
+# Prefixes each line of stdin with a wall-clock timestamp in seconds.
+stamp() {
+    while IFS= read -r line; do
+        echo "$EPOCHREALTIME $line"
+    done
+}
+
+# Reads stamped controller log lines and prints Started -> Terminated times (ms)
+# of foreground tasks, one per line.
+fg_latencies() {
+    awk '
+        /Foreground Process/ && /\(Started\)/ { start = $1 }
+        /Foreground Process/ && /\(Terminated/ && start { printf "%.3f\n", ($1 - start) * 1000; start = 0 }
+    '
+}
+
+# Reads one number per line and prints "LABEL,COUNT,P50,P95,P99,MAX".
+percentiles() {
+    sort -n | awk -v label="$1" '
+        { v[NR] = $1 }
+        END { printf "%s,%d,%.2f,%.2f,%.2f,%.2f\n", label, NR, v[int(NR * 0.50) + 1], v[int(NR * 0.95) + 1], v[int(NR * 0.99) + 1], v[NR] }'
+}
+
+# Coprocess helpers for driving one controller in batch: start it, send
+# instruction lines, and use the metrics instruction as a barrier (its reply
+# only comes back once every earlier line is done).
+
+ROWS=()
+
+# Records one result row.
+result() {
+    ROWS+=("$1,$2,$3,$4")
+}
+
+now() {
+    echo "$EPOCHREALTIME"
+}
+
+# Starts a controller, with any arguments given, its log silenced and task
+# output on the coprocess.
+start() {
+    coproc CTL { ./taskctl "$@" 2>/dev/null; }
+}
+
+# Sends one instruction line to the controller.
+send() {
+    echo "$1" >&"${CTL[1]}"
+}
+
+# Waits until every instruction sent so far is done. The metrics reply is
+# kept in METRICS (not printed: coprocess fds are closed in subshells).
+barrier() {
+    send "metrics"
+    METRICS=""
+    local line
+    while IFS= read -r line <&"${CTL[0]}"; do
+        line=${line//kitc\$ /}  # prompts have no newline of their own
+        case "$line" in
+            kitc_input_queue_bytes*) break ;;
+            kitc_*) METRICS+="$line"$'\n' ;;
+        esac
+    done
+}
+
+# Prints one metric value from the last barrier reply.
+metric() {
+    awk -v name="$1" '$1 == name { print $2 }' <<< "$METRICS"
+}
+
+stop() {
+    send "quit"
+    wait "$CTL_PID" 2>/dev/null
+}
+
+# Elapsed seconds between two now() stamps.
+elapsed() {
+    awk -v a="$1" -v b="$2" 'BEGIN { printf "%.6f", b - a }'
+}
+
+rate() {
+    awk -v n="$1" -v s="$2" 'BEGIN { printf "%.1f", (s > 0) ? n / s : 0 }'
+}
+
+# Prints the recorded rows as CSV, or as JSON with the commit if $1 is json.
+report() {
+    local sep row name param value unit
+    if [ "$1" = json ]; then
+        printf '{"commit":"%s","results":[' "$(git rev-parse --short HEAD 2>/dev/null)"
+        sep=""
+        for row in "${ROWS[@]}"; do
+            IFS=, read -r name param value unit <<< "$row"
+            printf '%s\n  {"benchmark":"%s","param":%s,"value":%s,"unit":"%s"}' "$sep" "$name" "$param" "$value" "$unit"
+            sep=","
+        done
+        printf '\n]}\n'
+    else
+        echo "benchmark,param,value,unit"
+        printf '%s\n' "${ROWS[@]}"
+    fi
+}
+
+make -s taskctl my_echo my_pause slow_cooker workload >/dev/null || exit 1
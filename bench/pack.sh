@@ -0,0 +1,62 @@
+#!/bin/bash
+# Packing against launching everything at once and a fixed number at a time,
+# on a mixed workload: memory-heavy sleepers, cpu burners and small mixed
+# tasks, N of each, all sent as bg at once. Reported for each mode:
+#   makespan   time from the first bg to the last task finished
+#   peak_rss   most resident memory of the tasks at once (sampled every 50 ms)
+# Modes: unbounded (no packing), fixed (FIXED tasks at a time, as if each
+# needed one core and no memory), packed (packed onto MEM and two cores a
+# cpu, since a cpu shared only slows its tasks down, with needs learned from
+# one run of each command first).
+#
+# Usage: bench/pack.sh [csv|json] [N] [MEM] [FIXED]   (default: 8 of each, 800M, 4)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+N=${2:-8}
+MEM=${3:-800M}
+FIXED=${4:-4}
+MIX=("workload rss=200 sleep=1000" "workload cpu=300" "workload rss=50 cpu=100 sleep=300")
+
+# Resident memory of every workload process, in MiB
+rss_mb() {
+    ps -C workload -o rss= | awk '{ kb += $1 } END { printf "%d", kb / 1024 }'
+}
+
+for mode in unbounded fixed packed; do
+    start
+    for cmd in "${MIX[@]}"; do send "$cmd"; done
+    total=${#MIX[@]}
+    case $mode in
+        fixed)  send "pack cores=$FIXED mem=1024G" ;;
+        packed) send "pack cores=$((2 * $(nproc))) mem=$MEM"
+                # one run of each command to learn from
+                for ((i = 0; i < total; i++)); do send "exec $i"; done ;;
+    esac
+    for cmd in "${MIX[@]}"; do
+        for ((i = 0; i < N; i++)); do
+            send "$cmd"
+            [ "$mode" = fixed ] && send "place $((total)) cores=1 mem=0"
+            total=$((total + 1))
+        done
+    done
+    barrier
+    f0=$(metric 'kitc_tasks{state="finished"}')
+
+    t0=$(now)
+    for ((i = ${#MIX[@]}; i < total; i++)); do send "bg $i"; done
+    peak=0
+    while :; do
+        r=$(rss_mb)
+        [ "$r" -gt "$peak" ] && peak=$r
+        barrier
+        [ $(($(metric 'kitc_tasks{state="finished"}') - f0)) -ge $((total - ${#MIX[@]})) ] && break
+        sleep 0.05
+    done
+    result "makespan_$mode" $((3 * N)) "$(awk -v s="$(elapsed "$t0" "$(now)")" 'BEGIN { printf "%.3f", s }')" s
+    result "peak_rss_$mode" $((3 * N)) "$peak" MiB
+    stop
+done
+
+report "$FORMAT"
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Foreground task latency while CPU-bound background tasks compete for the cpus.
+# Runs once with default placement and once with the background tasks placed
+# at sched=idle nice=19 and spread across cpus, then prints latency percentiles.
+#
+# Usage: bench/placement.sh [RUNS] [LOAD]
+
+. "$(dirname "$0")/lib.sh"
+RUNS=${1:-20}
+LOAD=${2:-$(( $(nproc) * 2 ))}
+
+# Feeds one session into taskctl. $1 is "placed" to place the background tasks.
+session() {
+    for ((i = 0; i < LOAD; i++)); do echo "workload cpu=600000"; done
+    echo "workload cpu=20"
+    if [ "$1" = placed ]; then
+        echo "placement spread"
+        for ((i = 0; i < LOAD; i++)); do echo "place $i sched=idle nice=19"; done
+    fi
+    for ((i = 0; i < LOAD; i++)); do echo "bg $i"; done
+    for ((r = 0; r < RUNS; r++)); do echo "exec $LOAD"; done
+    for ((i = 0; i < LOAD; i++)); do echo "kill $i"; done
+    echo "quit"
+}
+
+echo "mode,runs,p50_ms,p95_ms,p99_ms,max_ms"
+for mode in default placed; do
+    session $mode | ./taskctl 2>&1 >/dev/null | stamp | fg_latencies | percentiles $mode
+done
@@ -0,0 +1,22 @@
+#!/bin/bash
+# Launch latency of a short, frequently re-run task (my_echo) with and without
+# a warm pool of pre-forked helpers, as foreground Started -> Terminated times.
+#
+# Usage: bench/pool.sh [RUNS] [POOLSIZE]
+
+. "$(dirname "$0")/lib.sh"
+RUNS=${1:-500}
+SIZE=${2:-4}
+
+# Feeds one session into taskctl. $1 is "pool" to warm my_echo first.
+session() {
+    echo "my_echo 0"
+    [ "$1" = pool ] && echo "pool 0 $SIZE"
+    for ((r = 0; r < RUNS; r++)); do echo "exec 0"; done
+    echo "quit"
+}
+
+echo "mode,runs,p50_ms,p95_ms,p99_ms,max_ms"
+for mode in fork pool; do
+    session $mode | ./taskctl 2>&1 >/dev/null | stamp | fg_latencies | percentiles $mode
+done
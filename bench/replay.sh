@@ -0,0 +1,23 @@
+#!/bin/bash
+# Replays a recorded session (taskctl -r FILE, or record FILE) against a fresh
+# controller, so the task numbers in it mean what they did, and prints the
+# response time of each line and of each instruction (see taskctl-replay.c).
+#
+# Usage: bench/replay.sh RECORDING [SPEED|fast]   (default: original speed)
+# Output: taskctl-replay's CSV.
+
+. "$(dirname "$0")/lib.sh"
+make -s taskctl-replay taskctl-ctl >/dev/null || exit 1
+RECORDING=${1:?usage: bench/replay.sh RECORDING [SPEED|fast]}
+SPEED=${2:-1}
+SOCK=$(mktemp -u /tmp/kitc-replay.XXXXXX)
+
+./taskctl -d "$SOCK" >/dev/null || exit 1
+if [ "$SPEED" = fast ]; then
+    ./taskctl-replay -f "$RECORDING" "$SOCK"
+else
+    ./taskctl-replay -s "$SPEED" "$RECORDING" "$SOCK"
+fi
+status=$?
+[ -S "$SOCK" ] && ./taskctl-ctl "$SOCK" quit >/dev/null
+exit $status
@@ -0,0 +1,116 @@
+#!/bin/bash
+# Benchmark suite for taskctl, run by "make bench".
+#
+# Drives taskctl in batch through a coprocess and reports:
+#   register   task-registration throughput
+#   exec       foreground exec turnaround of my_echo
+#   fanout     bg fan-out of N my_echo tasks (launch rate)
+#   reap       reap throughput while the fan-out's SIGCHLDs arrive
+#   pipe       pipe throughput from a producer task to a consumer task
+#   list       list latency at large task-table sizes
+#
+# Each benchmark starts a fresh controller. The metrics instruction is used
+# as a barrier: its reply only comes back once every earlier line is done.
+#
+# Usage: bench/run.sh [csv|json] [quick]
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+if [ "$2" = quick ]; then
+    REGISTER=2000; EXECS=200; FANOUT="100 1000"; PIPE_MB=64; LIST="100 1000"
+else
+    REGISTER=10000; EXECS=1000; FANOUT="1000 10000"; PIPE_MB=512; LIST="100 1000 10000"
+fi
+
+bench_register() {
+    start
+    local t0; t0=$(now)
+    for ((i = 0; i < REGISTER; i++)); do send "my_echo $i"; done
+    barrier
+    local t1; t1=$(now)
+    stop
+    result register "$REGISTER" "$(rate "$REGISTER" "$(elapsed "$t0" "$t1")")" tasks/s
+}
+
+bench_exec() {
+    start
+    send "my_echo 0"
+    barrier
+    local t0; t0=$(now)
+    for ((i = 0; i < EXECS; i++)); do send "exec 0 > /dev/null"; done
+    barrier
+    local t1; t1=$(now)
+    stop
+    result exec "$EXECS" "$(awk -v s="$(elapsed "$t0" "$t1")" -v n="$EXECS" 'BEGIN { printf "%.3f", s * 1000 / n }')" ms/exec
+}
+
+# Fan-out and reap of N background tasks in one run.
+bench_fanout() {
+    local n=$1
+    start
+    for ((i = 0; i < n; i++)); do send "my_echo 0"; done
+    barrier
+
+    local t0; t0=$(now)
+    for ((i = 0; i < n; i++)); do send "bg $i > /dev/null"; done
+    barrier
+    local t1; t1=$(now)
+
+    # every task reaped; give up after a minute without progress
+    local done=0 last=0 idle=0
+    while [ "$done" -lt "$n" ] && [ "$idle" -lt 6000 ]; do
+        barrier
+        done=$(metric 'kitc_tasks{state="finished"}')
+        done=${done:-0}
+        if [ "$done" = "$last" ]; then idle=$((idle + 1)); else idle=0; last=$done; fi
+        sleep 0.01
+    done
+    local t2; t2=$(now)
+    stop
+
+    result fanout "$n" "$(rate "$n" "$(elapsed "$t0" "$t1")")" launches/s
+    result reap "$n" "$(rate "$done" "$(elapsed "$t0" "$t2")")" reaps/s
+    result reap_lost "$n" "$((n - done))" tasks
+}
+
+bench_pipe() {
+    local bytes=$((PIPE_MB * 1024 * 1024))
+    start
+    send "head -c $bytes /dev/zero"
+    send "wc -c"
+    barrier
+
+    local t0; t0=$(now)
+    send "pipe 0 1"
+    local line
+    # wc prints the byte count once the consumer has drained the pipe
+    while IFS= read -r line <&"${CTL[0]}"; do
+        line=${line//kitc\$ /}
+        [ "${line// /}" = "$bytes" ] && break
+    done
+    local t1; t1=$(now)
+    stop
+    result pipe "$PIPE_MB" "$(awk -v mb="$PIPE_MB" -v s="$(elapsed "$t0" "$t1")" 'BEGIN { printf "%.1f", mb / s }')" MB/s
+}
+
+bench_list() {
+    local n=$1
+    start
+    for ((i = 0; i < n; i++)); do send "my_echo $i"; done
+    barrier
+    local t0; t0=$(now)
+    send "list"
+    barrier
+    local t1; t1=$(now)
+    stop
+    result list "$n" "$(awk -v s="$(elapsed "$t0" "$t1")" 'BEGIN { printf "%.3f", s * 1000 }')" ms
+}
+
+bench_register
+bench_exec
+for n in $FANOUT; do bench_fanout "$n"; done
+bench_pipe
+for n in $LIST; do bench_list "$n"; done
+
+report "$FORMAT"
@@ -0,0 +1,66 @@
+#!/bin/bash
+# Schedules on the timer wheel: what they cost to add, what they cost while
+# nothing is due, and whether runs come on time.
+#   schedule   throughput of "every 1h TASK" for N tasks
+#   idle_cpu   controller cpu while the N schedules wait, in ms per second
+#   runs       runs of "every 100ms" in 3 s (30 on time)
+#   queue_manual  runs of "at +100ms TASK queue" launched behind a 0.5 s
+#              run started by hand with bg (1; 0 means the queued run hung)
+#
+# Usage: bench/schedule.sh [csv|json] [N...]   (default: 0 1000 10000)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+shift 2>/dev/null
+SIZES=${*:-0 1000 10000}
+IDLE=5    # seconds of idle time measured
+
+# utime + stime of the controller, in clock ticks
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+for n in $SIZES; do
+    start
+    pid=$(pgrep -P "$CTL_PID" -x taskctl || echo "$CTL_PID")
+    for ((i = 0; i < n; i++)); do send "true"; done
+    barrier
+
+    t0=$(now)
+    for ((i = 0; i < n; i++)); do send "every 1h $i"; done
+    barrier
+    [ "$n" -gt 0 ] && result schedule "$n" "$(rate "$n" "$(elapsed "$t0" "$(now)")")" schedules/s
+
+    c0=$(cpu_ticks "$pid")
+    sleep "$IDLE"
+    c1=$(cpu_ticks "$pid")
+    result idle_cpu "$n" "$(awk -v c=$((c1 - c0)) -v hz="$(getconf CLK_TCK)" -v s="$IDLE" 'BEGIN { printf "%.3f", c * 1000 / hz / s }')" ms/s
+    stop
+done
+
+start
+send "true"
+barrier
+s0=$(metric kitc_spawns_total)
+send "every 100ms 0"
+sleep 3
+send "every off 0"
+barrier
+runs=$(($(metric kitc_spawns_total) - s0))
+stop
+result runs 100ms "$runs" runs
+
+start
+send "sleep 0.5"
+send "bg 0"
+barrier
+s0=$(metric kitc_spawns_total)
+send "at +100ms 0 queue"
+sleep 1
+barrier
+runs=$(($(metric kitc_spawns_total) - s0))
+stop
+result queue_manual 1s "$runs" runs
+
+report "$FORMAT"
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Task-table scaling with the simulator backend: no task forks, so the cost
+# of each phase is the controller's own data structures and logging.
+#
+# For each size N, N workload tasks of 1-97 ms are registered, all started
+# in the background, run to completion in virtual time, listed and purged.
+#   register   task-registration throughput
+#   bg         bg throughput (task lookup and spawn)
+#   run        reap throughput while the simulator finishes every task
+#   list       list latency with N finished tasks
+#   purge      purge throughput, oldest task first
+#
+# Usage: bench/sim.sh [csv|json] [N...]   (default sizes: 1000 10000)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+shift
+SIZES=${*:-1000 10000}
+
+# Times one phase: sends every line of stdin (not a pipe: coprocess fds
+# are closed in subshells), waits on a barrier and records
+# the phase as a rate over n, or as milliseconds if n is 0.
+phase() {
+    local name=$1 size=$2 n=$3 line
+    local t0; t0=$(now)
+    while IFS= read -r line; do send "$line"; done
+    barrier
+    local s; s=$(elapsed "$t0" "$(now)")
+    if [ "$n" -gt 0 ]; then
+        result "$name" "$size" "$(rate "$n" "$s")" tasks/s
+    else
+        result "$name" "$size" "$(awk -v s="$s" 'BEGIN { printf "%.3f", s * 1000 }')" ms
+    fi
+}
+
+for n in $SIZES; do
+    start
+    send "backend sim"
+    barrier
+    phase register "$n" "$n" < <(for ((i = 0; i < n; i++)); do echo "workload sleep=$((i % 97 + 1)) exit=$((i % 4))"; done)
+    phase bg "$n" "$n" < <(for ((i = 0; i < n; i++)); do echo "bg $i"; done)
+    phase run "$n" "$n" <<< "sim run"
+    phase list "$n" 0 <<< "list"
+    phase purge "$n" "$n" < <(for ((i = 0; i < n; i++)); do echo "purge $i"; done)
+    stop
+done
+
+report "$FORMAT"
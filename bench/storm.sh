@@ -0,0 +1,57 @@
+#!/bin/bash
+# A fork storm: N "bg TASK" lines (sleep 1) sent at once, with the launch limiter off,
+# on, and off with launches spawned on one launcher thread a cpu. Reported for each mode:
+#   accept     time until the controller answers a request sent right after
+#              the burst (how long it is unresponsive)
+#   drain      time until every task of the burst has been launched
+#   rtt_max    slowest request round trip while the burst drains
+#   running    most tasks seen running at once
+#
+# Usage: bench/storm.sh [csv|json] [N] [RATE]   (default: 10000 tasks, limit 500/s)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+N=${2:-10000}
+RATE=${3:-500}
+
+ms() {
+    awk -v s="$(elapsed "$1" "$2")" 'BEGIN { printf "%.1f", s * 1000 }'
+}
+
+for mode in off "$RATE" launchers; do
+    start
+    for ((i = 0; i < N; i++)); do send "sleep 1"; done
+    if [ "$mode" = launchers ]; then
+        send "limit off"
+        send "launchers $(nproc)"
+    else
+        send "limit $mode"
+    fi
+    barrier
+    s0=$(metric kitc_spawns_total)
+
+    t0=$(now)
+    for ((i = 0; i < N; i++)); do send "bg $i"; done
+    barrier
+    result "accept_$mode" "$N" "$(ms "$t0" "$(now)")" ms
+
+    rtt_max=0
+    running=0
+    while :; do
+        t1=$(now)
+        barrier
+        rtt=$(ms "$t1" "$(now)")
+        rtt_max=$(awk -v a="$rtt_max" -v b="$rtt" 'BEGIN { print (b > a) ? b : a }')
+        r=$(metric 'kitc_tasks{state="running"}')
+        [ "$r" -gt "$running" ] && running=$r
+        [ $(($(metric kitc_spawns_total) - s0)) -ge "$N" ] && break
+        sleep 0.01
+    done
+    result "drain_$mode" "$N" "$(ms "$t0" "$(now)")" ms
+    result "rtt_max_$mode" "$N" "$rtt_max" ms
+    result "running_$mode" "$N" "$running" tasks
+    stop
+done
+
+report "$FORMAT"
@@ -0,0 +1,69 @@
+#!/bin/bash
+# Fan-out and fan-in throughput through the relays of tee and merge.
+#   tee        one producer to N consumers, duplicated in the kernel (tee/splice)
+#   tee_copy   the same through a user-space copy loop (tee copy)
+#   merge      N producers merged a line at a time into one consumer
+# Rates count the bytes the producers write, in MB/s.
+#
+# Usage: bench/tee.sh [csv|json] [MB] [N...]   (default: 256 MB, 2 and 4 consumers or producers)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+MB=${2:-256}
+shift 2 2>/dev/null || shift $#
+WIDTHS=${*:-2 4}
+
+# Waits until $2 consumers have printed the byte count $1.
+wait_counts() {
+    local seen=0 line
+    while ((seen < $2)) && IFS= read -r line <&"${CTL[0]}"; do
+        line=${line//kitc\$ /}
+        [ "${line// /}" = "$1" ] && seen=$((seen + 1))
+    done
+}
+
+# bench_fanout NAME INSTRUCTION N
+bench_fanout() {
+    local bytes=$((MB * 1024 * 1024)) targets="" i
+    start
+    send "head -c $bytes /dev/zero"
+    for ((i = 1; i <= $3; i++)); do
+        send "wc -c"
+        targets+=" $i"
+    done
+    barrier
+
+    local t0; t0=$(now)
+    send "$2 0 ->$targets"
+    wait_counts "$bytes" "$3"
+    local s; s=$(elapsed "$t0" "$(now)")
+    stop
+    result "$1" "$3" "$(awk -v mb="$MB" -v s="$s" 'BEGIN { printf "%.1f", mb / s }')" MB/s
+}
+
+bench_merge() {
+    local each=$((MB * 1024 * 1024 / $1)) sources="" i
+    start
+    for ((i = 0; i < $1; i++)); do
+        send "workload line=128 out=$each"
+        sources+="$i "
+    done
+    send "wc -c"
+    barrier
+
+    local t0; t0=$(now)
+    send "merge $sources-> $1"
+    wait_counts "$((each * $1))" 1
+    local s; s=$(elapsed "$t0" "$(now)")
+    stop
+    result merge "$1" "$(awk -v mb="$MB" -v s="$s" 'BEGIN { printf "%.1f", mb / s }')" MB/s
+}
+
+for n in $WIDTHS; do
+    bench_fanout tee tee "$n"
+    bench_fanout tee_copy "tee copy" "$n"
+    bench_merge "$n"
+done
+
+report "$FORMAT"
@@ -0,0 +1,85 @@
+#!/bin/bash
+# Watched tasks: what a change to their input costs and what a non-change
+# does not.
+#   latency   write of the input to the re-run launched, averaged over RUNS
+#             changes (includes the WATCH_DEBOUNCE quiet period)
+#   touch     re-runs after RUNS touches that leave the content alone (0)
+#   burst     re-runs after 100 writes in a row (1)
+#   shared    re-runs after one change to an input N tasks share (N)
+#   manual    re-runs after a change during a run started by hand with bg
+#             (1; 0 means the pending re-run hung)
+#
+# Usage: bench/watch.sh [csv|json] [RUNS]   (default: 20 runs)
+# Output: one row per result (benchmark,param,value,unit), as CSV or JSON.
+
+. "$(dirname "$0")/lib.sh"
+FORMAT=${1:-csv}
+RUNS=${2:-20}
+SHARED=100
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+IN=$DIR/in
+
+# Waits until more than $1 tasks have been launched, and prints how many were
+spawned_past() {
+    local n
+    while barrier; n=$(metric kitc_spawns_total); [ "$n" -le "$1" ]; do sleep 0.005; done
+    echo "$n"
+}
+
+# Spawns after a quiet period long enough for any check to have run
+settled() {
+    sleep 0.2
+    barrier
+    metric kitc_spawns_total
+}
+
+echo 0 > "$IN"
+start
+send "cat"
+send "watch 0 < $IN > $DIR/out"
+barrier
+
+s=$(settled)
+total=0
+for ((r = 1; r <= RUNS; r++)); do
+    t0=$(now)
+    echo "$r" > "$IN"
+    s=$(spawned_past "$s")
+    total=$(awk -v t="$total" -v e="$(elapsed "$t0" "$(now)")" 'BEGIN { print t + e }')
+    sleep 0.1
+done
+result latency "$RUNS" "$(awk -v t="$total" -v n="$RUNS" 'BEGIN { printf "%.3f", t * 1000 / n }')" ms
+
+s=$(settled)
+for ((r = 0; r < RUNS; r++)); do touch "$IN"; sleep 0.06; done
+result touch "$RUNS" $(($(settled) - s)) runs
+
+s=$(settled)
+for ((r = 0; r < 100; r++)); do echo "burst $r" >> "$IN"; done
+result burst 100 $(($(settled) - s)) runs
+stop
+
+start
+for ((i = 0; i < SHARED; i++)); do
+    send "cat"
+    send "watch $i < $IN > /dev/null"
+done
+s=$(settled)
+echo shared > "$IN"
+sleep 0.5
+result shared "$SHARED" $(($(settled) - s)) runs
+stop
+
+start
+send "sleep 0.3"
+send "watch 0 < $IN"
+s=$(settled)
+send "bg 0"
+barrier
+echo manual > "$IN"
+sleep 0.8
+result manual 1 $(($(settled) - s - 1)) runs
+stop
+
+report "$FORMAT"
@@ -0,0 +1,258 @@
+/* Output memoization cache, see cache.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "cache.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+#define COPY_SIZE  65536
+
+static long cache_hits = 0;
+static long cache_misses = 0;
+
+/* One entry found while scanning the store for eviction */
+typedef struct cache_entry {
+    char key[CACHE_KEYLEN];
+    long bytes;
+    struct timespec used;
+} cache_entry;
+
+/* FNV-1a over a buffer, continuing from hash */
+static unsigned long long fnv1a(unsigned long long hash, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Builds "CACHE_DIR/KEY.SUFFIX" into buf */
+static void entry_path(char *buf, size_t size, const char *key, const char *suffix) {
+    snprintf(buf, size, "%s/%s.%s", CACHE_DIR, key, suffix);
+}
+
+/* Copies all of src into dst, trying a reflink first.
+ * Returns 0 on success and -1 otherwise. */
+static int copy_fd(int src, int dst) {
+    if (ioctl(dst, FICLONE, src) == 0) { return 0; }
+
+    // no reflink; let the kernel copy, then fall back to read/write
+    ssize_t n;
+    while ((n = copy_file_range(src, NULL, dst, NULL, COPY_SIZE, 0)) > 0) { }
+    if (n == 0) { return 0; }
+
+    char buf[COPY_SIZE];
+    lseek(src, 0, SEEK_SET);
+    lseek(dst, 0, SEEK_SET);
+    if (ftruncate(dst, 0)) { return -1; }
+    while ((n = read(src, buf, sizeof(buf))) > 0) {
+        if (write(dst, buf, n) != n) { return -1; }
+    }
+    return n < 0 ? -1 : 0;
+}
+
+int cache_key(const char *path, const char *cmdline, const char *infile, char key[CACHE_KEYLEN]) {
+    if (!path || !cmdline || !key) { return -1; }
+
+    // the executable counts as changed when its mtime or size does
+    struct stat st;
+    if (stat(path, &st)) { return -1; }
+    unsigned long long hash = FNV_OFFSET;
+    hash = fnv1a(hash, path, strlen(path) + 1);
+    hash = fnv1a(hash, &st.st_mtim, sizeof(st.st_mtim));
+    hash = fnv1a(hash, &st.st_size, sizeof(st.st_size));
+    hash = fnv1a(hash, cmdline, strlen(cmdline) + 1);
+
+    // the input counts by content
+    if (infile) {
+        int fd = open(infile, O_RDONLY);
+        if (fd < 0) { return -1; }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        char buf[COPY_SIZE];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            hash = fnv1a(hash, buf, n);
+        }
+        close(fd);
+        if (n < 0) { return -1; }
+    }
+
+    snprintf(key, CACHE_KEYLEN, "%016llx", hash);
+    return 0;
+}
+
+int cache_lookup(const char *key, const char *outfile, int *exit_code) {
+    if (!key || !outfile || !exit_code) { return -1; }
+
+    char path[256];
+    entry_path(path, sizeof(path), key, "code");
+    FILE *code = fopen(path, "r");
+    if (!code) {
+        cache_misses++;
+        return 0;
+    }
+    int found = fscanf(code, "%d", exit_code);
+    fclose(code);
+
+    entry_path(path, sizeof(path), key, "out");
+    int src = open(path, O_RDONLY);
+    if (found != 1 || src < 0) {
+        if (src >= 0) { close(src); }
+        cache_misses++;
+        return 0;
+    }
+
+    int dst = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst < 0) {
+        close(src);
+        return -1;
+    }
+    int ret = copy_fd(src, dst);
+    close(dst);
+
+    // mark the entry as most recently used
+    futimens(src, NULL);
+    close(src);
+
+    if (ret) { return -1; }
+    cache_hits++;
+    return 1;
+}
+
+/* Compares entries by last use, oldest first */
+static int by_use(const void *a, const void *b) {
+    const struct timespec *x = &((const cache_entry *) a)->used;
+    const struct timespec *y = &((const cache_entry *) b)->used;
+    if (x->tv_sec != y->tv_sec) { return x->tv_sec < y->tv_sec ? -1 : 1; }
+    if (x->tv_nsec != y->tv_nsec) { return x->tv_nsec < y->tv_nsec ? -1 : 1; }
+    return 0;
+}
+
+/* Scans the store. Returns a malloc'd array of *count entries, or NULL. */
+static cache_entry *scan_entries(long *count, long *bytes) {
+    *count = 0;
+    *bytes = 0;
+    DIR *dir = opendir(CACHE_DIR);
+    if (!dir) { return NULL; }
+
+    long cap = 64;
+    cache_entry *entries = malloc(cap * sizeof(cache_entry));
+    struct dirent *ent;
+    while (entries && (ent = readdir(dir)) != NULL) {
+        // one entry per KEY.out
+        const char *dot = strrchr(ent->d_name, '.');
+        if (!dot || strcmp(dot, ".out") || dot - ent->d_name != CACHE_KEYLEN - 1) { continue; }
+
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", CACHE_DIR, ent->d_name);
+        if (stat(path, &st)) { continue; }
+
+        if (*count == cap) {
+            cap *= 2;
+            cache_entry *grown = realloc(entries, cap * sizeof(cache_entry));
+            if (!grown) { break; }
+            entries = grown;
+        }
+        snprintf(entries[*count].key, CACHE_KEYLEN, "%.*s", CACHE_KEYLEN - 1, ent->d_name);
+        entries[*count].bytes = st.st_size;
+        entries[*count].used = st.st_mtim;
+        *bytes += st.st_size;
+        (*count)++;
+    }
+    closedir(dir);
+    return entries;
+}
+
+/* Evicts least recently used entries until the store fits in CACHE_MAXBYTES */
+static void evict(void) {
+    long count, bytes;
+    cache_entry *entries = scan_entries(&count, &bytes);
+    if (!entries) { return; }
+
+    qsort(entries, count, sizeof(cache_entry), by_use);
+    for (long i = 0; i < count && bytes > CACHE_MAXBYTES; i++) {
+        cache_invalidate(entries[i].key);
+        bytes -= entries[i].bytes;
+    }
+    free(entries);
+}
+
+int cache_store(const char *key, const char *outfile, int exit_code) {
+    if (!key || !outfile) { return -1; }
+    if (mkdir(CACHE_DIR, 0755) && errno != EEXIST) { return -1; }
+
+    int src = open(outfile, O_RDONLY);
+    if (src < 0) { return -1; }
+
+    // write under a temporary name so a reader never sees half an entry
+    char tmp[256], path[256];
+    entry_path(tmp, sizeof(tmp), key, "tmp");
+    int dst = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst < 0) {
+        close(src);
+        return -1;
+    }
+    int ret = copy_fd(src, dst);
+    close(src);
+    close(dst);
+
+    entry_path(path, sizeof(path), key, "code");
+    FILE *code = fopen(path, "w");
+    if (ret || !code) {
+        if (code) { fclose(code); }
+        unlink(tmp);
+        return -1;
+    }
+    fprintf(code, "%d\n", exit_code);
+    fclose(code);
+
+    entry_path(path, sizeof(path), key, "out");
+    if (rename(tmp, path)) {
+        unlink(tmp);
+        return -1;
+    }
+
+    evict();
+    return 0;
+}
+
+void cache_invalidate(const char *key) {
+    char path[256];
+    if (key) {
+        entry_path(path, sizeof(path), key, "out");
+        unlink(path);
+        entry_path(path, sizeof(path), key, "code");
+        unlink(path);
+        return;
+    }
+
+    long count, bytes;
+    cache_entry *entries = scan_entries(&count, &bytes);
+    for (long i = 0; entries && i < count; i++) {
+        cache_invalidate(entries[i].key);
+    }
+    free(entries);
+}
+
+void cache_stats(long *hits, long *misses, long *entries, long *bytes) {
+    long count = 0, size = 0;
+    free(scan_entries(&count, &size));
+    if (hits) { *hits = cache_hits; }
+    if (misses) { *misses = cache_misses; }
+    if (entries) { *entries = count; }
+    if (bytes) { *bytes = size; }
+}
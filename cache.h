@@ -0,0 +1,40 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+/* Output memoization cache for deterministic tasks.
+ *
+ * A task's output is stored on disk under a key made from its resolved
+ * executable (path, mtime and size), its command line, and the content of
+ * its input file.  A later run with the same key can restore the output
+ * instead of running the task again.
+ *
+ * Entries live in CACHE_DIR as KEY.out (the output) and KEY.code (the exit
+ * code).  The store is bounded by CACHE_MAXBYTES; the least recently used
+ * entries are evicted first, using each entry's mtime as its last use.
+ */
+
+#define CACHE_DIR ".kitc_cache"
+#define CACHE_MAXBYTES (64L * 1024 * 1024)
+#define CACHE_KEYLEN 17 /* 16 hex digits and a terminator */
+
+/* Builds the key of a run into key.  infile may be NULL.
+ * Returns 0 on success and -1 if the executable or input cannot be read. */
+int cache_key(const char *path, const char *cmdline, const char *infile, char key[CACHE_KEYLEN]);
+
+/* Restores the output of key into outfile, reflinking when the filesystem allows.
+ * Returns 1 on a hit (exit_code is set), 0 on a miss and -1 on error. */
+int cache_lookup(const char *key, const char *outfile, int *exit_code);
+
+/* Records outfile and exit_code as the result of key, then evicts down to size.
+ * Returns 0 on success and -1 otherwise. */
+int cache_store(const char *key, const char *outfile, int exit_code);
+
+/* Removes the entry for key, or every entry if key is NULL. */
+void cache_invalidate(const char *key);
+
+/* Hit and miss counts since start, and current entry count and bytes on disk. */
+void cache_stats(long *hits, long *misses, long *entries, long *bytes);
+
+#endif /*CACHE_H*/
@@ -0,0 +1,582 @@
+/* Local control socket, see control.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "control.h"
+
+#define FRAME_HEADER 4      /* bytes of the length before each frame */
+#define READ_CHUNK 4096     /* bytes read from a client at a time */
+
+typedef struct control_client {
+    int fd;             /* -1 if the slot is free */
+    int closing;        /* peer is done sending; dropped once answered */
+    long hold;          /* id of the held response it waits for, 0 if none */
+    char *in;           /* received bytes; in[in_pos, in_len) not yet taken */
+    size_t in_pos, in_len, in_cap;
+    char *out;          /* response bytes; out[out_pos, out_len) not yet sent */
+    size_t out_pos, out_len, out_cap;
+} control_client;
+
+static int listen_fd = -1;
+static char listen_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+static pid_t owner = 0;
+
+static control_client *clients = NULL;
+static int num_slots = 0, num_clients = 0;
+static int next_client = 0;     /* where the round-robin search starts */
+
+static struct pollfd *pfds = NULL;
+static int *pfd_slot = NULL;    /* client slot of each pollfd, -1 if none */
+static int pfd_cap = 0;
+
+/* Capture of the running request's output */
+static int capture_fd = -1;
+static int saved_out = -1, saved_err = -1;
+static int current = -1;
+static long holding;        /* hold taken by the running request, 0 if none */
+static long last_hold;
+
+/* Console log of a daemon */
+static int log_fd = -1;         /* read end of the log pipe */
+static int task_out = -1;       /* blocking write end, stdout and stderr of tasks */
+static int console = -1;        /* client attached as the console, or -1 */
+static int attaching = -1;      /* client to attach once its response is queued */
+static char backlog[CONTROL_BACKLOG];
+static size_t backlog_start = 0, backlog_len = 0;
+static long backlog_dropped = 0;    /* bytes pushed out of the backlog since the last replay */
+
+/* Makes room for len more bytes after used. Returns 0 on success and -1 otherwise. */
+static int reserve(char **buf, size_t *cap, size_t used, size_t len) {
+    if (used + len <= *cap) { return 0; }
+    size_t size = *cap ? *cap : READ_CHUNK;
+    while (size < used + len) { size *= 2; }
+    char *grown = realloc(*buf, size);
+    if (!grown) { return -1; }
+    *buf = grown;
+    *cap = size;
+    return 0;
+}
+
+static size_t unsent(const control_client *c) {
+    return c->out_len - c->out_pos;
+}
+
+/* Length of the request at the front of c's input, or -1 if it is not all in */
+static long front_request(const control_client *c) {
+    if (c->in_len - c->in_pos < FRAME_HEADER) { return -1; }
+    uint32_t len;
+    memcpy(&len, c->in + c->in_pos, FRAME_HEADER);
+    len = ntohl(len);
+    if (c->in_len - c->in_pos < FRAME_HEADER + (size_t) len) { return -1; }
+    return len;
+}
+
+static void drop_client(int i) {
+    control_client *c = &clients[i];
+    if (console == i) { console = -1; }
+    if (attaching == i) { attaching = -1; }
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    num_clients--;
+}
+
+static void add_client(int fd) {
+    int i = 0;
+    while (i < num_slots && clients[i].fd >= 0) { i++; }
+    if (i == num_slots) {
+        int slots = num_slots ? num_slots * 2 : 16;
+        control_client *grown = realloc(clients, slots * sizeof(control_client));
+        if (!grown) {
+            close(fd);
+            return;
+        }
+        clients = grown;
+        for (int j = num_slots; j < slots; j++) {
+            memset(&clients[j], 0, sizeof(control_client));
+            clients[j].fd = -1;
+        }
+        num_slots = slots;
+    }
+    clients[i].fd = fd;
+    num_clients++;
+}
+
+/* Queues a frame of len bytes for c, with flags or'ed into its length.
+ * Returns where its body goes, or NULL if there is no memory for it. */
+static char *queue_frame(control_client *c, uint32_t flags, size_t len) {
+    if (c->out_pos > 0) {
+        memmove(c->out, c->out + c->out_pos, unsent(c));
+        c->out_len -= c->out_pos;
+        c->out_pos = 0;
+    }
+    if (reserve(&c->out, &c->out_cap, c->out_len, FRAME_HEADER + len)) { return NULL; }
+    uint32_t header = htonl(len | flags);
+    memcpy(c->out + c->out_len, &header, FRAME_HEADER);
+    c->out_len += FRAME_HEADER + len;
+    return c->out + c->out_len - len;
+}
+
+/* Sends what it can of c's responses. Returns 0 unless the client is gone. */
+static int flush_out(control_client *c) {
+    while (unsent(c) > 0) {
+        ssize_t n = send(c->fd, c->out + c->out_pos, unsent(c), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            c->out_pos += n;
+        }
+        else if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+    }
+    // a one-off huge response does not pin its buffer
+    c->out_pos = c->out_len = 0;
+    if (c->out_cap > CONTROL_MAXOUT) {
+        free(c->out);
+        c->out = NULL;
+        c->out_cap = 0;
+    }
+    return 0;
+}
+
+/* Reads what has arrived from c. Returns 0 unless the client is gone or
+ * broke the framing. */
+static int read_in(control_client *c) {
+    if (c->in_pos > 0) {
+        memmove(c->in, c->in + c->in_pos, c->in_len - c->in_pos);
+        c->in_len -= c->in_pos;
+        c->in_pos = 0;
+    }
+    while (c->in_len < CONTROL_MAXOUT) {
+        if (reserve(&c->in, &c->in_cap, c->in_len, READ_CHUNK)) { return -1; }
+        ssize_t n = recv(c->fd, c->in + c->in_len, READ_CHUNK, MSG_DONTWAIT);
+        if (n > 0) {
+            c->in_len += n;
+            continue;
+        }
+        if (n == 0) {
+            c->closing = 1;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+        break;
+    }
+
+    // only the first frame is checked; the rest are checked as they come up
+    if (c->in_len - c->in_pos >= FRAME_HEADER) {
+        uint32_t len;
+        memcpy(&len, c->in + c->in_pos, FRAME_HEADER);
+        if (ntohl(len) > CONTROL_MAXREQ) { return -1; }
+    }
+    return 0;
+}
+
+/* Stops listening; connected clients stay. */
+static void close_listener(void) {
+    if (listen_fd < 0) { return; }
+    close(listen_fd);
+    unlink(listen_path);
+    listen_fd = -1;
+}
+
+int control_open(const char *path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (!path || strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    if (listen_fd >= 0 && !strcmp(path, listen_path)) { return 0; }
+
+    // a socket file nobody listens on was left by a controller that died
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        int taken = !connect(probe, (struct sockaddr *) &addr, sizeof(addr));
+        int stale = !taken && errno == ECONNREFUSED;
+        close(probe);
+        if (taken) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        struct stat st;
+        if (stale && !lstat(path, &st) && S_ISSOCK(st.st_mode)) {
+            unlink(path);
+        }
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { return -1; }
+    // requests can run any command, so only this user may connect
+    mode_t mask = umask(077);
+    int bound = !bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    umask(mask);
+    if (!bound || listen(fd, SOMAXCONN)) {
+        int saved = errno;
+        close(fd);
+        if (bound) { unlink(path); }
+        errno = saved;
+        return -1;
+    }
+
+    close_listener();
+    listen_fd = fd;
+    snprintf(listen_path, sizeof(listen_path), "%s", path);
+    if (!owner) { atexit(control_close); }
+    owner = getpid();
+    return 0;
+}
+
+void control_close(void) {
+    // forked children inherit the atexit handler, but not the socket file
+    if (listen_fd < 0 || owner != getpid()) { return; }
+    for (int i = 0; i < num_slots; i++) {
+        if (clients[i].fd >= 0) { drop_client(i); }
+    }
+    close_listener();
+}
+
+const char *control_path(void) {
+    return listen_fd >= 0 ? listen_path : NULL;
+}
+
+int control_clients(void) {
+    return num_clients;
+}
+
+/* Keeps the newest CONTROL_BACKLOG bytes of the log while no console is attached */
+static void backlog_add(const char *buf, size_t len) {
+    if (len > CONTROL_BACKLOG) {
+        backlog_dropped += len - CONTROL_BACKLOG;
+        buf += len - CONTROL_BACKLOG;
+        len = CONTROL_BACKLOG;
+    }
+    size_t room = CONTROL_BACKLOG - backlog_len;
+    if (len > room) {
+        backlog_start = (backlog_start + len - room) % CONTROL_BACKLOG;
+        backlog_len -= len - room;
+        backlog_dropped += len - room;
+    }
+    size_t end = (backlog_start + backlog_len) % CONTROL_BACKLOG;
+    size_t first = len < CONTROL_BACKLOG - end ? len : CONTROL_BACKLOG - end;
+    memcpy(backlog + end, buf, first);
+    memcpy(backlog, buf + first, len - first);
+    backlog_len += len;
+}
+
+/* Sends the backlog to client as console output and empties it.
+ * Returns 0 unless there is no memory for it. */
+static int replay(int client) {
+    char note[96] = "";
+    if (backlog_dropped) {
+        snprintf(note, sizeof(note), "[%ld bytes of earlier output dropped]\n", backlog_dropped);
+    }
+    size_t len = strlen(note);
+    char *body = queue_frame(&clients[client], CONTROL_OUTPUT, len + backlog_len);
+    if (!body) { return -1; }
+    memcpy(body, note, len);
+    size_t first = backlog_len < CONTROL_BACKLOG - backlog_start ? backlog_len : CONTROL_BACKLOG - backlog_start;
+    memcpy(body + len, backlog + backlog_start, first);
+    memcpy(body + len + first, backlog, backlog_len - first);
+    backlog_start = backlog_len = 0;
+    backlog_dropped = 0;
+    return 0;
+}
+
+/* Moves what has been written to the log to the console, or the backlog. */
+static void drain_log(void) {
+    char buf[READ_CHUNK * 4];
+    ssize_t n;
+    while ((console < 0 || unsent(&clients[console]) < CONTROL_MAXOUT)
+           && (n = read(log_fd, buf, sizeof(buf))) > 0) {
+        if (console < 0) {
+            backlog_add(buf, n);
+            continue;
+        }
+        char *body = queue_frame(&clients[console], CONTROL_OUTPUT, n);
+        if (body) { memcpy(body, buf, n); }
+        if (!body || flush_out(&clients[console])) {
+            drop_client(console);
+        }
+    }
+}
+
+int control_wait(int in_fd, int wake_fd, int timeout) {
+    // stdin, the wake fd, the listener and the log, then one per client slot
+    if (pfd_cap < num_slots + 4) {
+        int cap = num_slots + 4;
+        struct pollfd *grown = realloc(pfds, cap * sizeof(struct pollfd));
+        if (grown) { pfds = grown; }
+        int *slots = realloc(pfd_slot, cap * sizeof(int));
+        if (slots) { pfd_slot = slots; }
+        if (!grown || !slots) { return 0; }
+        pfd_cap = cap;
+    }
+
+    int n = 0;
+    if (in_fd >= 0) {
+        pfds[n] = (struct pollfd) { in_fd, POLLIN, 0 };
+        pfd_slot[n++] = -1;
+    }
+    if (wake_fd >= 0) {
+        pfds[n] = (struct pollfd) { wake_fd, POLLIN, 0 };
+        pfd_slot[n++] = -1;
+    }
+    int listen_at = n;
+    if (listen_fd >= 0) {
+        pfds[n] = (struct pollfd) { listen_fd, POLLIN, 0 };
+        pfd_slot[n++] = -1;
+    }
+    // a console that falls behind holds up the log, and with it the tasks writing to it
+    int log_at = n;
+    if (log_fd >= 0 && (console < 0 || unsent(&clients[console]) < CONTROL_MAXOUT)) {
+        pfds[n] = (struct pollfd) { log_fd, POLLIN, 0 };
+        pfd_slot[n++] = -1;
+    }
+    for (int i = 0; i < num_slots; i++) {
+        control_client *c = &clients[i];
+        if (c->fd < 0) { continue; }
+        // a client that sends faster than it reads is held until it catches up
+        short events = 0;
+        if (!c->closing && c->in_len - c->in_pos < CONTROL_MAXOUT && unsent(c) < CONTROL_MAXOUT) { events |= POLLIN; }
+        if (unsent(c) > 0) { events |= POLLOUT; }
+        pfds[n] = (struct pollfd) { c->fd, events, 0 };
+        pfd_slot[n++] = i;
+    }
+
+    if (poll(pfds, n, timeout) < 0) { return -1; }
+
+    for (int k = 0; k < n; k++) {
+        int i = pfd_slot[k];
+        if (i < 0 || !pfds[k].revents) { continue; }
+        control_client *c = &clients[i];
+        if ((pfds[k].revents & (POLLOUT | POLLERR | POLLHUP)) && flush_out(c)) {
+            drop_client(i);
+            continue;
+        }
+        if ((pfds[k].events & POLLIN) && (pfds[k].revents & (POLLIN | POLLHUP)) && read_in(c)) {
+            drop_client(i);
+            continue;
+        }
+        if (c->closing && !c->hold && !unsent(c) && front_request(c) < 0) {
+            drop_client(i);
+        }
+    }
+
+    if (log_at < n && pfds[log_at].fd == log_fd && pfds[log_at].revents) {
+        drain_log();
+    }
+
+    if (listen_fd >= 0 && listen_at < n && (pfds[listen_at].revents & POLLIN)) {
+        int fd;
+        while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            add_client(fd);
+        }
+    }
+
+    return in_fd >= 0 && (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) ? 1 : 0;
+}
+
+int control_next(char *line, size_t size) {
+    for (int k = 0; k < num_slots; k++) {
+        int i = (next_client + k) % num_slots;
+        control_client *c = &clients[i];
+        if (c->fd < 0 || c->hold || unsent(c) >= CONTROL_MAXOUT) { continue; }
+        long len = front_request(c);
+        if (len < 0) { continue; }
+
+        // a request is one line, cut to fit like a long line of stdin
+        const char *req = c->in + c->in_pos + FRAME_HEADER;
+        size_t copy = (size_t) len < size - 2 ? (size_t) len : size - 2;
+        const char *newline = memchr(req, '\n', copy);
+        if (newline) { copy = newline - req; }
+        memcpy(line, req, copy);
+        line[copy] = '\n';
+        line[copy + 1] = '\0';
+
+        c->in_pos += FRAME_HEADER + len;
+        next_client = i + 1;
+        return i;
+    }
+    return -1;
+}
+
+int control_pending(void) {
+    for (int i = 0; i < num_slots; i++) {
+        if (clients[i].fd >= 0 && !clients[i].hold && unsent(&clients[i]) < CONTROL_MAXOUT && front_request(&clients[i]) >= 0) { return 1; }
+    }
+    return 0;
+}
+
+void control_begin(int client) {
+    current = client;
+    fflush(stdout);
+    fflush(stderr);
+    if (capture_fd < 0) {
+        capture_fd = memfd_create("kitc-response", MFD_CLOEXEC);
+        if (capture_fd < 0) { return; }
+    }
+    if (ftruncate(capture_fd, 0) || lseek(capture_fd, 0, SEEK_SET) < 0) { return; }
+
+    saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    saved_err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (saved_out < 0 || saved_err < 0) {
+        if (saved_out >= 0) { close(saved_out); }
+        if (saved_err >= 0) { close(saved_err); }
+        saved_out = saved_err = -1;
+        return;
+    }
+    dup2(capture_fd, STDOUT_FILENO);
+    dup2(capture_fd, STDERR_FILENO);
+}
+
+void control_end(void) {
+    if (current < 0) { return; }
+    int client = current;
+    current = -1;
+
+    size_t len = 0;
+    fflush(stdout);
+    fflush(stderr);
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        dup2(saved_err, STDERR_FILENO);
+        close(saved_out);
+        close(saved_err);
+        saved_out = saved_err = -1;
+        struct stat st;
+        if (!fstat(capture_fd, &st)) { len = st.st_size; }
+    }
+
+    // the client may have gone, or been closed by the request itself
+    long hold = holding;
+    holding = 0;
+    if (client >= num_slots || clients[client].fd < 0) { return; }
+    control_client *c = &clients[client];
+    c->hold = hold;
+    if (hold) { return; }
+    if (attaching == client) {
+        attaching = -1;
+        if (replay(client)) {
+            drop_client(client);
+            return;
+        }
+    }
+    char *body = queue_frame(c, 0, len);
+    if (!body) {
+        drop_client(client);
+        return;
+    }
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(capture_fd, body + got, len - got, got);
+        if (n <= 0) { break; }
+        got += n;
+    }
+    // anything unreadable goes out as blanks, so the framing holds
+    memset(body + got, ' ', len - got);
+
+    if (flush_out(c)) {
+        drop_client(client);
+    }
+}
+
+int control_current(void) {
+    return current;
+}
+
+long control_hold(void) {
+    if (current < 0) { return 0; }
+    holding = ++last_hold;
+    return holding;
+}
+
+int control_resume(long hold) {
+    for (int i = 0; hold && i < num_slots; i++) {
+        if (clients[i].fd >= 0 && clients[i].hold == hold) {
+            control_begin(i);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void control_child(void) {
+    if (task_out >= 0) {
+        dup2(task_out, STDOUT_FILENO);
+        dup2(task_out, STDERR_FILENO);
+    }
+    else if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        dup2(saved_err, STDERR_FILENO);
+    }
+}
+
+int control_log_open(void) {
+    if (log_fd >= 0) { return 0; }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC)) { return -1; }
+    // room for bursts while the controller is busy with a command
+    fcntl(fds[0], F_SETPIPE_SZ, CONTROL_MAXOUT);
+
+    // The controller writes through its own non-blocking open of the pipe,
+    // so a full log costs it lines rather than stopping it; tasks keep the
+    // blocking end and just wait for the log to drain.
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fds[1]);
+    int own = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (own < 0 || fcntl(fds[0], F_SETFL, O_NONBLOCK)) {
+        if (own >= 0) { close(own); }
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    dup2(own, STDOUT_FILENO);
+    dup2(own, STDERR_FILENO);
+    close(own);
+    log_fd = fds[0];
+    task_out = fds[1];
+    return 0;
+}
+
+int control_attach(int client) {
+    if (log_fd < 0 || client < 0 || client >= num_slots || clients[client].fd < 0) { return -1; }
+    attaching = client;
+    if (console >= 0 && console != client) {
+        static const char note[] = "[another console attached]\n";
+        char *body = queue_frame(&clients[console], CONTROL_OUTPUT, sizeof(note) - 1);
+        if (body) { memcpy(body, note, sizeof(note) - 1); }
+    }
+    console = client;
+    return 0;
+}
+
+int control_detach(int client) {
+    if (client < 0 || console != client) { return -1; }
+    console = -1;
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stddef.h>
+
+/* Local control socket, so other programs can drive the controller.
+ *
+ * The controller listens on a unix stream socket.  A request is one
+ * instruction line and its response is everything the instruction printed
+ * (stdout and stderr, in order).  Both travel as frames: a 4-byte
+ * big-endian length, then that many bytes.  A client may send requests
+ * back to back; responses come back in the same order.
+ *
+ * All sockets are non-blocking and polled together with stdin by the main
+ * loop, so any number of clients can be connected at once with no threads.
+ * Requests are taken one at a time, round-robin across clients, and run
+ * exactly like typed instructions.  A client that does not read its
+ * responses has its further requests held once CONTROL_MAXOUT bytes are
+ * waiting for it.
+ *
+ * A daemon has no terminal: its own output and its tasks' go to a log
+ * instead.  One client at a time may attach as the console, and is sent
+ * the log as it comes, in frames marked with CONTROL_OUTPUT to tell them
+ * from responses.  While no console is attached the newest CONTROL_BACKLOG
+ * bytes are kept, and replayed to the next console that attaches.
+ */
+
+#define CONTROL_MAXREQ 4096        /* longest request; longer ones drop the client */
+#define CONTROL_MAXOUT (1 << 20)   /* unsent response bytes before a client's requests are held */
+#define CONTROL_BACKLOG (64 << 10) /* log bytes kept while no console is attached */
+#define CONTROL_OUTPUT 0x80000000u /* set in the length of a console output frame */
+
+/* Listens on path, replacing a stale socket left there.  A socket already
+ * listening elsewhere is closed once the new one is up; its clients stay
+ * connected.  Returns 0 on success and -1 otherwise. */
+int control_open(const char *path);
+
+/* Closes the socket and every client, and removes the socket file. */
+void control_close(void);
+
+/* Path listened on, or NULL if the socket is closed. */
+const char *control_path(void);
+
+/* Number of connected clients. */
+int control_clients(void);
+
+/* Waits up to timeout ms (-1: no limit) for input on in_fd (-1: none),
+ * wake_fd (-1: none) or socket activity, and services the sockets: accepts
+ * clients, reads requests and sends responses.  wake_fd only cuts the wait
+ * short, for the caller to see to it.  Returns 1 if in_fd is readable, 0 if
+ * not, and -1 with errno set if a signal cut the wait short. */
+int control_wait(int in_fd, int wake_fd, int timeout);
+
+/* Takes the next waiting request, copied into line as a command line ending
+ * in a newline like one read from stdin.  Returns the client it came from,
+ * or -1 if none is waiting. */
+int control_next(char *line, size_t size);
+
+/* Whether a request is waiting to be taken. */
+int control_pending(void);
+
+/* Starts capturing stdout and stderr as the response to client. */
+void control_begin(int client);
+
+/* Stops the capture and queues what was captured as the client's response. */
+void control_end(void);
+
+/* Client whose request is running, or -1. */
+int control_current(void);
+
+/* Holds the response of the running request: control_end() sends nothing
+ * (what it printed is dropped) and the client's later requests wait, until
+ * the response is written between control_resume() and control_end().
+ * Returns the id of the hold, or 0 if no request is running. */
+long control_hold(void);
+
+/* Starts capturing the held response of hold, like control_begin().
+ * Returns 0 on success and -1 if its client is gone. */
+int control_resume(long hold);
+
+/* Sends stdout and stderr, and those of tasks started from now on, to the
+ * console log.  Returns 0 on success and -1 otherwise. */
+int control_log_open(void);
+
+/* Makes client the console, taking over from any other; the backlog is
+ * replayed ahead of its response.  Returns 0 on success and -1 if there is
+ * no console log. */
+int control_attach(int client);
+
+/* Stops client being the console. Returns 0 on success and -1 if it was not. */
+int control_detach(int client);
+
+/* In a freshly forked child, puts back the stdout and stderr a capture
+ * replaced, so tasks never write into a response; with a console log, gives
+ * it the log's blocking end. */
+void control_child(void);
+
+#endif /*CONTROL_H*/
@@ -0,0 +1,436 @@
+/* Write-ahead journal of the task table, see journal.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+#include "logging.h"
+
+#define SNAP_MAGIC "KITCSNAP"
+#define SNAP_VERSION 1
+#define COMPACT_MIN (256 << 10) /* journal bytes before compaction is considered */
+#define MAX_TASKS (1 << 24)     /* task numbers beyond this are taken as corruption */
+
+#define REC_ADD 1      /* task added: command, and in a snapshot its state */
+#define REC_PURGE 2    /* task purged */
+#define REC_STATE 3    /* pid, state and exit code of a task */
+
+/* One record, padded to a multiple of 8 bytes.  The sum covers everything
+ * after it, so a torn or overwritten record is never replayed. */
+typedef struct journal_record {
+    uint32_t len;
+    uint32_t sum;
+    uint64_t seq;
+    int32_t type, task, pid, state, exit_code;
+    int32_t cmd_len;
+    char command[];
+} journal_record;
+
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    uint64_t seq;      /* last journal record the snapshot includes */
+    uint64_t count;    /* records that follow */
+} snapshot_header;
+
+/* A task while the files are read back */
+typedef struct replay_task {
+    int present;
+    pid_t pid;
+    int state;
+    int exit_code;
+    char *command;
+} replay_task;
+
+static int journal_fd = -1;
+static char journal_file[4096];
+static char snapshot_file[4096 + 8];
+
+/* Records not committed yet.  used can run past JOURNAL_BUFSIZE when the
+ * buffer fills; the records that did not fit are dropped and the next
+ * commit becomes a snapshot instead. */
+static char *buf = NULL;
+static size_t buf_used = 0;
+static volatile sig_atomic_t overflowed = 0;
+static volatile sig_atomic_t need_snapshot = 0;
+static long oldest_ns = 0;      /* when the first uncommitted record came */
+static uint64_t next_seq = 1;
+
+/* Snapshot being written */
+static FILE *snap_out = NULL;
+static char snap_tmp[sizeof(snapshot_file) + 4];
+static uint64_t snap_seq = 0;
+static long snap_count = 0;
+
+/* Counters */
+static long snapshot_tasks = 0, snapshot_bytes = 0;
+static long journal_records = 0, journal_bytes = 0, commits = 0;
+
+/* Replay table */
+static replay_task *table = NULL;
+static long table_cap = 0;
+
+static uint32_t fnv1a(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) { return -1; }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Fills in a record in rec, which must hold sizeof(journal_record) + JOURNAL_CMDLEN bytes. */
+static void make_record(journal_record *rec, uint64_t seq, int type, int task, pid_t pid,
+                        int state, int exit_code, const char *cmd) {
+    size_t cmd_len = cmd ? strnlen(cmd, JOURNAL_CMDLEN) : 0;
+    size_t len = (sizeof(journal_record) + cmd_len + 7) & ~(size_t) 7;
+    memset(rec, 0, len);
+    rec->len = len;
+    rec->seq = seq;
+    rec->type = type;
+    rec->task = task;
+    rec->pid = pid;
+    rec->state = state;
+    rec->exit_code = exit_code;
+    rec->cmd_len = cmd_len;
+    if (cmd_len) { memcpy(rec->command, cmd, cmd_len); }
+    rec->sum = fnv1a(&rec->seq, len - offsetof(journal_record, seq));
+}
+
+/* Claims room in the buffer and copies a record in.  Runs in signal
+ * handlers too, so the claim is a single atomic add. */
+static void append(int type, int task, pid_t pid, int state, int exit_code, const char *cmd) {
+    if (journal_fd < 0) { return; }
+    union { journal_record rec; char bytes[sizeof(journal_record) + JOURNAL_CMDLEN + 8]; } u;
+    uint64_t seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+    make_record(&u.rec, seq, type, task, pid, state, exit_code, cmd);
+
+    size_t at = __atomic_fetch_add(&buf_used, u.rec.len, __ATOMIC_RELAXED);
+    if (at + u.rec.len > JOURNAL_BUFSIZE) {
+        overflowed = 1;
+        return;
+    }
+    if (at == 0) { oldest_ns = mono_ns(); }
+    memcpy(buf + at, &u.rec, u.rec.len);
+    __atomic_fetch_add(&journal_records, 1, __ATOMIC_RELAXED);
+}
+
+/* Checks the record at data[off, size). Returns its length, or 0 if it is torn or corrupt. */
+static size_t check_record(const char *data, size_t off, size_t size) {
+    if (size - off < sizeof(journal_record)) { return 0; }
+    const journal_record *rec = (const journal_record *) (data + off);
+    if (rec->len < sizeof(journal_record) || rec->len % 8 || rec->len > size - off) { return 0; }
+    if (rec->cmd_len < 0 || rec->cmd_len > JOURNAL_CMDLEN
+        || (size_t) rec->cmd_len > rec->len - sizeof(journal_record)) { return 0; }
+    if (rec->task < 0 || rec->task >= MAX_TASKS) { return 0; }
+    if (rec->sum != fnv1a(&rec->seq, rec->len - offsetof(journal_record, seq))) { return 0; }
+    return rec->len;
+}
+
+/* Applies one record to the replay table. Returns 0 on success and -1 otherwise. */
+static int apply(const journal_record *rec) {
+    if (rec->task >= table_cap) {
+        long cap = table_cap ? table_cap : 64;
+        while (cap <= rec->task) { cap *= 2; }
+        replay_task *grown = realloc(table, cap * sizeof(replay_task));
+        if (!grown) { return -1; }
+        memset(grown + table_cap, 0, (cap - table_cap) * sizeof(replay_task));
+        table = grown;
+        table_cap = cap;
+    }
+
+    replay_task *t = &table[rec->task];
+    switch (rec->type) {
+    case REC_ADD:
+        free(t->command);
+        t->command = strndup(rec->command, rec->cmd_len);
+        if (!t->command) { return -1; }
+        t->present = 1;
+        t->pid = rec->pid;
+        t->state = rec->state;
+        t->exit_code = rec->exit_code;
+        break;
+    case REC_PURGE:
+        free(t->command);
+        t->command = NULL;
+        t->present = 0;
+        break;
+    case REC_STATE:
+        if (t->present) {
+            t->pid = rec->pid;
+            t->state = rec->state;
+            t->exit_code = rec->exit_code;
+        }
+        break;
+    }
+    return 0;
+}
+
+/* Reads the snapshot into the replay table. Returns 0 on success (also when
+ * there is none) and -1 otherwise. */
+static int load_snapshot(void) {
+    int fd = open(snapshot_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return 0; }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(snapshot_header)) {
+        close(fd);
+        return 0;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { return -1; }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    int ret = 0;
+    const snapshot_header *header = (const snapshot_header *) data;
+    if (!memcmp(header->magic, SNAP_MAGIC, 8) && header->version == SNAP_VERSION) {
+        size_t off = sizeof(snapshot_header);
+        uint64_t count = 0;
+        size_t len;
+        while (count < header->count && (len = check_record(data, off, st.st_size))) {
+            if (apply((const journal_record *) (data + off))) { ret = -1; break; }
+            off += len;
+            count++;
+        }
+        snap_seq = header->seq;
+        snapshot_tasks = count;
+        snapshot_bytes = st.st_size;
+    }
+    munmap(data, st.st_size);
+    return ret;
+}
+
+/* Replays the journal on top of the snapshot, cutting it at the first bad
+ * record.  Returns 0 on success and -1 otherwise. */
+static int replay_journal(void) {
+    struct stat st;
+    if (fstat(journal_fd, &st)) { return -1; }
+    next_seq = snap_seq + 1;
+    if (st.st_size == 0) { return 0; }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, journal_fd, 0);
+    if (data == MAP_FAILED) { return -1; }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    int ret = 0;
+    size_t off = 0, len;
+    while ((len = check_record(data, off, st.st_size))) {
+        const journal_record *rec = (const journal_record *) (data + off);
+        if (rec->seq > snap_seq && apply(rec)) { ret = -1; break; }
+        if (rec->seq >= next_seq) { next_seq = rec->seq + 1; }
+        off += len;
+        journal_records++;
+    }
+    munmap(data, st.st_size);
+
+    // what follows the last good record was never committed
+    if (!ret && off < (size_t) st.st_size) {
+        if (ftruncate(journal_fd, off) || fdatasync(journal_fd)) { ret = -1; }
+    }
+    journal_bytes = off;
+    return ret;
+}
+
+static void free_table(void) {
+    for (long i = 0; i < table_cap; i++) { free(table[i].command); }
+    free(table);
+    table = NULL;
+    table_cap = 0;
+}
+
+long journal_open(const char *path, void (*restore)(const journal_task *task, void *arg), void *arg) {
+    if (strlen(path) >= sizeof(journal_file)) { return -1; }
+    journal_close();
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) { return -1; }
+    if (!buf && !(buf = malloc(JOURNAL_BUFSIZE))) {
+        close(fd);
+        return -1;
+    }
+    strcpy(journal_file, path);
+    snprintf(snapshot_file, sizeof(snapshot_file), "%s.snap", path);
+    journal_fd = fd;
+    buf_used = 0;
+    overflowed = need_snapshot = 0;
+    snap_seq = 0;
+    snapshot_tasks = snapshot_bytes = journal_records = journal_bytes = commits = 0;
+
+    // without restore, the table the caller has replaces what was there
+    if (!restore) {
+        next_seq = 1;
+        if (ftruncate(journal_fd, 0)) {
+            journal_close();
+            return -1;
+        }
+        return 0;
+    }
+
+    if (load_snapshot() || replay_journal()) {
+        free_table();
+        journal_close();
+        return -1;
+    }
+
+    long restored = 0;
+    for (long i = 0; i < table_cap; i++) {
+        if (!table[i].present) { continue; }
+        journal_task task = { i, table[i].pid, table[i].state, table[i].exit_code, table[i].command };
+        restore(&task, arg);
+        restored++;
+    }
+    free_table();
+    return restored;
+}
+
+void journal_close(void) {
+    if (journal_fd < 0) { return; }
+    journal_commit(0, 1);
+    close(journal_fd);
+    journal_fd = -1;
+}
+
+const char *journal_path(void) {
+    return journal_fd >= 0 ? journal_file : NULL;
+}
+
+void journal_add(int task, const char *cmd) {
+    append(REC_ADD, task, 0, LOG_STATE_READY, 0, cmd);
+}
+
+void journal_purge(int task) {
+    append(REC_PURGE, task, 0, 0, 0, NULL);
+}
+
+void journal_state(int task, pid_t pid, int state, int exit_code) {
+    append(REC_STATE, task, pid, state, exit_code, NULL);
+}
+
+int journal_commit(int input_waiting, int force) {
+    if (journal_fd < 0) { return 0; }
+    size_t used = __atomic_load_n(&buf_used, __ATOMIC_RELAXED);
+    if (used == 0) { return need_snapshot; }
+
+    // more instructions are coming: let them share the sync
+    if (!force && input_waiting && !overflowed && used < JOURNAL_GROUP_BYTES
+        && mono_ns() - oldest_ns < JOURNAL_GROUP_NS) { return 0; }
+
+    sigset_t all, old;
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &old);
+    used = buf_used;
+    if (overflowed) {
+        need_snapshot = 1;
+    } else if (write_all(journal_fd, buf, used) || fdatasync(journal_fd)) {
+        // the journal no longer follows the table; a snapshot puts it right
+        need_snapshot = 1;
+    } else {
+        journal_bytes += used;
+        commits++;
+    }
+    buf_used = 0;
+    overflowed = 0;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    if (journal_bytes > COMPACT_MIN && journal_bytes > snapshot_bytes) { return 1; }
+    return need_snapshot;
+}
+
+void journal_snapshot_begin(void) {
+    if (journal_fd < 0) { return; }
+    if (snap_out) { fclose(snap_out); }
+    snprintf(snap_tmp, sizeof(snap_tmp), "%s.tmp", snapshot_file);
+    snap_out = fopen(snap_tmp, "we");
+    if (!snap_out) { return; }
+    // changes recorded from here on may or may not make it in, so they are replayed after it
+    snap_seq = __atomic_load_n(&next_seq, __ATOMIC_RELAXED) - 1;
+    snap_count = 0;
+    snapshot_header header = { SNAP_MAGIC, SNAP_VERSION, 0, snap_seq, 0 };
+    fwrite(&header, sizeof(header), 1, snap_out);
+}
+
+void journal_snapshot_task(int task, pid_t pid, int state, int exit_code, const char *cmd) {
+    if (!snap_out) { return; }
+    union { journal_record rec; char bytes[sizeof(journal_record) + JOURNAL_CMDLEN + 8]; } u;
+    make_record(&u.rec, 0, REC_ADD, task, pid, state, exit_code, cmd);
+    fwrite(&u.rec, u.rec.len, 1, snap_out);
+    snap_count++;
+}
+
+int journal_snapshot_end(void) {
+    if (!snap_out) { return -1; }
+    FILE *out = snap_out;
+    snap_out = NULL;
+
+    long size = ftell(out);
+    snapshot_header header = { SNAP_MAGIC, SNAP_VERSION, 0, snap_seq, snap_count };
+    int failed = fseek(out, 0, SEEK_SET) || fwrite(&header, sizeof(header), 1, out) != 1
+        || fflush(out) || fsync(fileno(out));
+    failed |= fclose(out) != 0;
+    if (failed || rename(snap_tmp, snapshot_file)) {
+        unlink(snap_tmp);
+        return -1;
+    }
+    char dir[sizeof(snapshot_file)];
+    strcpy(dir, snapshot_file);
+    int dir_fd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    // the journal starts over with the records the snapshot may have missed
+    sigset_t all, old;
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &old);
+    size_t used = buf_used < JOURNAL_BUFSIZE ? buf_used : JOURNAL_BUFSIZE;
+    int ret = 0;
+    if (ftruncate(journal_fd, 0) || write_all(journal_fd, buf, used) || fdatasync(journal_fd)) { ret = -1; }
+    journal_bytes = ret ? 0 : used;
+    journal_records = 0;
+    buf_used = 0;
+    overflowed = 0;
+    need_snapshot = ret != 0;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    snapshot_tasks = snap_count;
+    snapshot_bytes = size;
+    commits++;
+    return ret;
+}
+
+void journal_stats(long *tasks, long *records, long *bytes, long *commit_count) {
+    *tasks = snapshot_tasks;
+    *records = journal_records;
+    *bytes = journal_bytes;
+    *commit_count = commits;
+}
@@ -0,0 +1,75 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <sys/types.h>
+
+/* Write-ahead journal of the task table, for restarts that keep every task.
+ *
+ * Changes to the table (a task added or purged, a state change) are
+ * appended as checksummed records to the journal file PATH.  Records are
+ * gathered in memory and written with one fdatasync() per commit, so a
+ * burst of instructions costs one sync rather than one each (group
+ * commit).  When the journal has grown past the size of the table it is
+ * compacted: the whole table goes to the snapshot PATH.snap (written
+ * aside and renamed into place) and the journal starts over.  Every record
+ * carries a sequence number, and the snapshot the last one it includes,
+ * so a crash between the two steps replays nothing twice.
+ *
+ * On open, the snapshot is mapped and read, the journal replayed on top of
+ * it up to the first torn or corrupt record (where it is cut), and the
+ * resulting tasks handed back in task number order.
+ *
+ * Records may be added from signal handlers (the reapers): space in the
+ * buffer is claimed with one atomic add, and commits hold signals off.  If
+ * the buffer fills before a commit, the next commit is a full snapshot.
+ */
+
+#define JOURNAL_BUFSIZE (4 << 20)    /* uncommitted record bytes held in memory */
+#define JOURNAL_GROUP_BYTES (64 << 10) /* uncommitted bytes that force a commit */
+#define JOURNAL_GROUP_NS 10000000L   /* age of the oldest uncommitted record that forces one */
+#define JOURNAL_CMDLEN 256           /* longest command line kept */
+
+/* A task as restored from the journal. */
+typedef struct journal_task {
+    int task;
+    pid_t pid;
+    int state;       /* LOG_STATE_* */
+    int exit_code;
+    const char *command;
+} journal_task;
+
+/* Opens the journal at path, creating it if needed, and calls restore with
+ * arg for every task it holds, in task number order.  Returns the number of
+ * tasks restored, or -1 if the journal cannot be opened. */
+long journal_open(const char *path, void (*restore)(const journal_task *task, void *arg), void *arg);
+
+/* Commits and closes the journal. */
+void journal_close(void);
+
+/* Path of the journal, or NULL if none is open. */
+const char *journal_path(void);
+
+/* Records a task added with its command line. */
+void journal_add(int task, const char *cmd);
+
+/* Records a task purged. */
+void journal_purge(int task);
+
+/* Records the state of a task. Safe in signal handlers. */
+void journal_state(int task, pid_t pid, int state, int exit_code);
+
+/* Writes what has been recorded and syncs it, unless input is waiting and
+ * the group limits are not reached yet (force overrides).  Returns 1 if the
+ * journal should now be compacted with a snapshot, and 0 otherwise. */
+int journal_commit(int input_waiting, int force);
+
+/* Snapshot: begin, one call per task in task number order, end.
+ * journal_snapshot_end() returns 0 on success and -1 otherwise. */
+void journal_snapshot_begin(void);
+void journal_snapshot_task(int task, pid_t pid, int state, int exit_code, const char *cmd);
+int journal_snapshot_end(void);
+
+/* Counters for the journal instruction. */
+void journal_stats(long *snapshot_tasks, long *records, long *bytes, long *commits);
+
+#endif /*JOURNAL_H*/
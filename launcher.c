@@ -0,0 +1,458 @@
+/* Launcher and reaper threads, see launcher.h */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "launcher.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+#define MAX_LAUNCHERS 64
+#define CHILD_STACK (256 * 1024)   /* stack a child runs on until it execs */
+#define UNWATCHED_POLL_MS 100      /* how often children without a pidfd are looked at */
+
+/* An intrusive queue with many producers and one consumer, after Vyukov.
+ * A node's link must come first in it. */
+typedef struct mpsc_node {
+    struct mpsc_node *next;
+} mpsc_node;
+
+typedef struct mpsc_queue {
+    mpsc_node *head;    /* pushed onto by producers */
+    mpsc_node *tail;    /* popped from by the consumer */
+    mpsc_node stub;
+} mpsc_queue;
+
+/* A child a launcher spawned, until the main thread takes its status */
+typedef struct reap_record {
+    struct reap_record *next;
+    struct reap_record *held;   /* in the reaper's list of those without a pidfd,
+                                   or the main thread's of those reaped early */
+    struct reap_record *prev_watched, *next_watched;   /* in the reaper's list of
+                                   those it waits on by pidfd */
+    pid_t pid;
+    int pidfd;
+    int status;
+    struct rusage usage;
+    int known;                  /* if the main thread has taken its launch */
+    int lost;                   /* if reaped elsewhere or handed off: no status */
+} reap_record;
+
+typedef struct launcher {
+    pthread_t thread;
+    mpsc_queue jobs;
+    sem_t ready;       /* posted once per job, and once more to stop */
+    void *stack;
+} launcher;
+
+static launcher *pool;
+static int num_launchers;
+static int next_launcher;
+
+static mpsc_queue done;        /* launches done, for the main thread */
+static mpsc_queue reaped;      /* children reaped, for the main thread */
+static mpsc_queue spent;       /* records the main thread is done with, for the reaper to free */
+static mpsc_queue fresh;       /* children just spawned, for the reaper to watch */
+static int done_fd = -1;
+static int reap_epoll = -1;
+static int reap_wake = -1;
+static int reaper_started;
+static int handoff;            /* set by launcher_stop() for the reaper to let go */
+static sem_t handed;           /* posted by the reaper once it has */
+static reap_record *early;     /* reaped before their launch was taken, main thread only */
+
+static void queue_init(mpsc_queue *q) {
+    q->stub.next = NULL;
+    q->head = q->tail = &q->stub;
+}
+
+/* Safe from any thread, and from a signal handler. */
+static void queue_push(mpsc_queue *q, mpsc_node *n) {
+    __atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+    mpsc_node *prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+/* For the consumer alone.  NULL if empty, or if the last push is not done
+ * yet: its producer signals the consumer once it is. */
+static mpsc_node *queue_pop(mpsc_queue *q) {
+    mpsc_node *tail = q->tail;
+    mpsc_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &q->stub) {
+        if (!next) { return NULL; }
+        q->tail = tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) { return NULL; }
+    queue_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static void wake(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0) {
+        // the count is already high: the reader will see it
+    }
+}
+
+/* Runs in the child, on the launcher's memory until it execs.  The
+ * controller's handlers would run on that memory too, so they go first. */
+static int child_main(void *arg) {
+    launch_job *job = arg;
+    struct sigaction dfl;
+    memset(&dfl, 0, sizeof(dfl));
+    dfl.sa_handler = SIG_DFL;
+    for (int sig = 1; sig < NSIG; sig++) {
+        struct sigaction old;
+        if (!sigaction(sig, NULL, &old) && old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN) {
+            sigaction(sig, &dfl, NULL);
+        }
+    }
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    job->child(job->arg);
+    _exit(127);
+}
+
+/* Spawns a job with the calling thread held until the child execs, then
+ * passes it back, and only then has the child watched. */
+static void spawn(launcher *l, launch_job *job) {
+    reap_record *r = calloc(1, sizeof(reap_record));
+    job->pid = -1;
+    job->err = ENOMEM;
+    if (r) {
+        job->pid = clone(child_main, (char *) l->stack + CHILD_STACK, CLONE_VM | CLONE_VFORK | SIGCHLD, job);
+        job->err = job->pid < 0 ? errno : 0;
+    }
+    if (job->pid < 0) {
+        free(r);
+        r = NULL;
+    }
+    else {
+        r->pid = job->pid;
+    }
+    job->reap = r;
+    // the job is the main thread's once it is pushed
+    queue_push(&done, (mpsc_node *) job);
+    wake(done_fd);
+    if (r) {
+        queue_push(&fresh, (mpsc_node *) r);
+        wake(reap_wake);
+    }
+}
+
+static void *run_launcher(void *arg) {
+    launcher *l = arg;
+    for (;;) {
+        while (sem_wait(&l->ready) && errno == EINTR) {}
+        launch_job *job = (launch_job *) queue_pop(&l->jobs);
+        if (!job) { return NULL; }
+        spawn(l, job);
+    }
+}
+
+/* Passes a reaped child to the main thread, and raises SIGCHLD for it:
+ * every other thread blocks it. */
+static void finish(reap_record *r, siginfo_t *info) {
+    if (info->si_code == CLD_EXITED) {
+        r->status = W_EXITCODE(info->si_status, 0);
+    }
+    else {
+        r->status = info->si_status | (info->si_code == CLD_DUMPED ? WCOREFLAG : 0);
+    }
+    queue_push(&reaped, (mpsc_node *) r);
+    kill(getpid(), SIGCHLD);
+}
+
+/* Passes a child the reaper no longer waits for to the main thread, with
+ * no status, for its record to be freed once its launch is taken: one
+ * reaped by another thread, or one handed off by launcher_stop(). */
+static void lose(reap_record *r) {
+    r->lost = 1;
+    queue_push(&reaped, (mpsc_node *) r);
+}
+
+/* Children the reaper waits on by pidfd, and those it polls without one */
+static reap_record *watched;
+static reap_record *polled;
+
+/* Waits on a child by its pidfd, or polls it without one. */
+static void watch_child(reap_record *r) {
+    r->pidfd = syscall(SYS_pidfd_open, r->pid, 0);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = r };
+    if (r->pidfd < 0 || epoll_ctl(reap_epoll, EPOLL_CTL_ADD, r->pidfd, &event)) {
+        if (r->pidfd >= 0) { close(r->pidfd); }
+        r->pidfd = -1;
+        r->held = polled;
+        polled = r;
+        return;
+    }
+    r->prev_watched = NULL;
+    r->next_watched = watched;
+    if (watched) { watched->prev_watched = r; }
+    watched = r;
+}
+
+/* Stops waiting on a child by its pidfd. */
+static void unwatch_child(reap_record *r) {
+    epoll_ctl(reap_epoll, EPOLL_CTL_DEL, r->pidfd, NULL);
+    close(r->pidfd);
+    if (r->prev_watched) { r->prev_watched->next_watched = r->next_watched; }
+    else { watched = r->next_watched; }
+    if (r->next_watched) { r->next_watched->prev_watched = r->prev_watched; }
+}
+
+/* Reaps a child if it has exited, by its pidfd or else its pid.  One that
+ * is gone already was reaped by another thread (ECHILD, or ESRCH for a
+ * pidfd).  Returns 1 if it is done with, and 0 if it still runs. */
+static int try_reap(reap_record *r) {
+    siginfo_t info;
+    info.si_pid = 0;
+    int failed = r->pidfd >= 0 ? syscall(SYS_waitid, P_PIDFD, r->pidfd, &info, WEXITED | WNOHANG, &r->usage)
+                               : syscall(SYS_waitid, P_PID, r->pid, &info, WEXITED | WNOHANG, &r->usage);
+    if (failed && errno != ECHILD && errno != ESRCH) { return 0; }
+    if (!failed && !info.si_pid) { return 0; }
+    if (r->pidfd >= 0) { unwatch_child(r); }
+    if (failed) { lose(r); }
+    else { finish(r, &info); }
+    return 1;
+}
+
+/* Lets go of every child, for launcher_stop(): the launchers that spawned
+ * them are gone, so the children are the main thread's to reap. */
+static void hand_off(void) {
+    reap_record *r;
+    while ((r = (reap_record *) queue_pop(&fresh))) {
+        lose(r);
+    }
+    while (watched) {
+        r = watched;
+        unwatch_child(r);
+        lose(r);
+    }
+    while (polled) {
+        r = polled;
+        polled = r->held;
+        lose(r);
+    }
+}
+
+static void *run_reaper(void *arg) {
+    struct epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(reap_epoll, events, 64, polled ? UNWATCHED_POLL_MS : -1);
+        for (int i = 0; i < n; i++) {
+            reap_record *r = events[i].data.ptr;
+            if (!r) {
+                uint64_t count;
+                if (read(reap_wake, &count, sizeof(count)) < 0) {
+                    // woken already
+                }
+                continue;
+            }
+            try_reap(r);
+        }
+
+        if (__atomic_load_n(&handoff, __ATOMIC_ACQUIRE)) {
+            hand_off();
+            __atomic_store_n(&handoff, 0, __ATOMIC_RELEASE);
+            sem_post(&handed);
+        }
+
+        reap_record *r;
+        while ((r = (reap_record *) queue_pop(&fresh))) {
+            watch_child(r);
+        }
+        for (reap_record **link = &polled; *link;) {
+            r = *link;
+            reap_record *after = r->held;
+            if (try_reap(r)) {
+                *link = after;
+            }
+            else {
+                link = &r->held;
+            }
+        }
+
+        while ((r = (reap_record *) queue_pop(&spent))) {
+            free(r);
+        }
+    }
+    return arg;
+}
+
+/* Starts a thread with every signal blocked, so signals stay the main thread's. */
+static int start_thread(pthread_t *thread, void *(*run)(void *), void *arg) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int failed = pthread_create(thread, NULL, run, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return failed ? -1 : 0;
+}
+
+/* Sets up the queues, the fds and the reaper thread, once. */
+static int start_reaper(void) {
+    if (reaper_started) { return 0; }
+    queue_init(&done);
+    queue_init(&reaped);
+    queue_init(&spent);
+    queue_init(&fresh);
+    done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    reap_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    reap_epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    pthread_t reaper;
+    if (done_fd < 0 || reap_wake < 0 || reap_epoll < 0 || sem_init(&handed, 0, 0) ||
+        epoll_ctl(reap_epoll, EPOLL_CTL_ADD, reap_wake, &event) ||
+        start_thread(&reaper, run_reaper, NULL)) {
+        if (done_fd >= 0) { close(done_fd); }
+        if (reap_wake >= 0) { close(reap_wake); }
+        if (reap_epoll >= 0) { close(reap_epoll); }
+        done_fd = reap_wake = reap_epoll = -1;
+        return -1;
+    }
+    pthread_detach(reaper);
+    reaper_started = 1;
+    return 0;
+}
+
+int launcher_start(int threads) {
+    if (threads < 1) { threads = 1; }
+    if (threads > MAX_LAUNCHERS) { threads = MAX_LAUNCHERS; }
+    if (threads == num_launchers) { return 0; }
+    launcher_stop();
+    if (start_reaper()) { return -1; }
+
+    pool = calloc(threads, sizeof(launcher));
+    if (!pool) { return -1; }
+    for (int i = 0; i < threads; i++) {
+        launcher *l = &pool[i];
+        queue_init(&l->jobs);
+        l->stack = mmap(NULL, CHILD_STACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (l->stack == MAP_FAILED || sem_init(&l->ready, 0, 0) || start_thread(&l->thread, run_launcher, l)) {
+            if (l->stack != MAP_FAILED) { munmap(l->stack, CHILD_STACK); }
+            break;
+        }
+        num_launchers++;
+    }
+    if (num_launchers == 0) {
+        free(pool);
+        pool = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void launcher_stop(void) {
+    for (int i = 0; i < num_launchers; i++) {
+        sem_post(&pool[i].ready);
+    }
+    for (int i = 0; i < num_launchers; i++) {
+        pthread_join(pool[i].thread, NULL);
+        sem_destroy(&pool[i].ready);
+        munmap(pool[i].stack, CHILD_STACK);
+    }
+
+    // the launchers' children now belong to the main thread, which reaps
+    // them with wait4() like its own: the reaper lets go of them first
+    if (num_launchers > 0) {
+        __atomic_store_n(&handoff, 1, __ATOMIC_RELEASE);
+        wake(reap_wake);
+        while (sem_wait(&handed) && errno == EINTR) {}
+    }
+    free(pool);
+    pool = NULL;
+    num_launchers = 0;
+    next_launcher = 0;
+}
+
+int launcher_threads(void) {
+    return num_launchers;
+}
+
+int launcher_reaping(void) {
+    return reaper_started;
+}
+
+int launcher_fd(void) {
+    return done_fd;
+}
+
+void launcher_submit(launch_job *job) {
+    launcher *l = &pool[next_launcher];
+    next_launcher = (next_launcher + 1) % num_launchers;
+    queue_push(&l->jobs, (mpsc_node *) job);
+    sem_post(&l->ready);
+}
+
+launch_job *launcher_done(void) {
+    launch_job *job = reaper_started ? (launch_job *) queue_pop(&done) : NULL;
+    if (job && job->reap) {
+        job->reap->known = 1;
+        // one held back may be this one's: have the reapers look again
+        if (early) { kill(getpid(), SIGCHLD); }
+    }
+    return job;
+}
+
+pid_t launcher_reap(int *status, struct rusage *usage) {
+    reap_record *r = NULL;
+    for (reap_record **link = &early; *link && !r;) {
+        if (!(*link)->known) {
+            link = &(*link)->held;
+            continue;
+        }
+        r = *link;
+        *link = r->held;
+        // one with no status is only freed
+        if (r->lost) {
+            queue_push(&spent, (mpsc_node *) r);
+            r = NULL;
+        }
+    }
+    while (!r) {
+        r = reaper_started ? (reap_record *) queue_pop(&reaped) : NULL;
+        if (!r) { return 0; }
+        if (!r->known) {
+            r->held = early;
+            early = r;
+            r = NULL;
+        }
+        else if (r->lost) {
+            queue_push(&spent, (mpsc_node *) r);
+            r = NULL;
+        }
+    }
+    pid_t pid = r->pid;
+    if (status) { *status = r->status; }
+    if (usage) { *usage = r->usage; }
+    queue_push(&spent, (mpsc_node *) r);
+    return pid;
+}
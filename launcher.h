@@ -0,0 +1,75 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* Launcher threads: background spawns off the main thread.
+ *
+ * launcher_start() starts a pool of launcher threads and a reaper thread.
+ * The main thread hands a launch to a launcher through that launcher's
+ * queue, lock-free with many producers and one consumer.  The launcher
+ * spawns it with a vfork-style clone, so no page tables are copied and
+ * launchers on different cores do not hold each other up.  The pid (or
+ * errno) comes back through the done queue, whose eventfd (launcher_fd())
+ * wakes the main thread.
+ *
+ * The reaper thread waits on a pidfd of each child a launcher spawned,
+ * reaps it with waitid() and passes its status and rusage back through
+ * the reaped queue, raising SIGCHLD for the main thread.  A child reaped
+ * before the main thread has taken its launch is held back until it has,
+ * so its pid is always known by then; one another thread has reaped
+ * first is let go with no status.  The main thread is the only
+ * consumer of both queues, and so the only one to touch the task table.
+ *
+ * Only the main thread may call these; launcher_reap() may be called from
+ * a signal handler, as long as it does not interrupt another call to it.
+ */
+
+/* A launch, owned by the caller from launcher_done() on.  The child
+ * is done with arg by then, having exec'd or exited. */
+struct reap_record;
+
+typedef struct launch_job {
+    struct launch_job *next;     /* link in a launcher's queue, then the done queue */
+    void (*child)(void *);       /* run in the child: must exec or _exit */
+    void *arg;
+    pid_t pid;                   /* the child, or -1 */
+    int err;                     /* errno if pid is -1 */
+    struct reap_record *reap;    /* private */
+} launch_job;
+
+/* Starts threads launcher threads (or changes their number, stopping the
+ * old ones as launcher_stop() does) and the reaper thread.
+ * Returns 0 on success and -1 otherwise. */
+int launcher_start(int threads);
+
+/* Stops the launcher threads once they have spawned what they were given.
+ * Their children pass to the main thread, so the reaper lets go of them
+ * and they are reaped with wait4() like its own.  Call with SIGCHLD
+ * blocked, and keep it blocked until launcher_done() has given back every
+ * launch, so no child is reaped before its pid is known. */
+void launcher_stop(void);
+
+/* Number of launcher threads running, 0 if stopped. */
+int launcher_threads(void);
+
+/* If the reaper thread has been started: from then on the children the
+ * launchers spawn are only reaped through launcher_reap(), until
+ * launcher_stop() hands them off. */
+int launcher_reaping(void);
+
+/* Readable while a launch is done; read to clear. -1 if never started. */
+int launcher_fd(void);
+
+/* Hands job to the next launcher thread. */
+void launcher_submit(launch_job *job);
+
+/* The next launch done, with pid or err set, or NULL if none. */
+launch_job *launcher_done(void);
+
+/* Takes the next child the reaper has reaped, like wait4() with WNOHANG.
+ * Returns its pid, or 0 if none. */
+pid_t launcher_reap(int *status, struct rusage *usage);
+
+#endif /*LAUNCHER_H*/
@@ -1,10 +1,11 @@
-/* Do Not Modify This File */
+/* Output of the controller, every line through kitc_log() */
 
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "logging.h"
+#include "trace.h"
 
 #define BUFSIZE 255
 
@@ -25,12 +26,23 @@ void log_kitc_intro() {
 /* Outputs the Help: All the Built-in Commands */
 void log_kitc_help() { 
   kitc_log("Instructions:\n");
-  kitc_log("    COMMAND [ARGS...],\n");
-  kitc_log("    help, quit, list, purge TASK,\n");
-  kitc_log("    exec TASK [<INFILE] [>OUTFILE],\n");
-  kitc_log("    bg TASK [<INFILE] [>OUTFILE],\n");
-  kitc_log("    pipe TASK1 TASK2,\n");
-  kitc_log("    kill TASK, suspend TASK, resume TASK\n");
+  kitc_log("    COMMAND [ARGS...] [&&|'||'|; COMMAND [ARGS...]]...,\n");
+  kitc_log("    help, quit [deadline=SECONDS|--detach], list, purge TASK,\n");
+  kitc_log("    exec TASK [<INFILE] [>OUTFILE|>>OUTFILE] [2>ERRFILE|2>&1],\n");
+  kitc_log("    bg TASK [<INFILE] [>OUTFILE|>>OUTFILE] [2>ERRFILE|2>&1],\n");
+  kitc_log("    pipe TASK1 TASK2, tee [copy] TASK -> TASK..., merge TASK... -> TASK,\n");
+  kitc_log("    kill TASK, suspend TASK, resume TASK,\n");
+  kitc_log("    place TASK [cpus=LIST] [nice=N] [sched=other|batch|idle] [io=be|idle] [cores=N] [mem=SIZE],\n");
+  kitc_log("    placement none|spread|numa, pool TASK SIZE,\n");
+  kitc_log("    cache [TASK [off]], invalidate [TASK],\n");
+  kitc_log("    metrics [dump FILE|unix:PATH [SECONDS]|dump off],\n");
+  kitc_log("    backend os|sim, sim [advance MS|run],\n");
+  kitc_log("    top [cpu|mem] [SECONDS] [COUNT], control [PATH|off],\n");
+  kitc_log("    attach, detach, journal [PATH|off], record [PATH|off],\n");
+  kitc_log("    every INTERVAL|off TASK [skip|queue|kill], at HH:MM[:SS]|+INTERVAL|off TASK [skip|queue|kill]\n");
+  kitc_log("    watch [off] TASK [< IN] [> OUT | >> OUT] [2> ERR | 2>&1], limit [RATE [BURST]|off],\n");
+  kitc_log("    pressure [cpu=PCT] [memory=PCT] [io=PCT] [shed]|off, pack [cores=N] [mem=SIZE]|off\n");
+  kitc_log("    wait [any] TASK... [timeout=SECONDS], wait all [timeout=SECONDS], launchers [N|off]\n");
   kitc_log("\n");
   kitc_log("Brackets denote optional arguments\n");
 }
@@ -70,9 +82,9 @@ void log_kitc_file_error(int task_num, const char *file) {
 /* Notifies of an input or output redirection */
 void log_kitc_redir(int task_num, int redir_type, const char *file) {
   char buffer[BUFSIZE] = {0};
-  static const char* types[] = {"input", "output"};
-  static const char* polarity[] = {"from", "to"};
-  if (redir_type < 0 || redir_type >= 2) {
+  static const char* types[] = {"input", "output", "error output"};
+  static const char* polarity[] = {"from", "to", "to"};
+  if (redir_type < 0 || redir_type >= 3) {
 	  kitc_write("Invalid input to log_kitc_redir\n");
 	  return;
   }
@@ -94,6 +106,13 @@ void log_kitc_pipe_error(int task_num) {
   kitc_log(buffer);
 }
 
+/* Output when relay pipes could not be made as big as asked */
+void log_kitc_pipe_size(int pipes, long size, long wanted) {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "%d relay pipe(s) left at %ld KiB instead of %ld KiB\n", pipes, size / 1024, wanted / 1024);
+  kitc_log(buffer);
+}
+
 /* Output when the command is not found
  * eg. User typed in lss instead of ls and exec returns an error
  */ 
@@ -150,6 +169,7 @@ void log_kitc_status_change(int task_num, int pid, int type, const char *cmd, in
 	  kitc_write("Invalid input to log_kitc_status_change\n");
 	  return;
   }
+  trace_probe(status_log, task_num, pid, transition, metrics_now());
   sprintf(buffer,"%s Process %d (Task %d): %s (%s)\n",types[type], pid, task_num, cmd, msgs[transition]);
   kitc_write(buffer);
 }
@@ -179,3 +199,353 @@ void log_kitc_task_info(int task_num, int status, int exit_code, int pid, const
 
   kitc_log(buffer);
 }
+
+/* Output one step of a chain under its task, with its last run */
+void log_kitc_chain_step(int step, int op, int status, int exit_code, int pid, double ms, const char *cmd){
+  char buffer[BUFSIZE] = {0};
+  static const char* ops[] = {";", "&&", "||"};
+  if (status < 0 || status >= 5 || op < 0 || op >= 3) {
+	  kitc_write("Invalid input to log_kitc_chain_step\n");
+	  return;
+  }
+  const char *joined = step > 1 ? ops[op] : "";
+  if (!pid)
+  { snprintf(buffer, BUFSIZE, "    Step %d: %s%s%s (not run)\n", step, joined, *joined ? " " : "", cmd); }
+  else if (status != LOG_STATE_FINISHED && status != LOG_STATE_KILLED)
+  { snprintf(buffer, BUFSIZE, "    Step %d: %s%s%s (PID %d; %s)\n", step, joined, *joined ? " " : "", cmd, pid, task_state[status]); }
+  else
+  { snprintf(buffer, BUFSIZE, "    Step %d: %s%s%s (PID %d; %s; exit code %d; %.3f ms)\n", step, joined, *joined ? " " : "", cmd, pid, task_state[status], exit_code, ms); }
+
+  kitc_log(buffer);
+}
+
+/* Output the placement attributes applied to a task */
+void log_kitc_placement(int task_num, const char *attrs){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Placement for Task #%d: %s\n", task_num, attrs);
+  kitc_log(buffer);
+}
+
+/* Output when a controller-wide setting changes */
+void log_kitc_policy(const char *name, const char *value){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Setting %s to %s\n", name, value);
+  kitc_log(buffer);
+}
+
+/* Output when an instruction argument cannot be understood */
+void log_kitc_arg_error(const char *arg){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Invalid argument %s\n", arg);
+  kitc_log(buffer);
+}
+
+/* Output when the warm pool for a task's executable changes size */
+void log_kitc_pool(int task_num, int size){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Warm pool for Task #%d: %d helper(s)\n", task_num, size);
+  kitc_log(buffer);
+}
+
+/* Output when output caching is turned on or off for a task */
+void log_kitc_cache(int task_num, int on){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Caching %s for Task #%d\n", on ? "on" : "off", task_num);
+  kitc_log(buffer);
+}
+
+/* Output when a task's output is restored from the cache instead of running it */
+void log_kitc_cache_hit(int task_num, const char *file, int exit_code){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Restored cached output of Task #%d to %s (exit code %d)\n", task_num, file, exit_code);
+  kitc_log(buffer);
+}
+
+/* Output the cache counters */
+void log_kitc_cache_stats(long hits, long misses, long entries, long bytes){
+  char buffer[BUFSIZE] = {0};
+  long lookups = hits + misses;
+  sprintf(buffer, "Cache: %ld hit(s), %ld miss(es) (%ld%% hit rate), %ld entries, %ld bytes\n",
+          hits, misses, lookups ? hits * 100 / lookups : 0, entries, bytes);
+  kitc_log(buffer);
+}
+
+/* Output when cached output is dropped, for one task or all (task_num < 0) */
+void log_kitc_invalidate(int task_num){
+  char buffer[BUFSIZE] = {0};
+  if (task_num < 0)
+  { sprintf(buffer, "Invalidating all cached output\n"); }
+  else
+  { sprintf(buffer, "Invalidating cached output of Task #%d\n", task_num); }
+  kitc_log(buffer);
+}
+
+/* Output of the simulator's virtual clock and task counts */
+void log_kitc_sim(long now_ms, long running, long stopped){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Virtual time %ld ms: %ld running, %ld stopped\n", now_ms, running, stopped);
+  kitc_log(buffer);
+}
+
+/* Outputs the control socket and its clients */
+void log_kitc_control(const char *path, int clients){
+  char buffer[BUFSIZE] = {0};
+  if (path == NULL)
+  { sprintf(buffer, "Control socket off\n"); }
+  else
+  { snprintf(buffer, BUFSIZE, "Control socket %s: %d client(s)\n", path, clients); }
+  kitc_log(buffer);
+}
+
+/* Outputs the journal of the task table and its counters */
+void log_kitc_journal(const char *path, long tasks, long records, long bytes, long commits){
+  char buffer[BUFSIZE] = {0};
+  if (path == NULL)
+  { sprintf(buffer, "Journal off\n"); }
+  else
+  { snprintf(buffer, BUFSIZE, "Journal %s: %ld task(s) in snapshot, %ld record(s) and %ld bytes since, %ld commit(s)\n", path, tasks, records, bytes, commits); }
+  kitc_log(buffer);
+}
+
+/* Output the session recording, path NULL if none */
+void log_kitc_recording(const char *path, long lines, double seconds){
+  char buffer[BUFSIZE] = {0};
+  if (path == NULL)
+  { sprintf(buffer, "Recording off\n"); }
+  else
+  { snprintf(buffer, BUFSIZE, "Recording to %s: %ld line(s) over %.1f s\n", path, lines, seconds); }
+  kitc_log(buffer);
+}
+
+/* Outputs the number of tasks restored from a journal at startup */
+void log_kitc_restored(long tasks, const char *path){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Restored %ld task(s) from journal %s\n", tasks, path);
+  kitc_log(buffer);
+}
+
+/* Outputs a console attaching to or detaching from a daemon */
+void log_kitc_console(int attached){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Console %s (taskctl %d)\n", attached ? "attached" : "detached", (int) getpid());
+  kitc_log(buffer);
+}
+
+/* Output when a task is scheduled with every or at, or unscheduled */
+void log_kitc_schedule(int task_num, const char *when, const char *overlap){
+  char buffer[BUFSIZE] = {0};
+  if (!when)
+  { snprintf(buffer, BUFSIZE, "Unscheduling Task #%d\n", task_num); }
+  else
+  { snprintf(buffer, BUFSIZE, "Scheduling Task #%d %s (%s when still running)\n", task_num, when, overlap); }
+  kitc_log(buffer);
+}
+
+/* Output the schedule of a task under it in the list */
+void log_kitc_schedule_info(const char *when, const char *overlap, double next_s, int queued, long skipped){
+  char buffer[BUFSIZE] = {0};
+  if (next_s < 0)
+  { snprintf(buffer, BUFSIZE, "    Scheduled %s (%s): done; %d queued, %ld skipped\n", when, overlap, queued, skipped); }
+  else
+  { snprintf(buffer, BUFSIZE, "    Scheduled %s (%s): next in %.3f s; %d queued, %ld skipped\n", when, overlap, next_s, queued, skipped); }
+  kitc_log(buffer);
+}
+
+/* Output one scheduled run of a task under it in the list */
+void log_kitc_run(long run, int status, int exit_code, double ms){
+  char buffer[BUFSIZE] = {0};
+  if (status < 0 || status >= 5) {
+	  kitc_write("Invalid input to log_kitc_run\n");
+	  return;
+  }
+  snprintf(buffer, BUFSIZE, "    Run %ld: %s; exit code %d; %.3f ms\n", run, task_state[status], exit_code, ms);
+  kitc_log(buffer);
+}
+
+/* Output when a task starts or stops (files 0) being re-run on changes to its files */
+void log_kitc_watch(int task_num, int files){
+  char buffer[BUFSIZE] = {0};
+  if (files == 0)
+  { snprintf(buffer, BUFSIZE, "Unwatching Task #%d\n", task_num); }
+  else
+  { snprintf(buffer, BUFSIZE, "Watching %d file(s) of Task #%d\n", files, task_num); }
+  kitc_log(buffer);
+}
+
+/* Output the watched files of a task under it in the list */
+void log_kitc_watch_info(const char *files, long runs, int pending){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "    Watching %s: %ld run(s) on change%s\n", files, runs, pending ? ", one queued" : "");
+  kitc_log(buffer);
+}
+
+/* Output the watch counters */
+void log_kitc_watch_stats(long files, long dirs, long events, long checks, long changes){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Watch: %ld file(s) in %ld directories, %ld event(s), %ld check(s), %ld change(s)\n",
+          files, dirs, events, checks, changes);
+  kitc_log(buffer);
+}
+
+/* Output when the launch limiter is set, or lifted (rate 0) */
+void log_kitc_limit(double rate, int burst){
+  char buffer[BUFSIZE] = {0};
+  if (rate <= 0)
+  { sprintf(buffer, "Launching without a limit\n"); }
+  else
+  { sprintf(buffer, "Limiting launches to %g a second (bursts of %d)\n", rate, burst); }
+  kitc_log(buffer);
+}
+
+/* Output the launch limiter and the launches it holds back */
+void log_kitc_limit_stats(double rate, int burst, double tokens, int waiting){
+  char buffer[BUFSIZE] = {0};
+  if (rate <= 0)
+  { sprintf(buffer, "Launch limit: off; %d launch(es) waiting to retry a fork\n", waiting); }
+  else
+  { sprintf(buffer, "Launch limit: %g a second, bursts of %d, %.1f token(s) left; %d launch(es) waiting\n", rate, burst, tokens, waiting); }
+  kitc_log(buffer);
+}
+
+/* Output when a background launch is held back by the launch limiter */
+void log_kitc_throttled(int task_num, int ahead){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Holding back Task #%d (%d launch(es) ahead)\n", task_num, ahead);
+  kitc_log(buffer);
+}
+
+/* Output a held back launch of a task under it in the list */
+void log_kitc_throttle_info(double waited_ms, int tries){
+  char buffer[BUFSIZE] = {0};
+  if (tries > 0)
+  { sprintf(buffer, "    Held back: waiting %.3f ms to launch; fork failed %d time(s)\n", waited_ms, tries); }
+  else
+  { sprintf(buffer, "    Held back: waiting %.3f ms to launch\n", waited_ms); }
+  kitc_log(buffer);
+}
+
+/* Output when admission control is set, or turned off (limits NULL) */
+void log_kitc_pressure_set(const char *limits, int shed){
+  char buffer[BUFSIZE] = {0};
+  if (limits == NULL)
+  { sprintf(buffer, "Admitting launches whatever the pressure\n"); }
+  else
+  { sprintf(buffer, "Holding back launches past %s stall%s\n", limits, shed ? ", and shedding running tasks" : ""); }
+  kitc_log(buffer);
+}
+
+/* Output the pressure of each resource watched and what it holds back */
+void log_kitc_pressure_stats(const char *stalls, int triggers, int pressured, int waiting, int shed){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Pressure: %s (%s); launches %s, %d waiting; %d task(s) shed\n", stalls,
+          triggers ? "kernel triggers" : "sampled every second", pressured ? "held back" : "admitted", waiting, shed);
+  kitc_log(buffer);
+}
+
+/* Output a decision of admission control, with the pressure behind it */
+void log_kitc_pressure(const char *stalls, int decision, int task_num){
+  char buffer[BUFSIZE] = {0};
+  static const char* msgs[] = {"holding back launches", "shedding", "resuming shed", "launching again"};
+  if (decision < 0 || decision >= 4) {
+	  kitc_write("Invalid input to log_kitc_pressure\n");
+	  return;
+  }
+  if (task_num < 0)
+  { sprintf(buffer, "Pressure (%s): %s\n", stalls, msgs[decision]); }
+  else
+  { sprintf(buffer, "Pressure (%s): %s Task #%d\n", stalls, msgs[decision], task_num); }
+  kitc_log(buffer);
+}
+
+/* Output a task shed by admission control under it in the list */
+void log_kitc_shed_info(){
+  kitc_log("    Shed: suspended under pressure, resumed once it falls\n");
+}
+
+/* Output when launches are packed onto the machine, or go in order (cores 0) */
+void log_kitc_pack(double cores, long mem_kb){
+  char buffer[BUFSIZE] = {0};
+  if (cores <= 0)
+  { sprintf(buffer, "Launching in order, without packing\n"); }
+  else if (mem_kb <= 0)
+  { sprintf(buffer, "Packing launches onto %g core(s), memory unknown so not limited\n", cores); }
+  else
+  { sprintf(buffer, "Packing launches onto %g core(s) and %ld MiB\n", cores, mem_kb / 1024); }
+  kitc_log(buffer);
+}
+
+/* Output the room packing has and what running tasks use of it */
+void log_kitc_pack_stats(double cores, long mem_kb, double used_cores, long used_kb, int waiting, long learned){
+  char buffer[BUFSIZE] = {0};
+  if (cores <= 0)
+  { sprintf(buffer, "Packing: off; %ld command(s) learned\n", learned); }
+  else if (mem_kb <= 0)
+  { sprintf(buffer, "Packing: %.2f of %g core(s) and %ld MiB (not limited) in use; %d launch(es) waiting; %ld command(s) learned\n",
+            used_cores, cores, used_kb / 1024, waiting, learned); }
+  else
+  { sprintf(buffer, "Packing: %.2f of %g core(s) and %ld of %ld MiB in use; %d launch(es) waiting; %ld command(s) learned\n",
+            used_cores, cores, used_kb / 1024, mem_kb / 1024, waiting, learned); }
+  kitc_log(buffer);
+}
+
+/* Output how many launcher threads spawn background launches (0 for inline) */
+void log_kitc_launchers(int threads){
+  char buffer[BUFSIZE] = {0};
+  if (threads <= 0)
+  { sprintf(buffer, "Launching on the main thread\n"); }
+  else
+  { sprintf(buffer, "Launching background tasks on %d launcher thread(s)\n", threads); }
+  kitc_log(buffer);
+}
+
+/* Output the launcher threads and the launches they have on hand */
+void log_kitc_launcher_stats(int threads, int launching){
+  char buffer[BUFSIZE] = {0};
+  if (threads <= 0)
+  { sprintf(buffer, "Launchers: off; %d launch(es) in flight\n", launching); }
+  else
+  { sprintf(buffer, "Launchers: %d thread(s); %d launch(es) in flight\n", threads, launching); }
+  kitc_log(buffer);
+}
+
+/* Output what packing counts a task as needing under it in the list */
+void log_kitc_needs_info(double cores, long mem_kb, const char *source){
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "    Needs: %.2f core(s), %ld MiB (%s)\n", cores, mem_kb / 1024, source);
+  kitc_log(buffer);
+}
+
+/* Output the end of a wait: the task that ended it for wait any (task_num
+ * not -1), how many ended and failed otherwise, and the exit status */
+void log_kitc_wait(double seconds, int ended, int total, int failed, int task_num, int timed_out, int status){
+  char buffer[BUFSIZE] = {0};
+  if (timed_out)
+  { sprintf(buffer, "Wait timed out after %.3f s: %d of %d task(s) ended; exit status %d\n", seconds, ended, total, status); }
+  else if (task_num >= 0)
+  { sprintf(buffer, "Wait over after %.3f s: Task #%d ended; exit status %d\n", seconds, task_num, status); }
+  else
+  { sprintf(buffer, "Wait over after %.3f s: %d of %d task(s) ended, %d failed; exit status %d\n", seconds, ended, total, failed, status); }
+  kitc_log(buffer);
+}
+
+/* Output the start of shutdown on quit, or of leaving the tasks running */
+void log_kitc_shutdown(int tasks, double deadline, int detach){
+  char buffer[BUFSIZE] = {0};
+  if (detach)
+  { sprintf(buffer, "Detaching: leaving %d task(s) running\n", tasks); }
+  else
+  { sprintf(buffer, "Shutting down %d task(s): SIGTERM now, SIGKILL after %g s\n", tasks, deadline); }
+  kitc_log(buffer);
+}
+
+/* Output how the tasks ended on shutdown: exited, ended by SIGTERM, killed
+ * at the deadline, and any that even SIGKILL left running */
+void log_kitc_shutdown_stats(double seconds, int exited, int terminated, int killed, int left){
+  char buffer[BUFSIZE] = {0};
+  if (left)
+  { sprintf(buffer, "Shut down in %.3f s: %d exited, %d terminated, %d killed at the deadline, %d still running\n",
+            seconds, exited, terminated, killed, left); }
+  else
+  { sprintf(buffer, "Shut down in %.3f s: %d exited, %d terminated, %d killed at the deadline\n", seconds, exited, terminated, killed); }
+  kitc_log(buffer);
+}
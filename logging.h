@@ -1,4 +1,4 @@
-/* Do not modify this file */
+/* Output of the controller, see logging.c */
 #ifndef LOGGING_H
 #define LOGGING_H
 
@@ -19,6 +19,7 @@
 
 #define LOG_REDIR_IN   0
 #define LOG_REDIR_OUT  1
+#define LOG_REDIR_ERR  2
 
 #define LOG_TERM       0
 #define LOG_TERM_SIG   1
@@ -26,12 +27,18 @@
 #define LOG_SUSPEND    3
 #define LOG_START      4
 
+#define LOG_PRESSURE_HOLD    0
+#define LOG_PRESSURE_SHED    1
+#define LOG_PRESSURE_RESUME  2
+#define LOG_PRESSURE_RELEASE 3
+
 void log_kitc_intro();
 void log_kitc_prompt();
 void log_kitc_help();
 void log_kitc_quit();
 void log_kitc_num_tasks(int num_tasks);
 void log_kitc_task_info(int task_num, int status, int exit_code, int pid, const char *cmd);
+void log_kitc_chain_step(int step, int op, int status, int exit_code, int pid, double ms, const char *cmd);
 void log_kitc_task_init(int task_num, const char *cmd);
 void log_kitc_task_num_error(int task_num);
 void log_kitc_purge(int task_num);
@@ -43,7 +50,44 @@ void log_kitc_file_error(int task_num, const char *file);
 void log_kitc_redir(int task_num, int redir_type, const char *file);
 void log_kitc_pipe(int task_num1, int task_num2);
 void log_kitc_pipe_error(int task_num);
+void log_kitc_pipe_size(int pipes, long size, long wanted);
 void log_kitc_ctrl_c();
 void log_kitc_ctrl_z();
+void log_kitc_placement(int task_num, const char *attrs);
+void log_kitc_policy(const char *name, const char *value);
+void log_kitc_arg_error(const char *arg);
+void log_kitc_pool(int task_num, int size);
+void log_kitc_cache(int task_num, int on);
+void log_kitc_cache_hit(int task_num, const char *file, int exit_code);
+void log_kitc_cache_stats(long hits, long misses, long entries, long bytes);
+void log_kitc_invalidate(int task_num);
+void log_kitc_sim(long now_ms, long running, long stopped);
+void log_kitc_control(const char *path, int clients);
+void log_kitc_console(int attached);
+void log_kitc_journal(const char *path, long tasks, long records, long bytes, long commits);
+void log_kitc_recording(const char *path, long lines, double seconds);
+void log_kitc_restored(long tasks, const char *path);
+void log_kitc_schedule(int task_num, const char *when, const char *overlap);
+void log_kitc_schedule_info(const char *when, const char *overlap, double next_s, int queued, long skipped);
+void log_kitc_run(long run, int status, int exit_code, double ms);
+void log_kitc_watch(int task_num, int files);
+void log_kitc_watch_info(const char *files, long runs, int pending);
+void log_kitc_watch_stats(long files, long dirs, long events, long checks, long changes);
+void log_kitc_limit(double rate, int burst);
+void log_kitc_limit_stats(double rate, int burst, double tokens, int waiting);
+void log_kitc_throttled(int task_num, int ahead);
+void log_kitc_throttle_info(double waited_ms, int tries);
+void log_kitc_pressure_set(const char *limits, int shed);
+void log_kitc_pressure_stats(const char *stalls, int triggers, int pressured, int waiting, int shed);
+void log_kitc_pressure(const char *stalls, int decision, int task_num);
+void log_kitc_shed_info();
+void log_kitc_pack(double cores, long mem_kb);
+void log_kitc_pack_stats(double cores, long mem_kb, double used_cores, long used_kb, int waiting, long learned);
+void log_kitc_launchers(int threads);
+void log_kitc_launcher_stats(int threads, int launching);
+void log_kitc_needs_info(double cores, long mem_kb, const char *source);
+void log_kitc_wait(double seconds, int ended, int total, int failed, int task_num, int timed_out, int status);
+void log_kitc_shutdown(int tasks, double deadline, int detach);
+void log_kitc_shutdown_stats(double seconds, int exited, int terminated, int killed, int left);
 
 #endif /*LOGGING_H*/
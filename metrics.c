@@ -0,0 +1,195 @@
+/* Controller metrics, see metrics.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+#define METRICS_BUFSIZE 16384
+
+typedef struct metrics_histogram {
+    unsigned long buckets[METRIC_BUCKETS];
+    unsigned long count;
+    unsigned long sum_ns;
+} metrics_histogram;
+
+typedef struct metrics_data {
+    metrics_histogram hists[METRIC_NUM_HIST];
+    unsigned long counters[METRIC_NUM_COUNTERS];
+    long gauges[METRIC_NUM_GAUGES];
+} metrics_data;
+
+static metrics_data *data = NULL;
+
+static const char *hist_names[] = {
+    "kitc_spawn_latency_seconds", "kitc_reap_lookup_seconds", "kitc_parse_seconds" };
+static const char *hist_help[] = {
+    "Time from fork (or warm pool hand-off) to exec of a task.",
+    "Time from each child being reaped to its task being found (not from the child's exit).",
+    "Time to parse one command line." };
+
+static const char *counter_names[] = {
+    "kitc_spawns_total", "kitc_reaps_total",
+    "kitc_signals_sent_total{signal=\"SIGINT\"}",
+    "kitc_signals_sent_total{signal=\"SIGTSTP\"}",
+    "kitc_signals_sent_total{signal=\"SIGCONT\"}",
+    "kitc_launches_deferred_total", "kitc_spawn_retries_total", "kitc_spawn_failures_total",
+    "kitc_tasks_shed_total" };
+
+static const char *state_names[] = { "ready", "running", "suspended", "finished", "killed" };
+
+int metrics_init(void) {
+    if (data) { return 0; }
+    void *map = mmap(NULL, sizeof(metrics_data), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) { return -1; }
+    data = map;  // mmap hands back zeroed pages
+    return 0;
+}
+
+long metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void metrics_observe(int hist, long ns) {
+    if (!data || hist < 0 || hist >= METRIC_NUM_HIST) { return; }
+    if (ns < 0) { ns = 0; }
+
+    // bucket i holds values up to 2^i microseconds
+    long us = ns / 1000;
+    int i = 0;
+    while (i < METRIC_BUCKETS - 1 && us > (1L << i)) { i++; }
+
+    metrics_histogram *h = &data->hists[hist];
+    __atomic_fetch_add(&h->buckets[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+}
+
+void metrics_count(int counter, long n) {
+    if (!data || counter < 0 || counter >= METRIC_NUM_COUNTERS) { return; }
+    __atomic_fetch_add(&data->counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge(int gauge, long value) {
+    if (!data || gauge < 0 || gauge >= METRIC_NUM_GAUGES) { return; }
+    __atomic_store_n(&data->gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+/* Appends formatted text at buf+*len, never past size */
+#define emit(...) do { \
+    if (*len < size) { \
+        int n = snprintf(buf + *len, size - *len, __VA_ARGS__); \
+        *len += (n > 0) ? (size_t) n : 0; \
+    } \
+} while (0)
+
+static void format_histogram(char *buf, size_t size, size_t *len, int hist) {
+    metrics_histogram *h = &data->hists[hist];
+    const char *name = hist_names[hist];
+    emit("# HELP %s %s\n# TYPE %s histogram\n", name, hist_help[hist], name);
+
+    unsigned long cumulative = 0;
+    for (int i = 0; i < METRIC_BUCKETS; i++) {
+        cumulative += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (i == METRIC_BUCKETS - 1) {
+            emit("%s_bucket{le=\"+Inf\"} %lu\n", name, cumulative);
+        } else {
+            emit("%s_bucket{le=\"%g\"} %lu\n", name, (1L << i) / 1e6, cumulative);
+        }
+    }
+    emit("%s_sum %.9f\n", name, __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9);
+    emit("%s_count %lu\n", name, __atomic_load_n(&h->count, __ATOMIC_RELAXED));
+}
+
+size_t metrics_format(char *buf, size_t size) {
+    size_t written = 0, *len = &written;
+    if (!data || !buf || !size) { return 0; }
+    buf[0] = '\0';
+
+    for (int i = 0; i < METRIC_NUM_HIST; i++) {
+        format_histogram(buf, size, len, i);
+    }
+
+    emit("# HELP kitc_spawns_total Tasks launched.\n# TYPE kitc_spawns_total counter\n");
+    emit("%s %lu\n", counter_names[METRIC_SPAWNS], data->counters[METRIC_SPAWNS]);
+    emit("# HELP kitc_reaps_total Child state changes reaped.\n# TYPE kitc_reaps_total counter\n");
+    emit("%s %lu\n", counter_names[METRIC_REAPS], data->counters[METRIC_REAPS]);
+    emit("# HELP kitc_signals_sent_total Signals sent to tasks by sendSig.\n# TYPE kitc_signals_sent_total counter\n");
+    for (int i = METRIC_SIGINT; i <= METRIC_SIGCONT; i++) {
+        emit("%s %lu\n", counter_names[i], data->counters[i]);
+    }
+    emit("# HELP kitc_launches_deferred_total Background launches made to wait by the launch limiter.\n# TYPE kitc_launches_deferred_total counter\n");
+    emit("%s %lu\n", counter_names[METRIC_DEFERRED], data->counters[METRIC_DEFERRED]);
+    emit("# HELP kitc_spawn_retries_total Forks tried again after EAGAIN or ENOMEM.\n# TYPE kitc_spawn_retries_total counter\n");
+    emit("%s %lu\n", counter_names[METRIC_SPAWN_RETRIES], data->counters[METRIC_SPAWN_RETRIES]);
+    emit("# HELP kitc_spawn_failures_total Launches given up after their forks kept failing.\n# TYPE kitc_spawn_failures_total counter\n");
+    emit("%s %lu\n", counter_names[METRIC_SPAWN_FAILURES], data->counters[METRIC_SPAWN_FAILURES]);
+    emit("# HELP kitc_tasks_shed_total Background tasks suspended to shed load under pressure.\n# TYPE kitc_tasks_shed_total counter\n");
+    emit("%s %lu\n", counter_names[METRIC_SHED], data->counters[METRIC_SHED]);
+
+    emit("# HELP kitc_tasks Tasks in the task table by state.\n# TYPE kitc_tasks gauge\n");
+    for (int i = METRIC_TASKS_READY; i <= METRIC_TASKS_KILLED; i++) {
+        emit("kitc_tasks{state=\"%s\"} %ld\n", state_names[i], data->gauges[i]);
+    }
+    emit("# HELP kitc_launch_queue Background launches waiting for the launch limiter.\n# TYPE kitc_launch_queue gauge\n");
+    emit("kitc_launch_queue %ld\n", data->gauges[METRIC_LAUNCH_QUEUE]);
+    emit("# HELP kitc_input_queue_bytes Bytes of command input waiting to be read, not a count of commands.\n# TYPE kitc_input_queue_bytes gauge\n");
+    emit("kitc_input_queue_bytes %ld\n", data->gauges[METRIC_INPUT_BYTES]);
+
+    return written < size ? written : size - 1;
+}
+
+/* Writes all of buf to fd. Returns 0 on success and -1 otherwise. */
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) { return -1; }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int metrics_dump(const char *target) {
+    static char buf[METRICS_BUFSIZE];
+    if (!target) { return -1; }
+    size_t len = metrics_format(buf, sizeof(buf));
+
+    // local scraper listening on a unix socket
+    if (!strncmp(target, "unix:", 5)) {
+        struct sockaddr_un addr = {0};
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", target + 5);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) { return -1; }
+        int ret = -1;
+        if (!connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+            ret = write_all(fd, buf, len);
+        }
+        close(fd);
+        return ret;
+    }
+
+    // file, replaced atomically so readers never see a partial dump
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", target);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) { return -1; }
+    int ret = write_all(fd, buf, len);
+    close(fd);
+    if (ret || rename(tmp, target)) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+/* Controller metrics: fixed-bucket latency histograms, counters and gauges.
+ *
+ * All storage is allocated once by metrics_init() in a shared anonymous
+ * mapping, so updates never allocate, are safe from signal handlers, and
+ * can be made by forked children (e.g. right before exec) as well as by
+ * the controller itself.  Output is Prometheus text format.
+ */
+
+/* Histograms, latencies in nanoseconds */
+#define METRIC_SPAWN       0  /* fork (or pool hand-off) to exec */
+#define METRIC_REAP_LOOKUP 1  /* a child reaped to its task found, not exit to reap */
+#define METRIC_PARSE       2  /* parse() of one command line */
+#define METRIC_NUM_HIST    3
+
+/* Histogram buckets: upper bounds of 1us, 2us, 4us ... 2^22us, then +Inf */
+#define METRIC_BUCKETS 24
+
+/* Counters */
+#define METRIC_SPAWNS  0
+#define METRIC_REAPS   1
+#define METRIC_SIGINT  2
+#define METRIC_SIGTSTP 3
+#define METRIC_SIGCONT 4
+#define METRIC_DEFERRED       5   /* background launches made to wait by the launch limiter */
+#define METRIC_SPAWN_RETRIES  6   /* forks tried again after EAGAIN or ENOMEM */
+#define METRIC_SPAWN_FAILURES 7   /* launches given up after their forks kept failing */
+#define METRIC_SHED           8   /* background tasks suspended to shed load under pressure */
+#define METRIC_NUM_COUNTERS 9
+
+/* Gauges, set by the controller before output. The first five are the task
+ * table by state and follow the LOG_STATE_* order. */
+#define METRIC_TASKS_READY      0
+#define METRIC_TASKS_RUNNING    1
+#define METRIC_TASKS_SUSPENDED  2
+#define METRIC_TASKS_FINISHED   3
+#define METRIC_TASKS_KILLED     4
+#define METRIC_INPUT_BYTES      5   /* bytes (not lines) of command input not yet read */
+#define METRIC_LAUNCH_QUEUE     6   /* background launches waiting for the limiter */
+#define METRIC_NUM_GAUGES 7
+
+/* Maps the shared storage. Returns 0 on success and -1 otherwise. */
+int metrics_init(void);
+
+/* Monotonic clock in nanoseconds. */
+long metrics_now(void);
+
+/* Records one latency into a histogram. */
+void metrics_observe(int hist, long ns);
+
+/* Adds n to a counter. */
+void metrics_count(int counter, long n);
+
+/* Sets a gauge. */
+void metrics_gauge(int gauge, long value);
+
+/* Writes every metric in Prometheus text format into buf.
+ * Returns the number of bytes written. */
+size_t metrics_format(char *buf, size_t size);
+
+/* Writes the metrics to target: a file path (replaced atomically), or
+ * "unix:PATH" to send them to a listening local stream socket.
+ * Returns 0 on success and -1 otherwise. */
+int metrics_dump(const char *target);
+
+#endif /*METRICS_H*/
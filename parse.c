@@ -1,6 +1,5 @@
-/* DO NOT modify this file.
- * This is the provided parsing facility. 
- * You can call parse() to divide the user command line into useful pieces. */
+/* The parsing facility.
+ * parse() divides the user command line into useful pieces. */
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -23,13 +22,13 @@ static void dprintf(const char* fmt, ...);
 /* Reference Data */
 
 // full recognized instruction list
-static char *instructs_list_full[] = {"quit", "help", "list", "purge", "exec", "bg", "kill", "suspend", "resume", "pipe", NULL};
+static char *instructs_list_full[] = {"quit", "help", "list", "purge", "exec", "bg", "kill", "suspend", "resume", "pipe", "place", "placement", "pool", "cache", "invalidate", "metrics", "backend", "sim", "top", "control", "attach", "detach", "journal", "tee", "merge", "every", "at", "watch", "limit", "pressure", "pack", "wait", "launchers", "record", NULL};
 
 // instructions which may use an Task Number argument
-static char *instructs_with_num[] = {"purge", "exec", "bg", "kill", "suspend", "resume", "pipe", NULL};
+static char *instructs_with_num[] = {"purge", "exec", "bg", "kill", "suspend", "resume", "pipe", "place", "pool", "cache", "invalidate", NULL};
 
 // instructions which may use a 2nd Task Number argument
-static char *instructs_with_num2[] = {"pipe", NULL};
+static char *instructs_with_num2[] = {"pipe", "pool", NULL};
 
 // instructions which may use filename arguments
 static char *instructs_with_file[] = {"exec", "bg", NULL};
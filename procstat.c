@@ -0,0 +1,189 @@
+/* /proc sampling, see procstat.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "procstat.h"
+
+#define STAT_BUFSIZE 1024
+
+typedef struct procstat_entry {
+    pid_t pid;              /* 0 if the slot is free */
+    int stat_fd;            /* -1 if not kept open */
+    int statm_fd;
+    unsigned int round;     /* last round the pid was sampled in */
+    unsigned long ticks;    /* utime + stime at the last sample */
+    unsigned long long start; /* start time (stat field 22), to tell a reused pid */
+    long sampled_ns;        /* time of the last sample, 0 if none */
+} procstat_entry;
+
+static procstat_entry *slots = NULL;
+static long num_slots = 0, used_slots = 0;
+static unsigned int round_num = 0;
+static long clk_tck = 0, page_kb = 0;
+static int uptime_fd = -1;
+static int raised_limit = 0;
+
+static long mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Slot of pid, or of the free slot where it would go */
+static procstat_entry *lookup(procstat_entry *table, long size, pid_t pid) {
+    unsigned long i = ((unsigned long) pid * 2654435761UL) & (size - 1);
+    while (table[i].pid && table[i].pid != pid) {
+        i = (i + 1) & (size - 1);
+    }
+    return &table[i];
+}
+
+/* Moves the entries into a new table of size slots, closing and dropping
+ * those not sampled this round unless keep_all */
+static int rehash(long size, int keep_all) {
+    procstat_entry *table = calloc(size, sizeof(procstat_entry));
+    if (!table) { return -1; }
+    used_slots = 0;
+    for (long i = 0; i < num_slots; i++) {
+        procstat_entry *e = &slots[i];
+        if (!e->pid) { continue; }
+        if (keep_all || e->round == round_num) {
+            *lookup(table, size, e->pid) = *e;
+            used_slots++;
+        }
+        else {
+            if (e->stat_fd >= 0) { close(e->stat_fd); }
+            if (e->statm_fd >= 0) { close(e->statm_fd); }
+        }
+    }
+    free(slots);
+    slots = table;
+    num_slots = size;
+    return 0;
+}
+
+/* Opens a /proc file to keep; -1 (read by path each time) when out of fds */
+static int keep_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == EMFILE && !raised_limit) {
+        // thousands of tasks need more than the default soft limit
+        struct rlimit rl;
+        raised_limit = 1;
+        if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+        }
+    }
+    return fd;
+}
+
+/* Reads all of a small /proc file from the start. A kept fd that fails to
+ * read (its process is gone, perhaps with the pid reused) is closed and the
+ * file read again by path, kept open anew if it can be. */
+static ssize_t read_file(int *fd, const char *path, char *buf, size_t size) {
+    ssize_t n = *fd >= 0 ? pread(*fd, buf, size - 1, 0) : -1;
+    if (n < 0 && *fd >= 0) {
+        close(*fd);
+        *fd = keep_open(path);
+        if (*fd >= 0) { n = pread(*fd, buf, size - 1, 0); }
+    }
+    else if (n < 0) {
+        int f = open(path, O_RDONLY | O_CLOEXEC);
+        if (f < 0) { return -1; }
+        n = pread(f, buf, size - 1, 0);
+        close(f);
+    }
+    if (n >= 0) { buf[n] = '\0'; }
+    return n;
+}
+
+void procstat_begin(void) {
+    if (!clk_tck) {
+        clk_tck = sysconf(_SC_CLK_TCK);
+        page_kb = sysconf(_SC_PAGESIZE) / 1024;
+        uptime_fd = open("/proc/uptime", O_RDONLY | O_CLOEXEC);
+    }
+    round_num++;
+}
+
+int procstat_read(pid_t pid, proc_sample *out) {
+    if (pid <= 0 || !out) { return -1; }
+    if (used_slots * 2 >= num_slots && rehash(num_slots ? num_slots * 2 : 256, 1)) { return -1; }
+
+    char path[64];
+    procstat_entry *e = lookup(slots, num_slots, pid);
+    if (!e->pid) {
+        e->pid = pid;
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+        e->stat_fd = keep_open(path);
+        snprintf(path, sizeof(path), "/proc/%d/statm", (int) pid);
+        e->statm_fd = keep_open(path);
+        e->sampled_ns = 0;
+        used_slots++;
+    }
+    e->round = round_num;
+
+    // comm may hold spaces and parens, so fields count from the last ')'
+    char buf[STAT_BUFSIZE];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    if (read_file(&e->stat_fd, path, buf, sizeof(buf)) <= 0) { return -1; }
+    char *p = strrchr(buf, ')');
+    char state;
+    unsigned long utime, stime;
+    unsigned long long start;
+    if (!p || sscanf(p + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %llu",
+                     &state, &utime, &stime, &start) != 4) {
+        return -1;
+    }
+
+    // a new start time is a new process under a reused pid: start over
+    if (e->sampled_ns && start != e->start) {
+        e->sampled_ns = 0;
+    }
+    e->start = start;
+
+    long size = 0, resident = 0;
+    snprintf(path, sizeof(path), "/proc/%d/statm", (int) pid);
+    if (read_file(&e->statm_fd, path, buf, sizeof(buf)) > 0) {
+        sscanf(buf, "%ld %ld", &size, &resident);
+    }
+
+    long now = mono_ns();
+    unsigned long ticks = utime + stime;
+    double cpu = 0;
+    if (e->sampled_ns && now > e->sampled_ns) {
+        cpu = (ticks - e->ticks) * 100.0 / clk_tck / ((now - e->sampled_ns) / 1e9);
+    }
+    else {
+        // first sample: average over the process lifetime
+        double uptime = 0;
+        if (read_file(&uptime_fd, "/proc/uptime", buf, sizeof(buf)) > 0) {
+            sscanf(buf, "%lf", &uptime);
+        }
+        double age = uptime - (double) start / clk_tck;
+        cpu = age > 0 ? ticks * 100.0 / clk_tck / age : 0;
+    }
+    e->ticks = ticks;
+    e->sampled_ns = now;
+
+    out->pid = pid;
+    out->state = state;
+    out->cpu = cpu;
+    out->rss_kb = resident * page_kb;
+    out->vsz_kb = size * page_kb;
+    return 0;
+}
+
+void procstat_end(void) {
+    if (num_slots) { rehash(num_slots, 0); }
+}
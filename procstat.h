@@ -0,0 +1,35 @@
+#ifndef PROCSTAT_H
+#define PROCSTAT_H
+
+#include <sys/types.h>
+
+/* Low-overhead sampling of /proc/<pid>/stat and statm.
+ *
+ * The stat and statm files of each sampled pid are opened once and then
+ * re-read with pread() every round, so a sample costs two reads and no
+ * path lookups.  Pids are found through a hash table, and the files of
+ * pids not sampled in a round are closed when it ends, so the cost of a
+ * round stays proportional to the pids in it.  The fds stay valid only
+ * for the process they were opened for, so a file that fails to read is
+ * reopened by path, and a changed start time (stat field 22) marks a
+ * reused pid, whose cpu% starts over as for a new process.
+ */
+
+typedef struct proc_sample {
+    pid_t pid;
+    char state;     /* R, S, D, T, Z ... from /proc/<pid>/stat */
+    double cpu;     /* cpu% since the last round, or since start on the first */
+    long rss_kb;    /* resident memory */
+    long vsz_kb;    /* virtual memory */
+} proc_sample;
+
+/* Starts a sampling round. */
+void procstat_begin(void);
+
+/* Samples pid into out.  Returns 0 on success and -1 if pid is gone. */
+int procstat_read(pid_t pid, proc_sample *out);
+
+/* Ends a round, closing the files of pids it did not sample. */
+void procstat_end(void);
+
+#endif /*PROCSTAT_H*/
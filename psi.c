@@ -0,0 +1,230 @@
+/* Pressure stall information, see psi.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "psi.h"
+
+static const char *names[PSI_RESOURCES] = { "cpu", "memory", "io" };
+
+static int epoll_fd = -1;       /* over event_fd and timer_fd, for the caller */
+static int timer_fd = -1;
+static int event_fd = -1;       /* written by the waiter when a trigger fires */
+static int trigger_fd = -1;     /* epoll over the triggers, for the waiter alone */
+static int stop_fd = -1;        /* in trigger_fd, written to end the waiter */
+static int waiter_started;
+static pthread_t waiter;
+
+static int fds[PSI_RESOURCES] = { -1, -1, -1 };
+static int triggered[PSI_RESOURCES];
+static long totals[PSI_RESOURCES];     /* us of stall at the start of the window */
+static double stalls[PSI_RESOURCES];   /* % over the last window sampled */
+
+static int timing;          /* if the sample timer is armed */
+static int confirming;      /* if a trigger fired and its window is being sampled */
+static int keep;            /* if asked to sample every window */
+static long window_start;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Total us of "some" stall so far, from the first line of a pressure file. */
+static long read_total(int fd) {
+    char buf[256];
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) { return 0; }
+    buf[len] = '\0';
+    char *total = strstr(buf, "total=");
+    return total ? strtol(total + 6, NULL, 10) : 0;
+}
+
+/* Passes fired triggers on to event_fd until stop_fd is written. Runs with
+ * every signal blocked. */
+static void *wait_triggers(void *arg) {
+    struct epoll_event events[PSI_RESOURCES + 1];
+    uint64_t one = 1;
+    for (;;) {
+        int n = epoll_wait(trigger_fd, events, PSI_RESOURCES + 1, -1);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == stop_fd) { return arg; }
+        }
+        if (n > 0 && write(event_fd, &one, sizeof(one)) < 0) {
+            // the count is already high: the caller will see it
+        }
+    }
+}
+
+/* Starts the waiter thread, with signals left to the main thread. */
+static int start_waiter(void) {
+    if (waiter_started) { return 0; }
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int failed = pthread_create(&waiter, NULL, wait_triggers, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (failed) { return -1; }
+    waiter_started = 1;
+    return 0;
+}
+
+/* Closes the fds open_fds() opened. */
+static void close_fds(void) {
+    if (timer_fd >= 0) { close(timer_fd); }
+    if (event_fd >= 0) { close(event_fd); }
+    if (epoll_fd >= 0) { close(epoll_fd); }
+    if (trigger_fd >= 0) { close(trigger_fd); }
+    if (stop_fd >= 0) { close(stop_fd); }
+    timer_fd = event_fd = epoll_fd = trigger_fd = stop_fd = -1;
+}
+
+/* Sets up the sample timer, the eventfds, and the epoll fds. */
+static int open_fds(void) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    trigger_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event timer = { .events = EPOLLIN, .data.fd = timer_fd };
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = event_fd };
+    struct epoll_event stop = { .events = EPOLLIN, .data.fd = stop_fd };
+    if (timer_fd < 0 || event_fd < 0 || stop_fd < 0 || epoll_fd < 0 || trigger_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer) ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event) ||
+        epoll_ctl(trigger_fd, EPOLL_CTL_ADD, stop_fd, &stop)) {
+        close_fds();
+        return -1;
+    }
+    return 0;
+}
+
+/* Arms the sample timer while a window is wanted, and disarms it otherwise.
+ * A window is wanted if asked for, while a fired trigger is confirmed, and
+ * always while a watched resource has no trigger. */
+static void arm(void) {
+    int wanted = keep || confirming;
+    for (int r = 0; r < PSI_RESOURCES; r++) {
+        if (fds[r] >= 0 && !triggered[r]) { wanted = 1; }
+    }
+    if (wanted == timing) { return; }
+    struct itimerspec when = { { 0, 0 }, { 0, 0 } };
+    if (wanted) {
+        window_start = now_ns();
+        for (int r = 0; r < PSI_RESOURCES; r++) {
+            if (fds[r] >= 0) { totals[r] = read_total(fds[r]); }
+        }
+        when.it_interval.tv_sec = when.it_value.tv_sec = PSI_WINDOW / 1000000000L;
+        when.it_interval.tv_nsec = when.it_value.tv_nsec = PSI_WINDOW % 1000000000L;
+    }
+    timerfd_settime(timer_fd, 0, &when, NULL);
+    timing = wanted;
+}
+
+int psi_fd(void) {
+    return epoll_fd;
+}
+
+int psi_watch(int r, double pct) {
+    if (r < 0 || r >= PSI_RESOURCES) { return -1; }
+    if (epoll_fd < 0 && open_fds()) { return -1; }
+    psi_unwatch(r);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/pressure/%s", names[r]);
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0 && (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) { return -1; }
+
+    // the kernel takes the trigger with its terminating NUL
+    char trigger[64];
+    snprintf(trigger, sizeof(trigger), "some %ld %ld", (long) (pct * PSI_WINDOW / 100000), PSI_WINDOW / 1000);
+    struct epoll_event pri = { .events = EPOLLPRI, .data.fd = fd };
+    triggered[r] = write(fd, trigger, strlen(trigger) + 1) > 0 && !start_waiter() &&
+                   !epoll_ctl(trigger_fd, EPOLL_CTL_ADD, fd, &pri);
+
+    fds[r] = fd;
+    totals[r] = read_total(fd);
+    stalls[r] = 0;
+    arm();
+    return 0;
+}
+
+void psi_unwatch(int r) {
+    if (r < 0 || r >= PSI_RESOURCES || fds[r] < 0) { return; }
+    if (triggered[r]) { epoll_ctl(trigger_fd, EPOLL_CTL_DEL, fds[r], NULL); }
+    close(fds[r]);
+    fds[r] = -1;
+    triggered[r] = 0;
+    stalls[r] = 0;
+    arm();
+}
+
+void psi_stop(void) {
+    keep = confirming = 0;
+    for (int r = 0; r < PSI_RESOURCES; r++) { psi_unwatch(r); }
+    arm();
+    uint64_t one = 1;
+    if (waiter_started && write(stop_fd, &one, sizeof(one)) == sizeof(one)) {
+        pthread_join(waiter, NULL);
+        waiter_started = 0;
+    }
+    // a waiter that could not be told to stop keeps its fds
+    if (!waiter_started) { close_fds(); }
+}
+
+void psi_sampling(int on) {
+    keep = on;
+    arm();
+}
+
+int psi_poll(void) {
+    uint64_t count;
+    if (epoll_fd < 0) { return 0; }
+
+    // a trigger only says the stall passed the mark once in a window: see if it holds
+    if (read(event_fd, &count, sizeof(count)) > 0 && !timing) {
+        confirming = 1;
+        arm();
+        return 0;
+    }
+    if (read(timer_fd, &count, sizeof(count)) <= 0) { return 0; }
+
+    long now = now_ns();
+    double elapsed_us = (now - window_start) / 1000.0;
+    for (int r = 0; r < PSI_RESOURCES; r++) {
+        if (fds[r] < 0) { continue; }
+        long total = read_total(fds[r]);
+        stalls[r] = elapsed_us > 0 ? (total - totals[r]) * 100.0 / elapsed_us : 0;
+        if (stalls[r] > 100) { stalls[r] = 100; }
+        totals[r] = total;
+    }
+    window_start = now;
+    confirming = 0;
+    arm();
+    return 1;
+}
+
+double psi_stall(int r) {
+    return r >= 0 && r < PSI_RESOURCES ? stalls[r] : 0;
+}
+
+int psi_triggered(int r) {
+    return r >= 0 && r < PSI_RESOURCES && triggered[r];
+}
+
+const char *psi_name(int r) {
+    return r >= 0 && r < PSI_RESOURCES ? names[r] : NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef PSI_H
+#define PSI_H
+
+/* Pressure stall information (/proc/pressure), sampled for admission control.
+ *
+ * Each watched resource is measured by its "some" stall: the share of time
+ * at least one task waited on it.  Where the kernel allows, a trigger is
+ * registered on its file at the watched percentage of a PSI_WINDOW, so
+ * nothing is read while pressure stays low; where it does not (older
+ * kernels, containers without the privilege), the stall totals are sampled
+ * every PSI_WINDOW instead.  A trigger's event is taken by whichever poll
+ * sees it first, so the triggers are waited on by a thread of their own
+ * that only passes the event on through an eventfd.  Once one fires, the
+ * stall is measured over the next window to see if the pressure held.
+ *
+ * psi_fd() is readable whenever psi_poll() has something to do.
+ */
+
+#define PSI_CPU    0
+#define PSI_MEMORY 1
+#define PSI_IO     2
+#define PSI_RESOURCES 3
+
+#define PSI_WINDOW 1000000000L    /* ns of stall measured for each sample */
+
+/* An epoll fd readable when a trigger has fired or a sample is due, -1
+ * before the first resource is watched. */
+int psi_fd(void);
+
+/* Watches resource r (PSI_CPU ...) for a stall of pct% or more.
+ * Returns 0 on success and -1 if the kernel has no pressure information. */
+int psi_watch(int r, double pct);
+
+/* Stops watching resource r. */
+void psi_unwatch(int r);
+
+/* Stops watching every resource, ends the thread waiting on the triggers,
+ * and closes psi_fd(). The next psi_watch() starts afresh. */
+void psi_stop(void);
+
+/* Keeps sampling every window (on), or, where every watched resource has
+ * a trigger, only once one fires (off). */
+void psi_sampling(int on);
+
+/* Reads fired triggers and the sample timer. Returns 1 when a window has
+ * been sampled, which psi_stall() then reports until the next, and 0
+ * otherwise. */
+int psi_poll(void);
+
+/* Stall % of resource r over the last window sampled. */
+double psi_stall(int r);
+
+/* If resource r is watched through a kernel trigger, rather than sampled. */
+int psi_triggered(int r);
+
+/* Name of resource r, as in /proc/pressure. */
+const char *psi_name(int r);
+
+#endif /*PSI_H*/
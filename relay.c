@@ -0,0 +1,205 @@
+/* Relays between task pipes, see relay.h */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "relay.h"
+
+#define GONE -1    /* bytes given to an output whose reader went away */
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return -1; }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return -1; }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Closes and removes outs[i]. Returns the number of outputs left. */
+static int drop(int *outs, int n, int i) {
+    close(outs[i]);
+    memmove(outs + i, outs + i + 1, (n - i - 1) * sizeof(int));
+    return n - 1;
+}
+
+/* Moves len bytes from the front of in to out. Returns 0 on success and -1
+ * if out went away, with the bytes it did not take left in in. */
+static int splice_all(int in, int out, size_t len, size_t *left) {
+    *left = len;
+    while (*left > 0) {
+        ssize_t n = splice(in, NULL, out, NULL, *left, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return -1; }
+        *left -= n;
+    }
+    return 0;
+}
+
+int relay_tee(int in, int *outs, int n) {
+    ssize_t *got = malloc(n * sizeof(ssize_t));
+    char *buf = malloc(RELAY_CHUNK);
+    if (!got || !buf) {
+        free(got);
+        free(buf);
+        return -1;
+    }
+
+    int ret = 0;
+    while (n > 0) {
+        // the first output sets the pace: tee waits for input and for room in it
+        ssize_t len = n > 1 ? tee(in, outs[0], RELAY_CHUNK, 0)
+                            : splice(in, NULL, outs[0], NULL, RELAY_CHUNK, SPLICE_F_MOVE);
+        if (len < 0 && errno == EINTR) { continue; }
+        if (len < 0 && errno == EPIPE) {
+            n = drop(outs, n, 0);
+            continue;
+        }
+        if (len <= 0) {
+            ret = len < 0 ? -1 : 0;
+            break;
+        }
+        if (n == 1) { continue; }
+
+        // the others but the last get the same bytes, which a tee can fall
+        // short of when its reader is behind
+        int partial = 0;
+        got[0] = len;
+        for (int i = 1; i < n - 1; i++) {
+            do {
+                got[i] = tee(in, outs[i], len, 0);
+            } while (got[i] < 0 && errno == EINTR);
+            if (got[i] < 0) { got[i] = GONE; }
+            if (got[i] != GONE && got[i] < len) { partial = 1; }
+        }
+
+        // the last takes the bytes themselves, which also moves the input on
+        int last = n - 1;
+        got[last] = partial ? 0 : len;
+        size_t left = 0;
+        if (!partial && splice_all(in, outs[last], len, &left)) {
+            got[last] = GONE;
+            if (read_all(in, buf, left)) {
+                ret = -1;
+                break;
+            }
+        }
+        else if (partial) {
+            // rare: read the bytes out and write the missing ends
+            if (read_all(in, buf, len)) {
+                ret = -1;
+                break;
+            }
+            for (int i = 1; i < n; i++) {
+                if (got[i] != GONE && got[i] < len && write_all(outs[i], buf + got[i], len - got[i])) {
+                    got[i] = GONE;
+                }
+            }
+        }
+
+        for (int i = n - 1; i > 0; i--) {
+            if (got[i] == GONE) { n = drop(outs, n, i); }
+        }
+    }
+    free(got);
+    free(buf);
+    return ret;
+}
+
+int relay_copy(int in, int *outs, int n) {
+    char *buf = malloc(RELAY_CHUNK);
+    if (!buf) { return -1; }
+
+    int ret = 0;
+    while (n > 0) {
+        ssize_t len = read(in, buf, RELAY_CHUNK);
+        if (len < 0 && errno == EINTR) { continue; }
+        if (len <= 0) {
+            ret = len < 0 ? -1 : 0;
+            break;
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            if (write_all(outs[i], buf, len)) { n = drop(outs, n, i); }
+        }
+    }
+    free(buf);
+    return ret;
+}
+
+int relay_merge(int *ins, int n, int out) {
+    struct pollfd *pfds = calloc(n, sizeof(struct pollfd));
+    char **bufs = calloc(n, sizeof(char *));
+    size_t *lens = calloc(n, sizeof(size_t));
+    int ret = -1;
+    if (!pfds || !bufs || !lens) { goto done; }
+    for (int i = 0; i < n; i++) {
+        if (!(bufs[i] = malloc(RELAY_LINE))) { goto done; }
+        pfds[i].fd = ins[i];
+        pfds[i].events = POLLIN;
+    }
+
+    int live = n;
+    ret = 0;
+    while (live > 0) {
+        if (poll(pfds, n, -1) < 0) {
+            if (errno == EINTR) { continue; }
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (pfds[i].fd < 0 || !pfds[i].revents) { continue; }
+            ssize_t r = read(pfds[i].fd, bufs[i] + lens[i], RELAY_LINE - lens[i]);
+            if (r < 0 && errno == EINTR) { continue; }
+
+            // whole lines go now; the start of the next one waits for its end,
+            // unless the input ended or the line is too long to keep
+            size_t keep = 0;
+            if (r <= 0) {
+                close(pfds[i].fd);
+                pfds[i].fd = -1;
+                live--;
+            }
+            else {
+                lens[i] += r;
+                char *newline = memrchr(bufs[i], '\n', lens[i]);
+                if (newline) { keep = bufs[i] + lens[i] - (newline + 1); }
+                else if (lens[i] < RELAY_LINE) { keep = lens[i]; }
+            }
+
+            size_t send = lens[i] - keep;
+            if (send && write_all(out, bufs[i], send)) {
+                // the reader went away
+                ret = errno == EPIPE ? 0 : -1;
+                goto done;
+            }
+            memmove(bufs[i], bufs[i] + send, keep);
+            lens[i] = keep;
+        }
+    }
+
+done:
+    for (int i = 0; bufs && i < n; i++) { free(bufs[i]); }
+    free(bufs);
+    free(lens);
+    free(pfds);
+    return ret;
+}
@@ -0,0 +1,35 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+/* Relays between task pipes, for more than one task on a side of a pipe.
+ *
+ * Fan-out gives one stream to several readers.  With tee(2) the pipe
+ * buffers are duplicated in the kernel: the stream is teed to every output
+ * but the last, then spliced (moved) to the last one, so no byte passes
+ * through user space.  Fan-in merges several streams into one, a whole line
+ * at a time, so lines from different writers never mix; lines have to be
+ * found, so it reads and writes.
+ *
+ * Every write blocks while its reader is behind, and nothing is read in
+ * the meantime: the slowest reader holds up the writers, and no more than
+ * the pipe buffers (plus RELAY_LINE of a partial line per input) is ever
+ * held.  A reader that goes away is dropped; once none is left, so is the
+ * input, and the writers get SIGPIPE.  SIGPIPE must be ignored.
+ */
+
+#define RELAY_PIPE (1 << 20)    /* capacity asked for each relay pipe */
+#define RELAY_CHUNK (1 << 20)   /* most bytes moved per tee, splice or read */
+#define RELAY_LINE (64 << 10)   /* longest line kept whole by a merge */
+
+/* Copies in to each of the n fds in outs until in ends, with tee(2) and
+ * splice(2).  Returns 0 on success and -1 otherwise. */
+int relay_tee(int in, int *outs, int n);
+
+/* The same through a user-space buffer, for comparison. */
+int relay_copy(int in, int *outs, int n);
+
+/* Copies the n fds in ins to out, interleaved a line at a time, until they
+ * all end.  Returns 0 on success and -1 otherwise. */
+int relay_merge(int *ins, int n, int out);
+
+#endif /*RELAY_H*/
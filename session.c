@@ -0,0 +1,121 @@
+/* Recordings of operator sessions, see session.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "session.h"
+
+static FILE *out = NULL;
+static char out_path[4096];
+static long start_ns, last_ns, lines;
+
+/* Time of the last line read back, one recording being read at a time */
+static long read_ns;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Appends v as a varint to buf. Returns the bytes written. */
+static int put_varint(unsigned char *buf, uint64_t v) {
+    int n = 0;
+    while (v >= 0x80) {
+        buf[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    buf[n++] = v;
+    return n;
+}
+
+/* Reads a varint. Returns 0 on success and -1 at the end or on a bad one. */
+static int get_varint(FILE *in, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(in);
+        if (c == EOF) { return -1; }
+        *v |= (uint64_t) (c & 0x7f) << shift;
+        if (!(c & 0x80)) { return 0; }
+    }
+    return -1;
+}
+
+int session_record_open(const char *path) {
+    session_record_close();
+    FILE *f = fopen(path, "we");
+    if (!f) { return -1; }
+    if (fwrite(SESSION_MAGIC, 1, strlen(SESSION_MAGIC), f) != strlen(SESSION_MAGIC) || fflush(f)) {
+        fclose(f);
+        return -1;
+    }
+    out = f;
+    snprintf(out_path, sizeof(out_path), "%s", path);
+    start_ns = last_ns = now_ns();
+    lines = 0;
+    return 0;
+}
+
+void session_record_close(void) {
+    if (out) {
+        fclose(out);
+        out = NULL;
+    }
+}
+
+const char *session_record_path(void) {
+    return out ? out_path : NULL;
+}
+
+long session_record_lines(void) {
+    return lines;
+}
+
+double session_record_seconds(void) {
+    return out ? (now_ns() - start_ns) / 1e9 : 0;
+}
+
+void session_record(const char *line) {
+    if (!out) { return; }
+    size_t len = strlen(line);
+    if (len > SESSION_MAXLINE) { len = SESSION_MAXLINE; }
+    unsigned char head[20];
+    long now = now_ns();
+    int n = put_varint(head, now - last_ns);
+    n += put_varint(head + n, len);
+    last_ns = now;
+    //One write a line, so a crash loses none
+    fwrite(head, 1, n, out);
+    fwrite(line, 1, len, out);
+    fflush(out);
+    lines++;
+}
+
+FILE *session_open(const char *path) {
+    char magic[sizeof(SESSION_MAGIC) - 1];
+    FILE *in = fopen(path, "re");
+    if (!in) { return NULL; }
+    if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, SESSION_MAGIC, sizeof(magic))) {
+        fclose(in);
+        return NULL;
+    }
+    read_ns = 0;
+    return in;
+}
+
+long session_next(FILE *in, char *line, size_t size) {
+    uint64_t delta, len;
+    if (get_varint(in, &delta) || get_varint(in, &len) || len > SESSION_MAXLINE) { return -1; }
+    char buf[SESSION_MAXLINE];
+    if (fread(buf, 1, len, in) != len || size == 0) { return -1; }
+    if (len >= size) { len = size - 1; }
+    memcpy(line, buf, len);
+    line[len] = '\0';
+    read_ns += delta;
+    return read_ns;
+}
@@ -0,0 +1,47 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Recordings of operator sessions, replayed as workloads (taskctl-replay).
+ *
+ * Every command line the controller reads, from stdin or a control client,
+ * is appended to the recording with the CLOCK_MONOTONIC time since the
+ * recording began.  A recording is SESSION_MAGIC followed by one record a
+ * line: the ns since the line before as a varint (7 bits a byte, low bits
+ * first), the length of the line as a varint, then the line without its
+ * newline.  A line under 128 bytes typed a second after the last costs 6
+ * bytes on top of itself (5 for the delay, 1 for the length).  Each line is written as it comes, so a crash loses none; a
+ * record cut short at the end is ignored when read back.
+ */
+
+#define SESSION_MAGIC "KITCSES1"
+#define SESSION_MAXLINE 4096    /* longest line kept */
+
+/* Starts recording to path, replacing what is there and ending any other
+ * recording.  Returns 0 on success and -1 otherwise. */
+int session_record_open(const char *path);
+
+/* Ends the recording. */
+void session_record_close(void);
+
+/* Path recorded to, or NULL if not recording. */
+const char *session_record_path(void);
+
+/* Lines recorded, and seconds since the recording began. */
+long session_record_lines(void);
+double session_record_seconds(void);
+
+/* Appends line (without its newline) to the recording, if any. */
+void session_record(const char *line);
+
+/* Opens a recording to read back, one at a time.  Returns NULL if it cannot
+ * be opened or is not a recording. */
+FILE *session_open(const char *path);
+
+/* Reads the next line of a recording into line (NUL-terminated, cut to
+ * size).  Returns its ns since the recording began, or -1 at the end. */
+long session_next(FILE *in, char *line, size_t size);
+
+#endif /*SESSION_H*/
@@ -0,0 +1,388 @@
+/* Deterministic in-memory process simulator, see backend.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "backend.h"
+
+/* Simulated pids start here, clear of the pid the keyboard path signals */
+#define SIM_PID_BASE 1000
+
+/* Wait status of a continued child, as the kernel reports it */
+#define SIM_CONTINUED 0xffff
+
+/* Task states */
+#define SIM_RUNNING 0
+#define SIM_STOPPED 1
+#define SIM_EXITED  2   /* final status queued, not reaped yet */
+#define SIM_REAPED  3
+
+typedef struct sim_proc {
+    char *script;       /* steps after the command name, NULL once exited */
+    size_t cursor;      /* offset of the next step in script */
+    int state;
+    int held_sig;       /* terminating signal held while stopped, 0 if none */
+    unsigned int seed;  /* seed for exit=A-B */
+    unsigned int gen;   /* bumped to void the task's queued event */
+    long due;           /* virtual time the current step ends */
+    long left;          /* time left of the current step while stopped */
+} sim_proc;
+
+/* The end of a task's current step, kept in a min-heap by (due, pid) */
+typedef struct sim_event {
+    long due;
+    pid_t pid;
+    unsigned int gen;
+} sim_event;
+
+/* A status change waiting to be reaped */
+typedef struct sim_status {
+    pid_t pid;          /* 0 once taken */
+    int status;
+} sim_status;
+
+static sim_proc *procs = NULL;
+static long num_procs = 0, cap_procs = 0;
+
+static sim_event *heap = NULL;
+static long num_heap = 0, cap_heap = 0;
+
+static sim_status *queue = NULL;
+static long queue_head = 0, queue_tail = 0, cap_queue = 0;
+
+static long now = 0;
+static long running = 0, stopped = 0, unreaped = 0;
+static long unannounced = 0;
+
+/* Makes room for need elements of size bytes in *arr.
+ * Returns 0 on success and -1 otherwise. */
+static int reserve(void **arr, long *cap, long need, size_t size) {
+    if (need <= *cap) { return 0; }
+    long grown_cap = *cap ? *cap * 2 : 1024;
+    while (grown_cap < need) { grown_cap *= 2; }
+    void *grown = realloc(*arr, grown_cap * size);
+    if (!grown) { return -1; }
+    *arr = grown;
+    *cap = grown_cap;
+    return 0;
+}
+
+static sim_proc *find(pid_t pid) {
+    long i = (long) pid - SIM_PID_BASE;
+    return (i >= 0 && i < num_procs) ? &procs[i] : NULL;
+}
+
+/* Heap order: earliest first, ties by pid so runs are reproducible */
+static int before(const sim_event *a, const sim_event *b) {
+    return a->due != b->due ? a->due < b->due : a->pid < b->pid;
+}
+
+static void push_event(long due, pid_t pid, unsigned int gen) {
+    if (reserve((void **) &heap, &cap_heap, num_heap + 1, sizeof(sim_event))) { return; }
+    long i = num_heap++;
+    heap[i] = (sim_event) { due, pid, gen };
+    while (i > 0 && before(&heap[i], &heap[(i - 1) / 2])) {
+        sim_event tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+static void pop_event(void) {
+    heap[0] = heap[--num_heap];
+    long i = 0;
+    for (;;) {
+        long l = 2 * i + 1, r = l + 1, min = i;
+        if (l < num_heap && before(&heap[l], &heap[min])) { min = l; }
+        if (r < num_heap && before(&heap[r], &heap[min])) { min = r; }
+        if (min == i) { break; }
+        sim_event tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+/* Returns the next event that still applies, dropping voided ones, or NULL */
+static sim_event *next_event(void) {
+    while (num_heap > 0) {
+        sim_proc *p = find(heap[0].pid);
+        if (p && p->gen == heap[0].gen && p->state == SIM_RUNNING) { return &heap[0]; }
+        pop_event();
+    }
+    return NULL;
+}
+
+static void queue_status(pid_t pid, int status) {
+    if (reserve((void **) &queue, &cap_queue, queue_tail + 1, sizeof(sim_status))) { return; }
+    queue[queue_tail++] = (sim_status) { pid, status };
+    unannounced++;
+}
+
+/* Tells the controller about queued status changes, one SIGCHLD for each
+ * like the kernel sends (they merge while SIGCHLD is blocked) */
+static void announce(void) {
+    while (unannounced > 0) {
+        unannounced--;
+        raise(SIGCHLD);
+    }
+}
+
+/* Ends a task with a wait status */
+static void finish(sim_proc *p, pid_t pid, int status) {
+    if (p->state == SIM_RUNNING) { running--; }
+    else { stopped--; }
+    p->state = SIM_EXITED;
+    p->gen++;
+    free(p->script);
+    p->script = NULL;
+    queue_status(pid, status);
+}
+
+/* Copies the next step of a task's script into buf.
+ * Returns 0 once the script is used up. */
+static int next_step(sim_proc *p, char *buf, size_t size) {
+    const char *s = p->script + p->cursor;
+    while (*s == ' ') { s++; }
+    size_t len = strcspn(s, " ");
+    if (len == 0) { return 0; }
+    snprintf(buf, size, "%.*s", (int) len, s);
+    p->cursor = s + len - p->script;
+    return 1;
+}
+
+/* Runs a task's steps from its cursor until one takes time, stops or exits */
+static void run_steps(sim_proc *p, pid_t pid) {
+    char step[64];
+    while (next_step(p, step, sizeof(step))) {
+        char *eq = strchr(step, '=');
+        long value = eq ? atol(eq + 1) : 0;
+        size_t key_len = eq ? (size_t) (eq - step) : strlen(step);
+
+#define IS(key) (key_len == strlen(key) && !strncmp(step, key, key_len))
+        if ((IS("cpu") || IS("sleep")) && value > 0) {
+            p->due = now + value;
+            push_event(p->due, pid, p->gen);
+            return;
+        }
+        if (IS("stop")) {
+            p->state = SIM_STOPPED;
+            p->left = 0;
+            running--;
+            stopped++;
+            queue_status(pid, W_STOPCODE(SIGTSTP));
+            return;
+        }
+        if (IS("exit")) {
+            // same draw as workload, so real and simulated runs agree
+            int code = eq ? atoi(eq + 1) : 0;
+            int lo, hi;
+            if (eq && sscanf(eq + 1, "%d-%d", &lo, &hi) == 2 && hi >= lo) {
+                srand(p->seed);
+                code = lo + rand() % (hi - lo + 1);
+            }
+            finish(p, pid, W_EXITCODE(code & 0xff, 0));
+            return;
+        }
+        if (IS("seed")) { p->seed = value; }
+#undef IS
+    }
+    finish(p, pid, W_EXITCODE(0, 0));
+}
+
+/* Runs the next event. Returns 0 if there is none. */
+static int step_event(void) {
+    sim_event *ev = next_event();
+    if (!ev) { return 0; }
+    pid_t pid = ev->pid;
+    if (ev->due > now) { now = ev->due; }
+    pop_event();
+    run_steps(find(pid), pid);
+    return 1;
+}
+
+static pid_t sim_spawn(const char *cmdline, void (*child)(void *), void *arg) {
+    if (reserve((void **) &procs, &cap_procs, num_procs + 1, sizeof(sim_proc))) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // the command name is not a step
+    const char *steps = cmdline + strcspn(cmdline, " ");
+    char *script = strdup(steps);
+    if (!script) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    pid_t pid = SIM_PID_BASE + num_procs;
+    sim_proc *p = &procs[num_procs++];
+    *p = (sim_proc) { script, 0, SIM_RUNNING, 0, 1, 0, now, 0 };
+    running++;
+    unreaped++;
+
+    // the first steps run once virtual time next moves, even by 0
+    push_event(now, pid, p->gen);
+    return pid;
+}
+
+static int sim_signal(pid_t pid, int sig) {
+    sim_proc *p = find(pid);
+    if (!p || p->state >= SIM_EXITED) {
+        errno = ESRCH;
+        return -1;
+    }
+
+    switch (sig) {
+        case SIGTSTP:
+        case SIGSTOP:
+            if (p->state == SIM_RUNNING) {
+                p->state = SIM_STOPPED;
+                p->left = p->due > now ? p->due - now : 0;
+                p->gen++;
+                running--;
+                stopped++;
+                queue_status(pid, W_STOPCODE(sig));
+            }
+            break;
+        case SIGCONT:
+            if (p->state == SIM_STOPPED) {
+                p->state = SIM_RUNNING;
+                stopped--;
+                running++;
+                queue_status(pid, SIM_CONTINUED);
+                if (p->held_sig) {
+                    finish(p, pid, W_EXITCODE(0, p->held_sig));
+                }
+                else {
+                    p->due = now + p->left;
+                    push_event(p->due, pid, p->gen);
+                }
+            }
+            break;
+        case SIGINT:
+        case SIGTERM:
+        case SIGHUP:
+        case SIGQUIT:
+        case SIGKILL:
+            // a stopped task only takes SIGKILL until it is continued
+            if (p->state == SIM_STOPPED && sig != SIGKILL) {
+                p->held_sig = sig;
+            }
+            else {
+                finish(p, pid, W_EXITCODE(0, sig));
+            }
+            break;
+        default:
+            break;
+    }
+
+    announce();
+    return 0;
+}
+
+/* If options ask for status */
+static int wanted(int status, int options) {
+    if (WIFSTOPPED(status)) { return options & WUNTRACED; }
+    if (WIFCONTINUED(status)) { return options & WCONTINUED; }
+    return 1;
+}
+
+static pid_t sim_reap(pid_t pid, int *status, int options, struct rusage *usage) {
+    for (;;) {
+        for (long i = queue_head; i < queue_tail; i++) {
+            sim_status *s = &queue[i];
+            if (!s->pid || (pid > 0 && s->pid != pid) || !wanted(s->status, options)) { continue; }
+
+            pid_t found = s->pid;
+            if (status) { *status = s->status; }
+            // virtual time is not cpu time: simulated tasks use nothing
+            if (usage) { memset(usage, 0, sizeof(*usage)); }
+            if (WIFEXITED(s->status) || WIFSIGNALED(s->status)) {
+                find(found)->state = SIM_REAPED;
+                unreaped--;
+            }
+            s->pid = 0;
+            while (queue_head < queue_tail && !queue[queue_head].pid) { queue_head++; }
+            if (queue_head == queue_tail) { queue_head = queue_tail = 0; }
+            return found;
+        }
+
+        sim_proc *p = find(pid);
+        if ((pid > 0 && (!p || p->state == SIM_REAPED)) || (pid <= 0 && unreaped == 0)) {
+            errno = ECHILD;
+            return -1;
+        }
+        if (options & WNOHANG) { return 0; }
+
+        // block by running virtual time forward; the handler may reap first
+        if (!step_event()) {
+            errno = EDEADLK;  // only stopped tasks are left, nothing can change
+            return -1;
+        }
+        announce();
+    }
+}
+
+static void sim_idle(unsigned int seconds) {
+    long limit = now + seconds * 1000L;
+    long queued = queue_tail;
+    sim_event *ev;
+    while (queue_tail == queued && (ev = next_event()) && ev->due <= limit) {
+        step_event();
+    }
+    if (queue_tail == queued) { now = limit; }
+    announce();
+
+    // let the announced SIGCHLDs in, as a real wait would
+    sigset_t chld, mask;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &chld, &mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+}
+
+proc_backend sim_backend = { "sim", sim_spawn, sim_signal, sim_reap, sim_idle };
+
+void sim_advance(long ms) {
+    long limit = now + (ms > 0 ? ms : 0);
+    sim_event *ev;
+    while ((ev = next_event()) && ev->due <= limit) {
+        step_event();
+    }
+    now = limit;
+    announce();
+}
+
+void sim_run(void) {
+    while (step_event()) { }
+    announce();
+}
+
+void sim_stats(long *now_ms, long *num_running, long *num_stopped) {
+    if (now_ms) { *now_ms = now; }
+    if (num_running) { *num_running = running; }
+    if (num_stopped) { *num_stopped = stopped; }
+}
+
+void sim_reset(void) {
+    for (long i = 0; i < num_procs; i++) {
+        free(procs[i].script);
+    }
+    free(procs);
+    free(heap);
+    free(queue);
+    procs = NULL;
+    heap = NULL;
+    queue = NULL;
+    num_procs = cap_procs = num_heap = cap_heap = 0;
+    queue_head = queue_tail = cap_queue = 0;
+    now = running = stopped = unreaped = unannounced = 0;
+}
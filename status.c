@@ -0,0 +1,247 @@
+/* Shared-memory task status table, see status.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "status.h"
+#include "logging.h"
+
+#define STATUS_ROWS 1024 /* rows of a new segment */
+#define SPINS 100         /* busy reads before a reader yields the cpu */
+#define MAX_TRIES 100000  /* busy reads before a reader gives up */
+
+/* The low byte of seq is the depth of nested writes in progress; the rest
+ * counts finished writes.  A write starts with one atomic add, so a signal
+ * handler that writes in the middle of a main-loop write only deepens it. */
+#define SEQ_DEPTH 0xffUL
+
+/* Writer */
+static status_table *table = NULL;
+static size_t table_size = 0;
+static int table_fd = -1;
+static char table_name[64];
+
+/* Reader */
+static const status_table *view = NULL;
+static size_t view_size = 0;
+static int view_fd = -1;
+static status_row *copy = NULL;
+static long copy_cap = 0;
+
+static long wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static size_t size_for(long capacity) {
+    return sizeof(status_table) + capacity * sizeof(status_row);
+}
+
+static void write_begin(void) {
+    __atomic_fetch_add(&table->seq, 1, __ATOMIC_SEQ_CST);
+}
+
+static void write_end(void) {
+    table->updated_ns = wall_ns();
+    // a handler that runs between the check and the add leaves the depth as it found it
+    if ((__atomic_load_n(&table->seq, __ATOMIC_RELAXED) & SEQ_DEPTH) == 1) {
+        __atomic_fetch_add(&table->seq, SEQ_DEPTH, __ATOMIC_SEQ_CST);
+    } else {
+        __atomic_fetch_sub(&table->seq, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/* Resizes the segment to hold at least rows rows.
+ * Signals are held off so no handler writes through the old mapping.
+ * Returns 0 on success and -1 otherwise. */
+static int grow(long rows) {
+    long capacity = table->capacity;
+    while (capacity < rows) { capacity *= 2; }
+
+    sigset_t all, old;
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &old);
+    int ret = -1;
+    size_t size = size_for(capacity);
+    if (!ftruncate(table_fd, size)) {
+        void *map = mremap(table, table_size, size, MREMAP_MAYMOVE);
+        if (map != MAP_FAILED) {
+            table = map;
+            table_size = size;
+            write_begin();
+            table->capacity = capacity;
+            write_end();
+            ret = 0;
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return ret;
+}
+
+int status_open(void) {
+    if (table) { return 0; }
+    snprintf(table_name, sizeof(table_name), STATUS_PREFIX "%d", (int) getpid());
+    //Owner only: commands and their arguments are in it. A segment left by
+    //an earlier controller with this pid is replaced, never reused.
+    shm_unlink(table_name);
+    table_fd = shm_open(table_name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (table_fd < 0) { return -1; }
+
+    table_size = size_for(STATUS_ROWS);
+    void *map = MAP_FAILED;
+    if (!ftruncate(table_fd, table_size)) {
+        map = mmap(NULL, table_size, PROT_READ | PROT_WRITE, MAP_SHARED, table_fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        close(table_fd);
+        shm_unlink(table_name);
+        table_fd = -1;
+        return -1;
+    }
+
+    table = map;
+    table->version = STATUS_VERSION;
+    table->owner = getpid();
+    table->capacity = STATUS_ROWS;
+    table->updated_ns = wall_ns();
+    // readers check the magic last
+    __atomic_store_n(&table->magic, STATUS_MAGIC, __ATOMIC_RELEASE);
+
+    atexit(status_close);
+    return 0;
+}
+
+/* Copies cmd into dst, cut to fit; no stdio, since handlers call this */
+static void copy_command(char *dst, const char *cmd) {
+    size_t i = 0;
+    for (; cmd && cmd[i] && i < STATUS_CMDLEN - 1; i++) { dst[i] = cmd[i]; }
+    dst[i] = '\0';
+}
+
+void status_update(int task, pid_t pid, int state, int exit_code, const char *cmd) {
+    if (!table || task < 0) { return; }
+    if (task >= table->capacity && grow(task + 1)) { return; }
+
+    write_begin();
+    long now = wall_ns();
+    while (table->count <= task) {
+        table->rows[table->count].state = STATUS_EMPTY;
+        table->count++;
+    }
+
+    status_row *row = &table->rows[task];
+    int was = row->state;
+    if (was == STATUS_EMPTY) {
+        memset(row, 0, sizeof(*row));
+        row->task = task;
+        row->created_ns = now;
+    }
+    if (state == LOG_STATE_RUNNING && was != LOG_STATE_RUNNING && was != LOG_STATE_SUSPENDED) {
+        row->started_ns = now;
+        row->ended_ns = 0;
+    }
+    if ((state == LOG_STATE_FINISHED || state == LOG_STATE_KILLED) && was != state) {
+        row->ended_ns = now;
+    }
+    row->pid = pid;
+    row->state = state;
+    row->exit_code = exit_code;
+    copy_command(row->command, cmd);
+    write_end();
+}
+
+void status_remove(int task) {
+    if (!table || task < 0 || task >= table->count) { return; }
+    write_begin();
+    memset(&table->rows[task], 0, sizeof(status_row));
+    table->rows[task].task = task;
+    table->rows[task].state = STATUS_EMPTY;
+    while (table->count > 0 && table->rows[table->count - 1].state == STATUS_EMPTY) {
+        table->count--;
+    }
+    write_end();
+}
+
+void status_close(void) {
+    // forked children inherit the mapping and the atexit handler, but not the table
+    if (!table || table->owner != getpid()) { return; }
+    munmap(table, table_size);
+    close(table_fd);
+    shm_unlink(table_name);
+    table = NULL;
+    table_fd = -1;
+}
+
+/* Maps the whole segment as it is now. Returns 0 on success and -1 otherwise. */
+static int map_view(void) {
+    struct stat st;
+    if (fstat(view_fd, &st) || (size_t) st.st_size < sizeof(status_table)) { return -1; }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, view_fd, 0);
+    if (map == MAP_FAILED) { return -1; }
+    if (view) { munmap((void *) view, view_size); }
+    view = map;
+    view_size = st.st_size;
+    return 0;
+}
+
+int status_attach(pid_t owner) {
+    char name[64];
+    snprintf(name, sizeof(name), STATUS_PREFIX "%d", (int) owner);
+    view_fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (view_fd < 0) { return -1; }
+    if (map_view() || __atomic_load_n(&view->magic, __ATOMIC_ACQUIRE) != STATUS_MAGIC
+        || view->version != STATUS_VERSION) {
+        close(view_fd);
+        view_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+long status_snapshot(const status_row **rows, long *updated_ns) {
+    if (!view) { return -1; }
+    for (long tries = 1; ; tries++) {
+        // the writer may be off the cpu mid-write, or gone for good
+        if (tries > MAX_TRIES) { return -1; }
+        if (tries % SPINS == 0) { sched_yield(); }
+
+        unsigned long seq = __atomic_load_n(&view->seq, __ATOMIC_ACQUIRE);
+        if (seq & SEQ_DEPTH) { continue; }
+
+        long count = view->count;
+        long capacity = view->capacity;
+        if (count < 0 || count > capacity) { continue; }
+
+        // the table has grown past this mapping
+        if (size_for(capacity) > view_size) {
+            if (map_view()) { return -1; }
+            continue;
+        }
+        if (count > copy_cap) {
+            status_row *grown = realloc(copy, count * sizeof(status_row));
+            if (!grown) { return -1; }
+            copy = grown;
+            copy_cap = count;
+        }
+        memcpy(copy, (const void *) view->rows, count * sizeof(status_row));
+        long updated = view->updated_ns;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&view->seq, __ATOMIC_RELAXED) != seq) { continue; }
+
+        *rows = copy;
+        if (updated_ns) { *updated_ns = updated; }
+        return count;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <sys/types.h>
+
+/* Shared-memory task status table for external monitors.
+ *
+ * The controller publishes one row per task number in the POSIX shared
+ * memory segment STATUS_PREFIX<controller pid> (e.g. /dev/shm/kitc.1234),
+ * readable by its owner only.
+ * Readers map it read-only and copy it under a seqlock: the writer marks
+ * the sequence number busy while it changes the table and moves it on
+ * after, and a reader retries any copy that saw a busy or changed
+ * sequence.  The writer never waits for readers, and a copy takes no
+ * syscalls, so monitors can neither block nor slow the controller.
+ *
+ * The table grows (the segment is resized) as task numbers grow.  Writes
+ * may come from the controller's signal handlers as well as its main loop;
+ * nested writes keep the sequence busy until the outermost one is done.
+ */
+
+#define STATUS_PREFIX "/kitc."
+#define STATUS_MAGIC 0x4b495443 /* "KITC" */
+#define STATUS_VERSION 1
+#define STATUS_CMDLEN 64
+#define STATUS_EMPTY -1 /* state of a row with no task */
+
+/* One task. state follows LOG_STATE_*; times are CLOCK_REALTIME in ns, 0 if
+ * not reached yet. */
+typedef struct status_row {
+    int task;
+    pid_t pid;
+    int state;
+    int exit_code;
+    long created_ns;  /* task added */
+    long started_ns;  /* last exec or bg */
+    long ended_ns;    /* last finish or kill */
+    char command[STATUS_CMDLEN];  /* command line, cut to fit */
+} status_row;
+
+typedef struct status_table {
+    unsigned int magic;
+    unsigned int version;
+    pid_t owner;          /* controller pid */
+    unsigned long seq;    /* busy (low byte nonzero) while the table is being changed */
+    long updated_ns;      /* last change */
+    long capacity;        /* rows the segment holds */
+    long count;           /* rows in use: highest task number + 1 */
+    status_row rows[];
+} status_table;
+
+/* Controller side */
+
+/* Creates the segment of this process. Returns 0 on success and -1 otherwise. */
+int status_open(void);
+
+/* Publishes the row of a task. */
+void status_update(int task, pid_t pid, int state, int exit_code, const char *cmd);
+
+/* Empties the row of a purged task. */
+void status_remove(int task);
+
+/* Removes the segment. */
+void status_close(void);
+
+/* Reader side */
+
+/* Maps the segment of controller owner read-only.
+ * Returns 0 on success and -1 otherwise. */
+int status_attach(pid_t owner);
+
+/* Copies a consistent snapshot of the table.  *rows points at the copy,
+ * which stays valid until the next call.  Returns the row count, or -1 if
+ * the table is gone or unreadable. */
+long status_snapshot(const status_row **rows, long *updated_ns);
+
+#endif /*STATUS_H*/
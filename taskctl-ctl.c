@@ -0,0 +1,212 @@
+/* taskctl-ctl: drives a running taskctl through its control socket.
+ * - The controller listens once told "control PATH", or when started as
+ *   "taskctl -d PATH" (see control.h); any number of these clients can be
+ *   connected to it at once.
+ * - Usage: taskctl-ctl [-a] SOCKET [INSTRUCTION...]
+ *     With an instruction, sends it and prints the response.
+ *     Without, sends each line of stdin in turn and prints each response.
+ *     -a  attaches as the console of a daemon: its output is shown as it
+ *         comes, starting with what it kept while nobody was attached, and
+ *         instructions are read at a kitc$ prompt.  "detach" or end of
+ *         input leaves the daemon running.
+ * - Exits 1 if the controller cannot be reached or goes away.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control.h"
+
+static int write_all(int fd, const char *buf, size_t len) {
+   while (len > 0){
+	ssize_t n = write(fd, buf, len);
+	if (n < 0 && errno == EINTR)
+	     continue;
+	if (n <= 0)
+	     return -1;
+	buf += n;
+	len -= n;
+   }
+   return 0;
+}
+
+static int read_all(int fd, char *buf, size_t len) {
+   while (len > 0){
+	ssize_t n = read(fd, buf, len);
+	if (n < 0 && errno == EINTR)
+	     continue;
+	if (n <= 0)
+	     return -1;
+	buf += n;
+	len -= n;
+   }
+   return 0;
+}
+
+/* Sends one instruction. Returns 0 on success and -1 if the controller is gone. */
+static int send_request(int sock, const char *line) {
+   size_t len = strlen(line);
+   if (len > CONTROL_MAXREQ)
+	len = CONTROL_MAXREQ;
+   char frame[4 + CONTROL_MAXREQ];
+   uint32_t header = htonl(len);
+   memcpy(frame, &header, 4);
+   memcpy(frame + 4, line, len);
+   return write_all(sock, frame, 4 + len);
+}
+
+/* Copies one frame to stdout. Returns 1 for a response, 0 for console
+ * output and -1 if the controller is gone. */
+static int print_frame(int sock) {
+   static char *body = NULL;
+   static size_t body_cap = 0;
+
+   uint32_t header;
+   if (read_all(sock, (char *) &header, 4))
+	return -1;
+   header = ntohl(header);
+   size_t len = header & ~CONTROL_OUTPUT;
+   if (len > body_cap){
+	char *grown = realloc(body, len);
+	if (!grown)
+	     return -1;
+	body = grown;
+	body_cap = len;
+   }
+   if (read_all(sock, body, len))
+	return -1;
+   fwrite(body, 1, len, stdout);
+   fflush(stdout);
+   return header & CONTROL_OUTPUT ? 0 : 1;
+}
+
+/* Sends one instruction and copies its response to stdout.
+ * Returns 0 on success and -1 if the controller is gone. */
+static int request(int sock, const char *line) {
+   if (send_request(sock, line))
+	return -1;
+   int ret;
+   while ((ret = print_frame(sock)) == 0)
+	;
+   return ret < 0 ? -1 : 0;
+}
+
+/* Runs the console of a daemon until detach or end of input.
+ * Returns 0 on success and -1 if the controller is gone. */
+static int run_console(int sock) {
+   char *line = NULL;
+   size_t cap = 0;
+   int waiting = 1, detaching = 0;
+   if (send_request(sock, "attach"))
+	return -1;
+
+   while (1){
+	// lines stdio has read ahead do not show up in poll
+	int buffered = stdin->_IO_read_ptr < stdin->_IO_read_end;
+	struct pollfd fds[2] = { { sock, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+	if (!waiting && buffered)
+	     fds[1].revents = POLLIN;
+	else if (poll(fds, waiting ? 1 : 2, -1) < 0){
+	     if (errno == EINTR)
+		  continue;
+	     return -1;
+	}
+
+	if (fds[0].revents){
+	     int ret = print_frame(sock);
+	     if (ret < 0)
+		  return -1;
+	     if (ret == 1){
+		  if (detaching)
+		       return 0;
+		  waiting = 0;
+		  printf("kitc$ ");
+		  fflush(stdout);
+	     }
+	     continue;
+	}
+
+	if (!waiting && fds[1].revents){
+	     ssize_t n = getline(&line, &cap, stdin);
+	     if (n < 0)
+		  return 0;
+	     if (n > 0 && line[n - 1] == '\n')
+		  line[--n] = '\0';
+	     detaching = !strcmp(line, "detach") || !strcmp(line, "quit");
+	     if (send_request(sock, line))
+		  return -1;
+	     waiting = 1;
+	}
+   }
+}
+
+int main(int argc, char *argv[]) {
+   int attach = 0;
+   int opt;
+   while ((opt = getopt(argc, argv, "+a")) != -1){
+	if (opt != 'a'){
+	     fprintf(stderr, "usage: %s [-a] SOCKET [INSTRUCTION...]\n", argv[0]);
+	     return 2;
+	}
+	attach = 1;
+   }
+   if (optind >= argc){
+	fprintf(stderr, "usage: %s [-a] SOCKET [INSTRUCTION...]\n", argv[0]);
+	return 2;
+   }
+
+   struct sockaddr_un addr = {0};
+   addr.sun_family = AF_UNIX;
+   snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", argv[optind]);
+   int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (sock < 0 || connect(sock, (struct sockaddr *) &addr, sizeof(addr))){
+	fprintf(stderr, "taskctl-ctl: cannot connect to %s: %s\n", argv[optind], strerror(errno));
+	return 1;
+   }
+
+   if (attach){
+	if (run_console(sock)){
+	     fprintf(stderr, "taskctl-ctl: controller went away\n");
+	     return 1;
+	}
+	return 0;
+   }
+
+   // one instruction from the arguments
+   if (optind + 1 < argc){
+	char line[CONTROL_MAXREQ + 1] = {0};
+	size_t len = 0;
+	for (int i = optind + 1; i < argc && len < CONTROL_MAXREQ; i++)
+	     len += snprintf(line + len, sizeof(line) - len, "%s%s", i > optind + 1 ? " " : "", argv[i]);
+	if (request(sock, line)){
+	     fprintf(stderr, "taskctl-ctl: controller went away\n");
+	     return 1;
+	}
+	return 0;
+   }
+
+   // or one per line of stdin
+   char *line = NULL;
+   size_t cap = 0;
+   ssize_t n;
+   while ((n = getline(&line, &cap, stdin)) != -1){
+	if (n > 0 && line[n - 1] == '\n')
+	     line[n - 1] = '\0';
+	if (request(sock, line)){
+	     fprintf(stderr, "taskctl-ctl: controller went away\n");
+	     return 1;
+	}
+   }
+   free(line);
+   return 0;
+}
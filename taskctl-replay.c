@@ -0,0 +1,260 @@
+/* taskctl-replay: replays a recorded session against a running taskctl and
+ * reports how long each line took to be answered.
+ * - Sessions are recorded with "taskctl -r FILE" or "record FILE" (see
+ *   session.h); the controller replayed against listens on a control
+ *   socket ("taskctl -d SOCKET" or "control SOCKET", see control.h), a
+ *   fresh one, since the lines name tasks by number (bench/replay.sh).
+ * - Usage: taskctl-replay [-s SPEED | -f] RECORDING SOCKET
+ *     Lines are sent at the times they were read, or SPEED times faster
+ *     with -s (0.5 for half speed), or with -f as fast as possible: each
+ *     line as soon as the one before is answered.
+ * - A line's response time runs from sending it to the end of its
+ *   response, so it includes the socket round trip and any wait behind
+ *   lines sent before it, not just the controller's own time over it.
+ *   Output is CSV: a row a line (line,at_s,response_ms,command), then a row
+ *   an instruction or command name (instruction,count,p50_ms,p95_ms,p99_ms,
+ *   max_ms) over those response times.
+ * - Exits 1 if the recording or the controller cannot be opened, or the
+ *   controller goes away before answering every line (but a quit).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control.h"
+#include "session.h"
+
+/* A recorded line and how it went */
+typedef struct replay_line {
+   long at;          /* ns since the recording began */
+   char *command;
+   long sent;        /* when it was sent, 0 if not yet */
+   long response;    /* ns from sending it to the end of its response, -1 if none came */
+} replay_line;
+
+static long now_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+   while (len > 0){
+	ssize_t n = write(fd, buf, len);
+	if (n < 0 && errno == EINTR)
+	     continue;
+	if (n <= 0)
+	     return -1;
+	buf += n;
+	len -= n;
+   }
+   return 0;
+}
+
+static int read_all(int fd, char *buf, size_t len) {
+   while (len > 0){
+	ssize_t n = read(fd, buf, len);
+	if (n < 0 && errno == EINTR)
+	     continue;
+	if (n <= 0)
+	     return -1;
+	buf += n;
+	len -= n;
+   }
+   return 0;
+}
+
+/* Sends one instruction. Returns 0 on success and -1 if the controller is gone. */
+static int send_request(int sock, const char *line) {
+   size_t len = strlen(line);
+   if (len > CONTROL_MAXREQ)
+	len = CONTROL_MAXREQ;
+   char frame[4 + CONTROL_MAXREQ];
+   uint32_t header = htonl(len);
+   memcpy(frame, &header, 4);
+   memcpy(frame + 4, line, len);
+   return write_all(sock, frame, 4 + len);
+}
+
+/* Reads and drops one frame. Returns 1 for a response, 0 for console
+ * output and -1 if the controller is gone. */
+static int skip_frame(int sock) {
+   char body[4096];
+   uint32_t header;
+   if (read_all(sock, (char *) &header, 4))
+	return -1;
+   header = ntohl(header);
+   size_t len = header & ~CONTROL_OUTPUT;
+   while (len > 0){
+	size_t n = len < sizeof(body) ? len : sizeof(body);
+	if (read_all(sock, body, n))
+	     return -1;
+	len -= n;
+   }
+   return header & CONTROL_OUTPUT ? 0 : 1;
+}
+
+/* First word of a command line, for grouping */
+static int word_len(const char *s) {
+   return strcspn(s, " \t");
+}
+
+static int by_word_then_response(const void *a, const void *b) {
+   const replay_line *x = *(replay_line * const *) a, *y = *(replay_line * const *) b;
+   int lx = word_len(x->command), ly = word_len(y->command);
+   int cmp = strncmp(x->command, y->command, lx < ly ? lx : ly);
+   if (cmp || lx != ly)
+	return cmp ? cmp : lx - ly;
+   return (x->response > y->response) - (x->response < y->response);
+}
+
+/* Prints s as a quoted CSV field. */
+static void print_field(const char *s) {
+   putchar('"');
+   for (; *s; s++){
+	if (*s == '"')
+	     putchar('"');
+	putchar(*s);
+   }
+   putchar('"');
+}
+
+/* Prints a row per line, then the response times of each instruction. */
+static void report(replay_line *lines, long count) {
+   replay_line **answered = malloc(count * sizeof(replay_line *));
+   long n = 0;
+   printf("line,at_s,response_ms,command\n");
+   for (long i = 0; i < count; i++){
+	printf("%ld,%.3f,", i + 1, lines[i].at / 1e9);
+	if (lines[i].response >= 0){
+	     printf("%.3f", lines[i].response / 1e6);
+	     answered[n++] = &lines[i];
+	}
+	putchar(',');
+	print_field(lines[i].command);
+	putchar('\n');
+   }
+
+   qsort(answered, n, sizeof(replay_line *), by_word_then_response);
+   printf("instruction,count,p50_ms,p95_ms,p99_ms,max_ms\n");
+   for (long start = 0, end; start < n; start = end){
+	int len = word_len(answered[start]->command);
+	for (end = start + 1; end < n && word_len(answered[end]->command) == len &&
+		  !strncmp(answered[end]->command, answered[start]->command, len); end++)
+	     ;
+	long k = end - start;
+	replay_line **g = answered + start;
+	printf("%.*s,%ld,%.3f,%.3f,%.3f,%.3f\n", len, g[0]->command, k,
+	       g[k * 50 / 100]->response / 1e6, g[k * 95 / 100]->response / 1e6,
+	       g[k * 99 / 100]->response / 1e6, g[k - 1]->response / 1e6);
+   }
+   free(answered);
+}
+
+int main(int argc, char *argv[]) {
+   double speed = 1;
+   int fast = 0;
+   int opt;
+   while ((opt = getopt(argc, argv, "s:f")) != -1){
+	char *end = NULL;
+	if (opt == 'f')
+	     fast = 1;
+	else if (opt != 's' || (speed = strtod(optarg, &end)) <= 0 || *end != '\0'){
+	     fprintf(stderr, "usage: %s [-s SPEED | -f] RECORDING SOCKET\n", argv[0]);
+	     return 2;
+	}
+   }
+   if (optind + 2 != argc){
+	fprintf(stderr, "usage: %s [-s SPEED | -f] RECORDING SOCKET\n", argv[0]);
+	return 2;
+   }
+
+   FILE *in = session_open(argv[optind]);
+   if (!in){
+	fprintf(stderr, "taskctl-replay: cannot read recording %s\n", argv[optind]);
+	return 1;
+   }
+   replay_line *lines = NULL;
+   long count = 0, cap = 0;
+   char line[SESSION_MAXLINE + 1];
+   long at;
+   while ((at = session_next(in, line, sizeof(line))) >= 0){
+	if (count == cap){
+	     cap = cap ? cap * 2 : 256;
+	     lines = realloc(lines, cap * sizeof(replay_line));
+	     if (!lines)
+		  return 1;
+	}
+	lines[count++] = (replay_line) { at, strdup(line), 0, -1 };
+   }
+   fclose(in);
+
+   struct sockaddr_un addr = {0};
+   addr.sun_family = AF_UNIX;
+   snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", argv[optind + 1]);
+   int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (sock < 0 || connect(sock, (struct sockaddr *) &addr, sizeof(addr))){
+	fprintf(stderr, "taskctl-replay: cannot connect to %s: %s\n", argv[optind + 1], strerror(errno));
+	return 1;
+   }
+
+   // lines go out on their schedule (or as each is answered with -f), and
+   // responses come back in order while they do
+   long start = now_ns();
+   long sent = 0, answered = 0;
+   int gone = 0;
+   while (answered < count && !gone){
+	long due = 0;
+	if (sent < count && !fast)
+	     due = start + (long) (lines[sent].at / speed);
+	if (sent < count && (fast ? answered == sent : now_ns() >= due)){
+	     lines[sent].sent = now_ns();
+	     if (send_request(sock, lines[sent].command)){
+		  gone = 1;
+		  break;
+	     }
+	     sent++;
+	     continue;
+	}
+
+	int timeout = -1;
+	if (sent < count && !fast){
+	     long wait = due - now_ns();
+	     timeout = wait > 0 ? (wait + 999999) / 1000000 : 0;
+	}
+	struct pollfd fds = { sock, POLLIN, 0 };
+	if (sent == answered && timeout < 0)
+	     break;
+	int ready = poll(&fds, sent > answered ? 1 : 0, timeout);
+	if (ready < 0 && errno != EINTR)
+	     gone = 1;
+	else if (ready > 0){
+	     int ret = skip_frame(sock);
+	     if (ret < 0)
+		  gone = 1;
+	     else if (ret == 1){
+		  lines[answered].response = now_ns() - lines[answered].sent;
+		  answered++;
+	     }
+	}
+   }
+
+   report(lines, count);
+   // the controller goes away on a quit before it can answer
+   if (gone && !(answered == sent - 1 && !strncmp(lines[answered].command, "quit", 4))){
+	fprintf(stderr, "taskctl-replay: controller went away after %ld of %ld line(s)\n", answered, count);
+	return 1;
+   }
+   return 0;
+}
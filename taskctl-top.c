@@ -0,0 +1,133 @@
+/* taskctl-top: watches the task table of a running taskctl, read-only.
+ * - Reads the shared status table (see status.h); the controller is never
+ *   asked for anything and never waits on this program.
+ * - Usage: taskctl-top [-n] [-i SECONDS] [PID]
+ *     PID         controller to watch (default: the first live one found)
+ *     -i SECONDS  refresh interval (default 1)
+ *     -n          print the table once and exit
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "status.h"
+
+#define SHM_DIR "/dev/shm"
+#define OUTSIZE (1 << 20)
+
+static const char *state_names[] = { "Ready", "Running", "Suspended", "Finished", "Killed" };
+
+static int alive(pid_t pid) {
+   return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+/* Finds a live controller from its segment. Returns its pid, or 0. */
+static pid_t find_controller(void) {
+   DIR *dir = opendir(SHM_DIR);
+   if (!dir)
+	return 0;
+   pid_t found = 0;
+   struct dirent *ent;
+   while (!found && (ent = readdir(dir)) != NULL){
+	if (strncmp(ent->d_name, STATUS_PREFIX + 1, strlen(STATUS_PREFIX) - 1))
+	     continue;
+	pid_t pid = atoi(ent->d_name + strlen(STATUS_PREFIX) - 1);
+	if (pid > 0 && alive(pid))
+	     found = pid;
+   }
+   closedir(dir);
+   return found;
+}
+
+static long wall_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Formats one snapshot into out. Returns its length. */
+static size_t render(char *out, size_t size, pid_t owner, const status_row *rows, long count, long updated) {
+   long now = wall_ns();
+   long states[5] = {0};
+   for (long i = 0; i < count; i++){
+	if (rows[i].state >= 0 && rows[i].state < 5)
+	     states[rows[i].state]++;
+   }
+
+   size_t len = snprintf(out, size, "taskctl %d: %ld ready, %ld running, %ld suspended, %ld finished, %ld killed (updated %.1fs ago)\n%6s %8s %-10s %4s %10s  %s\n",
+			 (int) owner, states[0], states[1], states[2], states[3], states[4], (now - updated) / 1e9,
+			 "TASK", "PID", "STATE", "EXIT", "RUNTIME", "COMMAND");
+   for (long i = 0; i < count && len < size; i++){
+	const status_row *r = &rows[i];
+	if (r->state < 0 || r->state >= 5)
+	     continue;
+	double runtime = 0;
+	if (r->started_ns)
+	     runtime = ((r->ended_ns ? r->ended_ns : now) - r->started_ns) / 1e9;
+	len += snprintf(out + len, size - len, "%6d %8d %-10s %4d %9.2fs  %s\n",
+			r->task, (int) r->pid, state_names[r->state], r->exit_code, runtime, r->command);
+   }
+   return len < size ? len : size - 1;
+}
+
+int main(int argc, char *argv[]) {
+   int once = 0;
+   double interval = 1;
+   pid_t owner = 0;
+
+   int opt;
+   while ((opt = getopt(argc, argv, "ni:")) != -1){
+	switch (opt){
+	case 'n': once = 1; break;
+	case 'i': interval = atof(optarg); break;
+	default:
+	     fprintf(stderr, "usage: %s [-n] [-i SECONDS] [PID]\n", argv[0]);
+	     return 2;
+	}
+   }
+   if (optind < argc)
+	owner = atoi(argv[optind]);
+   if (!owner)
+	owner = find_controller();
+   if (!owner){
+	fprintf(stderr, "taskctl-top: no running taskctl found\n");
+	return 1;
+   }
+   if (status_attach(owner)){
+	fprintf(stderr, "taskctl-top: no task table for taskctl %d\n", (int) owner);
+	return 1;
+   }
+
+   static char out[OUTSIZE];
+   int tty = isatty(STDOUT_FILENO);
+   struct timespec pause = { (time_t) interval, (long) ((interval - (time_t) interval) * 1e9) };
+   while (1){
+	const status_row *rows;
+	long updated;
+	long count = status_snapshot(&rows, &updated);
+	if (count < 0 || !alive(owner)){
+	     fprintf(stderr, "taskctl-top: taskctl %d is gone\n", (int) owner);
+	     return 1;
+	}
+
+	// one write per refresh, redrawn in place on a terminal
+	size_t len = 0;
+	if (tty && !once)
+	     len = snprintf(out, sizeof(out), "\033[H\033[2J");
+	len += render(out + len, sizeof(out) - len, owner, rows, count, updated);
+	if (write(STDOUT_FILENO, out, len) < 0)
+	     return 1;
+
+	if (once)
+	     return 0;
+	nanosleep(&pause, NULL);
+   }
+}
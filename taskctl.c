@@ -1,20 +1,158 @@
-/* This is the only file you should update and submit. */
+/* The task controller: the command loop, the task table and launching.
+ * The rest is in modules of their own, each described in its header
+ * (cache.h, metrics.h, backend.h, control.h, journal.h, launcher.h, ...). */
 
 /* Fill in your Name and GNumber in the following two comment fields
  * Name: Piyush Budhathoki
  * GNumber: G01187180
  */
 
+#define _GNU_SOURCE
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sched.h>
+#include <poll.h>
 #include "taskctl.h"
 #include "parse.h"
 #include "util.h"   
+#include "cache.h"
+#include "metrics.h"
+#include "backend.h"
+#include "status.h"
+#include "procstat.h"
+#include "control.h"
+#include "journal.h"
+#include "relay.h"
+#include "watch.h"
+#include "psi.h"
+#include "usage.h"
+#include "launcher.h"
+#include "trace.h"
+#include "session.h"
 
 /* Constants */
 #define DEBUG 0
 
+/* Placement policies for background tasks */
+#define PLACE_NONE   0
+#define PLACE_SPREAD 1
+#define PLACE_NUMA   2
+
+#define MAXNUMA 64 /* the max number of NUMA nodes tracked */
+#define MAXPOOL 16 /* the max number of warm helpers per executable */
+#define ADOPT_POLL_MS 100 /* how often an idle loop checks adopted tasks and chains */
+#define WHEEL_SLOTS 1024 /* slots of the schedule timer wheel */
+#define WHEEL_TICK 10000000L /* ns one slot of the wheel covers */
+#define RUNS_KEPT 5 /* the number of scheduled runs of a task kept for list */
+#define READAHEAD (4 << 20) /* bytes of an input file read ahead at launch */
+#define SPAWN_TRIES 10 /* forks of a launch tried while they fail with EAGAIN or ENOMEM, in the foreground */
+#define SPAWN_BACKOFF 1000000L /* ns before the first retry of a fork, doubled up to the last one */
+#define LAUNCH_YIELD 100000000L /* ns held launches give way to command lines that keep coming */
+#define PRESSURE_HOLD 5000000000L /* ns pressure stays under half of every limit before shed load comes back */
+#define PACK_AGE 10000000000L /* ns a launch waits for room before it goes ahead of those that fit better */
+#define SHUTDOWN_DEADLINE 5.0 /* s tasks have to exit on quit before they get SIGKILL */
+#define SHUTDOWN_KILL_WAIT 1000000000L /* ns a task is waited for after SIGKILL before quit gives up on it */
+
+/* Where the needs of a task come from, see taskNeeds() */
+#define NEEDS_GUESSED  0
+#define NEEDS_LEARNED  1
+#define NEEDS_DECLARED 2
+
+/* Relays between task pipes */
+#define RELAY_TEE   0
+#define RELAY_COPY  1
+#define RELAY_MERGE 2
+
+/* Operators joining a step of a chain to the one before it */
+#define CHAIN_SEQ 0 /* ; runs the step whatever came before */
+#define CHAIN_AND 1 /* && runs it if the chain so far succeeded */
+#define CHAIN_OR  2 /* || runs it if the chain so far failed */
+
+/* What a schedule does when a run comes due while the last one still runs */
+#define OVERLAP_SKIP  0 /* drops the new run */
+#define OVERLAP_QUEUE 1 /* starts it once the last one ends */
+#define OVERLAP_KILL  2 /* kills the last one, then starts it */
+
+/* ioprio_set() values, see linux/ioprio.h */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
 //static const char *task_path[] = { "./", "/usr/bin/", NULL };
-static const char *instructions[] = { "quit", "help", "list", "purge", "exec", "bg", "kill", "suspend", "resume", "pipe", NULL};
+static const char *instructions[] = { "quit", "help", "list", "purge", "exec", "bg", "kill", "suspend", "resume", "pipe", "place", "placement", "pool", "cache", "invalidate", "metrics", "backend", "sim", "top", "control", "attach", "detach", "journal", "tee", "merge", "every", "at", "watch", "limit", "pressure", "pack", "wait", "launchers", "record", NULL};
+
+/* One command of a chain such as "build && test || notify", with its last run. */
+typedef struct Chain_Step{
+    char *command; // Command line of the step
+    int op; // CHAIN_SEQ, CHAIN_AND or CHAIN_OR, joining it to the step before
+    pid_t pid; // Pid of its last run, 0 if it has not run
+    int status; // LOG_STATE_READY if it has not run or was skipped
+    int exitCode; // Exit code, or 128 + signal if a signal ended it
+    long start; // When it was launched, in ns
+    long end; // When it was reaped, in ns
+}Chain_Step;
+
+/* A run of a scheduled task. */
+typedef struct Run_Record{
+    int status; // LOG_STATE_FINISHED or LOG_STATE_KILLED
+    int exitCode; // Exit code
+    long duration; // From launch to reap, in ns
+}Run_Record;
+
+/* A task run every interval, or once at a time, from the timer wheel. */
+typedef struct Schedule{
+    struct Process_Node *node; // Task to run
+    char when[32]; // As given, e.g. "every 5m" or "at 12:00"
+    long interval; // ns between runs, 0 for a single run
+    long due; // Next run, on the metrics_now() clock
+    int overlap; // OVERLAP_SKIP, OVERLAP_QUEUE or OVERLAP_KILL
+    int armed; // If it is on the wheel
+    int queued; // Runs waiting for the one in progress
+    long skipped; // Runs dropped because the last one still ran
+    struct Schedule *prev; // Previous in its wheel slot
+    struct Schedule *next; // Next in its wheel slot
+}Schedule;
+
+/* A task re-run when a file it reads changes. */
+typedef struct Watch{
+    int files[MAXARGS]; // Ids of the watched files, see watch.h
+    int numFiles; // Number of files
+    char *args; // Redirections of each run, as given to watch
+    int pending; // If a change came while the last run was still going
+    long runs; // Runs started by changes
+}Watch;
+
+/* A task a wait instruction waits for. The links of the waits on a task
+ * hang off its node, so a task ending reaches only the waits on it. */
+typedef struct Wait_Link{
+    struct Wait *wait; // The wait
+    int task; // Task number
+    int ended; // If the task has ended since the wait began
+    int exitCode; // Its exit code then, 128 + SIGINT if killed
+    struct Wait_Link *next; // Next link of a wait on the same task
+}Wait_Link;
+
+/* A wait instruction in progress. */
+typedef struct Wait{
+    Wait_Link *links; // One per task waited for
+    int numTasks; // Number of tasks
+    int any; // If the first task to end ends the wait
+    int left; // Tasks not ended yet
+    int first; // Link of the first task to end, -1 if none has
+    volatile sig_atomic_t due; // If it is over, left for the main loop to answer
+    long start; // When it began, on the metrics_now() clock
+    long deadline; // When it times out, 0 if never
+    long hold; // Held response of the control client that asked, 0 for stdin
+    struct Wait *next; // Next wait in progress
+}Wait;
 
 /* Node struct for linked list structure. */
 typedef struct Process_Node{
@@ -24,10 +162,210 @@ typedef struct Process_Node{
     int status; // Status of process
     char *command; // Full command line string
     Instruction *inst; // Instruction
+    cpu_set_t cpuSet; // CPUs set by place
+    int hasCpuSet; // If cpuSet should be applied
+    int niceLevel; // Nice level set by place
+    int hasNice; // If niceLevel should be applied
+    int schedPolicy; // SCHED_OTHER, SCHED_BATCH or SCHED_IDLE
+    int ioClass; // ioprio class, 0 to leave unchanged
+    int placedSlot; // CPU or NUMA node chosen by the placement policy, -1 if none
+    int cached; // If the output of runs is memoized
+    char cacheKey[CACHE_KEYLEN]; // Key of the run being recorded
+    char *cacheOut; // Output file of the run being recorded, NULL if none
+    int adoptFd; // Pidfd of a task taken over from before a restart, -1 if none
+    pid_t relayPid; // Relay (tee, merge) of its last run, 0 if none
+    int relayFd; // Pidfd of that relay, -1 if none
+    int redirFds[3]; // Files opened by exec/bg for stdin, stdout and stderr, -1 if none
+    int outAppend; // If the output file is appended to (>>)
+    int errToOut; // If stderr copies the stdout the task is launched with (2>&1 before any > FILE)
+    Chain_Step *steps; // Steps if the command is a chain, NULL otherwise
+    int numSteps; // Number of steps
+    int step; // Step running or due to run
+    volatile sig_atomic_t stepDue; // If the reaper has left the next step for the main loop
+    Schedule *schedule; // every or at schedule, NULL if none
+    long runStart; // When the scheduled run in progress was launched, 0 if none
+    long numRuns; // Scheduled runs finished
+    Run_Record runs[RUNS_KEPT]; // The last of them, run n at n % RUNS_KEPT
+    Watch *watch; // Files that re-run it when changed, NULL if none
+    int throttled; // If its launch waits in the launch queue
+    struct Launch *launching; // Its launch while a launcher thread has it, NULL otherwise
+    int spawnTries; // Failed forks of the launch in progress
+    long waitStart; // When the launch began to wait
+    long retryAt; // When to fork again after a failed fork, 0 to go with the next token
+    struct Process_Node *nextWaiting; // Next in the launch queue
+    int shed; // If suspended by admission control, to resume once pressure falls
+    double needCores; // Cores a run keeps busy, as declared by place, -1 if not
+    long needMemKb; // Peak memory of a run, as declared by place, -1 if not
+    double waitCores; // Its needs while in the launch queue, as of the last drain
+    long waitMemKb;
+    long launchedAt; // When the run in progress was launched, 0 if none or a chain
+    double usedCores; // Cores the last run kept busy, from its rusage
+    long usedRssKb; // Peak memory of the last run
+    volatile sig_atomic_t usageDue; // If the reaper has left its use to be learned
+    Wait_Link *waiters; // Links of the waits on it, NULL if none
     struct Process_Node *next; // Next node
 
 }Process_Node;
 
+/* Pre-forked helpers that have already resolved and opened one executable.
+ * Each idle helper waits on its own socket for a Launch_Request. */
+typedef struct Warm_Pool{
+    char name[MAXLINE]; // Command name as typed, e.g. "my_echo"
+    char path[MAXLINE]; // Path found by findPath
+    int exeFd; // Opened executable, used by fexecve
+    int count; // Number of helper slots
+    pid_t pids[MAXPOOL]; // Pid of each idle helper, -1 if the slot is empty
+    int socks[MAXPOOL]; // Controller end of each helper's socket
+    struct Warm_Pool *next; // Next pool
+}Warm_Pool;
+
+/* Message sent to a helper to start a task.
+ * Stdin/stdout for the task travel alongside as SCM_RIGHTS. */
+typedef struct Launch_Request{
+    int backGround; // If the task gets its own process group
+    int numFds; // Number of fds passed
+    int targets[3]; // Fd each passed fd is duplicated onto
+    int errToOut; // If stderr is made a copy of the helper's own stdout
+    Process_Node place; // Placement fields of the task, pointers are not used
+    char command[MAXLINE]; // Command line to run
+    long spawnStart; // When the controller began the launch
+}Launch_Request;
+
+/* What a launched child needs, passed through the process backend. */
+typedef struct Child_Args{
+    Process_Node *eNode; // Task being launched
+    int taskNum; // Its number, so the child need not follow eNode -> inst
+    int BG; // If background task
+    int *pipefd; // Pipe ends for stdin and stdout (-1 for none), NULL if none
+    char **command; // Split command line
+    long spawnStart; // When the controller began the launch
+    char path[MAXLINE]; // Executable found by findPath(), before the fork
+}Child_Args;
+
+/* A background launch handed to a launcher thread. The child gets a copy
+ * of the node, since the node can change or be purged before the child
+ * runs: it only reads the copy's values (placement, with a slot already
+ * turned into its cpus, and the redirected files, which stay open until
+ * finishLaunches() takes the launch back), never what its pointers hold. */
+typedef struct Launch{
+    launch_job job; // First, so a job is its Launch
+    Child_Args args;
+    Process_Node node; // Copy of the task for the child
+    char *command[MAXARGS+1]; // Split command line
+    char *cmdCopy; // What command points into
+    int pipefd[2]; // Copies of the pipe ends the child takes, -1 for none, closed once back
+    Process_Node *eNode; // The task, NULL once purged
+}Launch;
+
+/* Names of the OVERLAP_* policies, as given to every and at. */
+static const char *overlaps[] = { "skip", "queue", "kill" };
+
+/* Number of cached tasks whose run is being recorded, so the table is only
+ * searched for finished ones while there are any. */
+int numRecording;
+
+/* Warm pools, one per pooled executable. */
+Warm_Pool *pools;
+
+/* If stdin is still read. After EOF it is left alone while the control
+ * socket serves clients. */
+int stdinOpen;
+
+/* Input read from stdin and not yet taken as lines, and if its end was
+ * reached. Stdin is read here rather than through stdio, so what is held
+ * back from poll() is known without looking inside a FILE. */
+char stdinBuf[MAXLINE];
+int stdinLen;
+int stdinEnded;
+
+/* Number of tasks taken over from before a restart that are still running. */
+int numAdopted;
+
+/* Number of chains running, and if any has a step due. Both change in the reapers. */
+volatile sig_atomic_t numChains;
+volatile sig_atomic_t chainsDue;
+
+/* Timer wheel of schedules, slot (due / WHEEL_TICK) % WHEEL_SLOTS: its
+ * timerfd, the time it is armed for (0 if not), the last tick turned and
+ * the number of schedules on it. Runs queued behind a run in progress are
+ * counted apart, and flagged due by the reapers when it ends. */
+Schedule *wheel[WHEEL_SLOTS];
+int wheelFd = -1;
+long wheelNext;
+long wheelTick;
+int numSchedules;
+int numQueued;
+volatile sig_atomic_t runsDue;
+
+/* Number of tasks watching their files. */
+int numWatches;
+
+/* Waits in progress, and their number: waitsDue is set by the reapers when
+ * one is over, waitFd (on the wake fd) fires at the first deadline, and
+ * stdinHeld is set while one from stdin holds the script back. */
+Wait *waits;
+int numWaits;
+volatile sig_atomic_t waitsDue;
+int waitFd = -1;
+int stdinHeld;
+
+/* Launch limiter: a token bucket holding up to launchBurst launches and
+ * refilled at launchRate a second (0 for no limit). Background launches
+ * that find no token, or whose fork failed, wait in a queue in order, and
+ * the prompt is woken by limitFd when the first can go. tokenHeld is set
+ * while launchWaiting() makes a launch it has taken a token for, and
+ * launchBatch is when it last let launches through. */
+double launchRate;
+int launchBurst;
+double launchTokens;
+long launchRefill;
+Process_Node *waitHead;
+Process_Node *waitTail;
+int numWaiting;
+int limitFd = -1;
+int tokenHeld;
+long launchBatch;
+
+/* Admission control: the stall % of each resource past which background
+ * launches are held back (0 if not watched), and if running background
+ * tasks are suspended too. pressured is set by a window past a limit, and
+ * cleared once every resource has stayed under half its limit for
+ * PRESSURE_HOLD (since calmSince) and the tasks suspended have resumed. */
+double pressureLimit[PSI_RESOURCES];
+int pressureOn;
+int pressureShed;
+int pressured;
+long calmSince;
+
+/* Packing: background launches wait in the launch queue until their cores
+ * and memory fit in what running tasks leave of packCores and packMemKb,
+ * and are taken best-fit rather than in order (0 cores: packing off; 0 KiB:
+ * memory unknown, so not limited).
+ * usageDue is set by the reapers when a run has use to be learned. */
+double packCores;
+long packMemKb;
+volatile sig_atomic_t usageDue;
+
+/* Number of background launches handed to the launcher threads (see
+ * launcher.h) and not yet back. */
+int numLaunching;
+
+/* Epoll fd over the timer wheel, the file watches, the launch limiter,
+ * pressure and the launcher threads, which the prompt waits on with stdin,
+ * -1 until either is used. */
+int wakeFd = -1;
+
+/* Start of the launch in progress, read by the child for spawn latency. */
+long spawnStart;
+
+/* Periodic metrics dump target (NULL if off), interval and next due time, in ns. */
+char *metricsTarget;
+long metricsInterval;
+long metricsDue;
+
+/* How tasks are spawned, signalled and reaped: for real, or simulated. */
+proc_backend *procBackend;
+
 /* Pointer to head of linked list
  * to store instructions. */
 Process_Node *head;
@@ -37,6 +375,13 @@ int currentTaskNum;
 struct sigaction actChild;
 struct sigaction actKey;
 
+/* Placement policy for background tasks and the machine topology it uses. */
+int placePolicy;
+int numCpus;
+int usableCpus[CPU_SETSIZE]; // The cpus the controller may run on, in order
+int numNumaNodes;
+cpu_set_t numaCpus[MAXNUMA];
+
 /* Finds the node with specified task number.
  * Returns node with instruciton with correct task num, or NULL on failure. */
 Process_Node* getTaskNode(pid_t pid);
@@ -49,72 +394,140 @@ Process_Node* getPidNode(pid_t pid);
  * Also handles sending signals with keybaord inputs. */
 void sendSig(Process_Node *node, int sig, int kB);
 
-/* Child handler primarily for background processes.
- * Uses pid of reaped child to find the node of the process.
- * Also handles SIGINT, SIGTSTP, and SIGCONT */
-void bg_handler(int sig){
-    pid_t pid;  //Pid of process
-    int child_status;  //Child exit status information
+/* Publishes the row of a task for external monitors. */
+void publishNode(Process_Node *node){
+    status_update(node -> inst -> num, node -> pid, node -> status, node -> exitCode, node -> command);
+    journal_state(node -> inst -> num, node -> pid, node -> status, node -> exitCode);
+}
 
-    //Reaps all current background processes
-    //Also decects process status change, suspend or resume.
-    while((pid = waitpid(-1, &child_status, WNOHANG | WUNTRACED | WCONTINUED)) > 0){
-        Process_Node* node = getPidNode(pid);  //Get the node from pid
+/* Records the end of a scheduled run. */
+void endRun(Process_Node *node){
+    Run_Record *run = &node -> runs[node -> numRuns % RUNS_KEPT];
+    run -> status = node -> status;
+    run -> exitCode = node -> status == LOG_STATE_KILLED ? 128 + SIGINT : node -> exitCode;
+    run -> duration = metrics_now() - node -> runStart;
+    node -> numRuns++;
+    node -> runStart = 0;
+}
 
-        //Error from waitpid results in -1 pid
-        if(node == NULL){
-            return;
+/* Records the end of a task in the waits on it, and flags those it ends
+ * for the main loop (finishWaits()). Purged tasks end with exit code -1. */
+void endWaits(Process_Node *node){
+    for(Wait_Link *link = node -> waiters; link != NULL; link = link -> next){
+        if(link -> ended){
+            continue;
         }
-        
-        //Checks for normal termination and stores exit code
-        if(WIFEXITED(child_status)){
-            node -> exitCode = WEXITSTATUS(child_status);
+        Wait *wait = link -> wait;
+        link -> ended = 1;
+        link -> exitCode = node -> status == LOG_STATE_KILLED ? 128 + SIGINT :
+                           node -> status == LOG_STATE_FINISHED ? node -> exitCode : -1;
+        wait -> left--;
+        if(wait -> first < 0){
+            wait -> first = link - wait -> links;
         }
-        
-        //Checks if child terminated by signal.
-        //If so, updates the node and displays status change to terminated by signal
-        if(WIFSIGNALED(child_status)){
-            if(WTERMSIG(child_status) == SIGINT){
-                node -> status = LOG_STATE_KILLED;
-                log_kitc_status_change(node -> inst -> num, pid, node -> backGround, node -> command, LOG_TERM_SIG);
-                return;
-            }
+        if(wait -> any || wait -> left == 0){
+            wait -> due = 1;
+            waitsDue = 1;
         }
+    }
+}
 
-        //Checks if child stopped by signal.
-        //If so, updates the node and displays status change to stopped
-        else if(WIFSTOPPED(child_status)){
-            if(WSTOPSIG(child_status) == SIGTSTP){
-                node -> status = LOG_STATE_SUSPENDED;
-                log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_SUSPEND);
-                return;
-            }
-        }
+/* Sets the status of a task and publishes it. */
+void setStatus(Process_Node *node, int status){
+    trace_probe(state, node -> inst -> num, node -> pid, node -> status, status, metrics_now());
+    node -> status = status;
+    if((status == LOG_STATE_FINISHED || status == LOG_STATE_KILLED) && node -> runStart){
+        endRun(node);
+    }
+    //Whatever started the run that ended, even exec or bg by hand, what is
+    //queued behind it can go now
+    if((status == LOG_STATE_FINISHED || status == LOG_STATE_KILLED) &&
+       ((node -> schedule != NULL && node -> schedule -> queued) || (node -> watch != NULL && node -> watch -> pending))){
+        runsDue = 1;
+    }
+    if((status == LOG_STATE_FINISHED || status == LOG_STATE_KILLED) && node -> waiters != NULL){
+        endWaits(node);
+    }
+    publishNode(node);
+}
 
-        //Checks if child is being resumed by signal.
-        //If so, updates the node and displays status change to running
-        else if(WIFCONTINUED(child_status)){
-            node -> status = LOG_STATE_RUNNING;
-            log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_RESUME);
-            return;
-        }
-        node -> status = LOG_STATE_FINISHED;
-        log_kitc_status_change(node -> inst -> num, pid, LOG_BG, node -> command, LOG_TERM);
+/* Closes the files openRedirects() opened, once the task has them. */
+void closeRedirects(Process_Node *eNode);
+
+/* Empties the pool slot of a helper that exited before taking a task.
+ * Returns 1 if pid was an idle helper and 0 otherwise. */
+int helperExited(pid_t pid);
+
+/* Ends a chain whose due step could not be launched at all. */
+void failStep(Process_Node *node);
+
+/* Records the end of the running step of a chain, for the reapers.
+ * The next step is found from the operators and the exit code so far,
+ * skipping those that do not apply as a shell would, and left due for the
+ * main loop (or the foreground wait) to launch. A signal ends the chain.
+ * Returns 1 if the chain goes on, and 0 if the task ends or is no chain. */
+int endStep(Process_Node *node, int child_status){
+    if(node -> steps == NULL){
+        return 0;
     }
-    
+    Chain_Step *step = &node -> steps[node -> step];
+    step -> end = metrics_now();
+    if(WIFEXITED(child_status)){
+        step -> status = LOG_STATE_FINISHED;
+        step -> exitCode = WEXITSTATUS(child_status);
+    }
+    else{
+        step -> status = LOG_STATE_KILLED;
+        step -> exitCode = 128 + WTERMSIG(child_status);
+    }
+    node -> exitCode = step -> exitCode;
+
+    int next = node -> step + 1;
+    while(next < node -> numSteps &&
+          ((node -> steps[next].op == CHAIN_AND && step -> exitCode != 0) ||
+           (node -> steps[next].op == CHAIN_OR && step -> exitCode == 0))){
+        next++;
+    }
+    if(step -> status == LOG_STATE_KILLED || next == node -> numSteps){
+        numChains--;
+        closeRedirects(node);
+        return 0;
+    }
+    node -> step = next;
+    node -> stepDue = 1;
+    chainsDue = 1;
+    return 1;
 }
 
-/* Child handler primarily for foreground processes.
- * Uses pid of reaped child to find the node of the process.
- * Also handles child status change from signals. */
-void fg_handler(int sig){
-    
-    int child_status;   //Child exit status information
-    //Reaps dead child and detects process change 
-    pid_t pid = waitpid(-1, &child_status, WUNTRACED | WNOHANG);  
-    Process_Node *node = getPidNode(pid);
+/* Records what a run that ended used, for the main loop to learn
+ * (learnUsage()). Chains are left out: their steps are different commands. */
+void noteUsage(Process_Node *node, int child_status, struct rusage *usage){
+    if((!WIFEXITED(child_status) && !WIFSIGNALED(child_status)) || node -> launchedAt == 0){
+        return;
+    }
+    double wall = (metrics_now() - node -> launchedAt) / 1e9;
+    double cpu = usage -> ru_utime.tv_sec + usage -> ru_stime.tv_sec +
+                 (usage -> ru_utime.tv_usec + usage -> ru_stime.tv_usec) / 1e6;
+    node -> launchedAt = 0;
+    if(wall <= 0 || (cpu == 0 && usage -> ru_maxrss == 0)){
+        return;
+    }
+    node -> usedCores = cpu / wall;
+    node -> usedRssKb = usage -> ru_maxrss;
+    node -> usageDue = 1;
+    usageDue = 1;
+}
 
-    if(node == NULL){
+/* Records a change of state of a background task's child, reaped by any
+ * of the handlers: its end, suspension or resumption. */
+void bgReaped(Process_Node *node, pid_t pid, int child_status){
+    //Checks for normal termination and stores exit code
+    if(WIFEXITED(child_status)){
+        node -> exitCode = WEXITSTATUS(child_status);
+    }
+
+    //A chain goes on to its next step rather than finishing
+    if((WIFEXITED(child_status) || WIFSIGNALED(child_status)) && endStep(node, child_status)){
         return;
     }
 
@@ -122,7 +535,7 @@ void fg_handler(int sig){
     //If so, updates the node and displays status change to terminated by signal
     if(WIFSIGNALED(child_status)){
         if(WTERMSIG(child_status) == SIGINT){
-            node -> status = LOG_STATE_KILLED;
+            setStatus(node, LOG_STATE_KILLED);
             log_kitc_status_change(node -> inst -> num, pid, node -> backGround, node -> command, LOG_TERM_SIG);
             return;
         }
@@ -132,42 +545,170 @@ void fg_handler(int sig){
     //If so, updates the node and displays status change to stopped
     else if(WIFSTOPPED(child_status)){
         if(WSTOPSIG(child_status) == SIGTSTP){
-            node -> status = LOG_STATE_SUSPENDED;
+            setStatus(node, LOG_STATE_SUSPENDED);
             log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_SUSPEND);
-            return;
         }
+        return;
     }
-    if(WIFEXITED(child_status)){
-        node -> exitCode = WEXITSTATUS(child_status);
-        node -> status = LOG_STATE_FINISHED;
-        log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_TERM);
+
+    //Checks if child is being resumed by signal.
+    //If so, updates the node and displays status change to running
+    else if(WIFCONTINUED(child_status)){
+        setStatus(node, LOG_STATE_RUNNING);
+        log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_RESUME);
         return;
     }
-    log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_TERM);
-    node -> status = LOG_STATE_FINISHED;
+    setStatus(node, LOG_STATE_FINISHED);
+    log_kitc_status_change(node -> inst -> num, pid, LOG_BG, node -> command, LOG_TERM);
 }
 
-void pipe_handler(int sig){
+/* Reaping for bg_handler, primarily for background processes.
+ * Uses pid of reaped child to find the node of the process.
+ * Also handles SIGINT, SIGTSTP, and SIGCONT */
+void bgReap(){
     pid_t pid;  //Pid of process
     int child_status;  //Child exit status information
+    struct rusage usage;  //Resources used by a child that ended
 
-    while((pid = waitpid(-1, &child_status, WNOHANG | WUNTRACED | WCONTINUED)) > 0){
+    //Reaps all current background processes
+    //Also decects process status change, suspend or resume.
+    while((pid = procBackend -> reap(-1, &child_status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0){
+        long reapStart = metrics_now();  //Reaped, for the time to find its task
         Process_Node* node = getPidNode(pid);  //Get the node from pid
 
-        //Error from waitpid results in -1 pid
+        //Pool helpers (and helpers of pools since removed) are no tasks
         if(node == NULL){
-            return;
+            helperExited(pid);
+            continue;
+        }
+        metrics_count(METRIC_REAPS, 1);
+        metrics_observe(METRIC_REAP_LOOKUP, metrics_now() - reapStart);
+        trace_probe(reap, node -> inst -> num, pid, child_status, metrics_now());
+        noteUsage(node, child_status, &usage);
+        bgReaped(node, pid, child_status);
+    }
+    
+}
+
+/* Reaping for fg_handler, primarily for foreground processes.
+ * Uses pid of reaped child to find the node of the process.
+ * Also handles child status change from signals. */
+void fgReap(){
+    pid_t pid;  //Pid of process
+    int child_status;   //Child exit status information
+    struct rusage usage;  //Resources used by a child that ended
+    //Reaps dead children and detects process change
+    //One SIGCHLD can stand for several children, so reap until none is left
+    while((pid = procBackend -> reap(-1, &child_status, WUNTRACED | WCONTINUED | WNOHANG, &usage)) > 0){
+        long reapStart = metrics_now();  //Reaped, for the time to find its task
+        Process_Node *node = getPidNode(pid);
+
+        //Pool helpers (and helpers of pools since removed) are no tasks
+        if(node == NULL){
+            helperExited(pid);
+            continue;
+        }
+        metrics_count(METRIC_REAPS, 1);
+        metrics_observe(METRIC_REAP_LOOKUP, metrics_now() - reapStart);
+        trace_probe(reap, node -> inst -> num, pid, child_status, metrics_now());
+        noteUsage(node, child_status, &usage);
+
+        //Only the foreground task (and its chain's steps) is waited for
+        //here; background tasks that change meanwhile are theirs
+        if(node -> inst -> num != currentTaskNum){
+            bgReaped(node, pid, child_status);
+            continue;
+        }
+        if(WIFCONTINUED(child_status)){
+            continue;
+        }
+
+        //A chain goes on to its next step rather than finishing
+        if((WIFEXITED(child_status) || WIFSIGNALED(child_status)) && endStep(node, child_status)){
+            continue;
+        }
+
+        //Checks if child terminated by signal.
+        //If so, updates the node and displays status change to terminated by signal
+        if(WIFSIGNALED(child_status)){
+            if(WTERMSIG(child_status) == SIGINT){
+                setStatus(node, LOG_STATE_KILLED);
+                log_kitc_status_change(node -> inst -> num, pid, node -> backGround, node -> command, LOG_TERM_SIG);
+                continue;
+            }
+        }
+
+        //Checks if child stopped by signal.
+        //If so, updates the node and displays status change to stopped
+        else if(WIFSTOPPED(child_status)){
+            if(WSTOPSIG(child_status) == SIGTSTP){
+                setStatus(node, LOG_STATE_SUSPENDED);
+                log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_SUSPEND);
+                continue;
+            }
+        }
+        if(WIFEXITED(child_status)){
+            node -> exitCode = WEXITSTATUS(child_status);
+            setStatus(node, LOG_STATE_FINISHED);
+            log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_TERM);
+            continue;
+        }
+        log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_TERM);
+        setStatus(node, LOG_STATE_FINISHED);
+    }
+}
+
+/* Reaping for pipe_handler. */
+void pipeReap(){
+    pid_t pid;  //Pid of process
+    int child_status;  //Child exit status information
+
+    while((pid = procBackend -> reap(-1, &child_status, WNOHANG | WUNTRACED | WCONTINUED, NULL)) > 0){
+        long reapStart = metrics_now();  //Reaped, for the time to find its task
+        Process_Node* node = getPidNode(pid);  //Get the node from pid
+
+        //Pool helpers (and helpers of pools since removed) are no tasks
+        if(node == NULL){
+            helperExited(pid);
+            continue;
         }
+        metrics_count(METRIC_REAPS, 1);
+        metrics_observe(METRIC_REAP_LOOKUP, metrics_now() - reapStart);
+        trace_probe(reap, node -> inst -> num, pid, child_status, metrics_now());
 
-        node -> status = LOG_STATE_FINISHED;
+        setStatus(node, LOG_STATE_FINISHED);
         log_kitc_status_change(node -> inst -> num, pid, LOG_BG, node -> command, LOG_TERM);
     }
 }
 
+/* SIGCHLD handlers. Each keeps errno intact around its reaping, since the
+ * final reap fails with ECHILD and main checks errno after reading stdin. */
+void bg_handler(int sig){
+    trace_probe(signal, sig, "bg", metrics_now());
+    int savedErrno = errno;
+    bgReap();
+    errno = savedErrno;
+}
+
+void fg_handler(int sig){
+    trace_probe(signal, sig, "fg", metrics_now());
+    int savedErrno = errno;
+    fgReap();
+    errno = savedErrno;
+}
+
+void pipe_handler(int sig){
+    trace_probe(signal, sig, "pipe", metrics_now());
+    int savedErrno = errno;
+    pipeReap();
+    errno = savedErrno;
+}
+
 /* Handles SIGINT and SIGTSTP from keyboard inputs(^C, ^Z).
  * Limited to foreground process.
  * Uses global variable currentTaskNum to get the node to send signals to. */
 void key_handler(int sig){
+    trace_probe(signal, sig, "key", metrics_now());
     //Gets the node from global var
     Process_Node *node = getTaskNode(currentTaskNum);
     //No current foreground process
@@ -220,10 +761,57 @@ int cpyInst(Instruction inst, Instruction *pInst){
     return 0;
 }
 
+/* Takes a task off the timer wheel, dropping its schedule. */
+void unschedule(Process_Node *node);
+
+/* Stops watching the files of a task. */
+void unwatch(Process_Node *node);
+
+/* Takes a task out of the launch queue. */
+void dropWaiting(Process_Node *node);
+
+/* If another command line is waiting, on stdin or from a client. */
+int inputWaiting();
+
+/* Lets go of the relay a task was run through, stopping it if it serves no
+ * other task still running or on its way from a launcher thread. */
+void dropRelay(Process_Node *node);
+
 /* Frees a node and the pointers within the node. */
 void freeNode(Process_Node *node){
+    if(node -> schedule != NULL){
+        unschedule(node);
+    }
+    if(node -> watch != NULL){
+        unwatch(node);
+    }
+    if(node -> throttled){
+        dropWaiting(node);
+        closeRedirects(node);
+    }
+    //A launch on its way is let go once it is back, and its files closed then
+    if(node -> launching != NULL){
+        node -> launching -> eNode = NULL;
+    }
+    if(node -> waiters != NULL){
+        node -> status = LOG_STATE_READY;
+        endWaits(node);
+    }
     free_instruction(node -> inst);
     free(node -> command);
+    if(node -> cacheOut != NULL){
+        free(node -> cacheOut);
+        numRecording--;
+    }
+    for(int i = 0; i < node -> numSteps; i++){
+        free(node -> steps[i].command);
+    }
+    free(node -> steps);
+    if(node -> adoptFd >= 0){
+        close(node -> adoptFd);
+        numAdopted--;
+    }
+    dropRelay(node);
     free(node);
 }
 
@@ -240,6 +828,70 @@ int newNode(Process_Node *new, Instruction *instruction, char *cmd){
     new -> status = LOG_STATE_READY;
     new -> next = NULL;
 
+    // Placement, inherited from the controller unless set by place
+    CPU_ZERO(&new -> cpuSet);
+    new -> hasCpuSet = 0;
+    new -> niceLevel = 0;
+    new -> hasNice = 0;
+    new -> schedPolicy = SCHED_OTHER;
+    new -> ioClass = 0;
+    new -> placedSlot = -1;
+
+    // Output cache, opt-in
+    new -> cached = 0;
+    new -> cacheKey[0] = '\0';
+    new -> cacheOut = NULL;
+
+    // Only restored tasks are adopted
+    new -> adoptFd = -1;
+
+    // Only tee and merge relay
+    new -> relayPid = 0;
+    new -> relayFd = -1;
+
+    // Redirections, set for one launch at a time
+    for(int i = 0; i < 3; i++){
+        new -> redirFds[i] = -1;
+    }
+    new -> outAppend = 0;
+    new -> errToOut = 0;
+
+    // A single command until parseChain() finds operators
+    new -> steps = NULL;
+    new -> numSteps = 0;
+    new -> step = 0;
+    new -> stepDue = 0;
+
+    // Unscheduled until every or at
+    new -> schedule = NULL;
+    new -> runStart = 0;
+    new -> numRuns = 0;
+
+    // Unwatched until watch
+    new -> watch = NULL;
+
+    // Launched without waiting until the limiter says otherwise
+    new -> throttled = 0;
+    new -> launching = NULL;
+    new -> spawnTries = 0;
+    new -> waitStart = 0;
+    new -> retryAt = 0;
+    new -> nextWaiting = NULL;
+    new -> shed = 0;
+
+    // Needs learned from past runs until place declares them
+    new -> needCores = -1;
+    new -> needMemKb = -1;
+    new -> waitCores = 0;
+    new -> waitMemKb = 0;
+    new -> launchedAt = 0;
+    new -> usedCores = 0;
+    new -> usedRssKb = 0;
+    new -> usageDue = 0;
+
+    // Waited for by no wait yet
+    new -> waiters = NULL;
+
     // Instruction
     new -> inst = instruction;
 
@@ -332,12 +984,13 @@ int purgeNode(int taskNum){
 
     //Head is the node to be purged
     if(head -> inst -> num == taskNum){
-        if(head -> status != LOG_STATE_RUNNING && head -> status != LOG_STATE_SUSPENDED){
+        int retStatus = head -> status;
+        if(retStatus != LOG_STATE_RUNNING && retStatus != LOG_STATE_SUSPENDED){
             Process_Node *temp = head;
             head = head -> next;
             freeNode(temp);
         }
-        return head -> status;
+        return retStatus;
     }
 
     Process_Node *current = head;
@@ -440,6 +1093,75 @@ int stringSplit(char *list[], char* string, char* delim){
     return 0;
 }
 
+/* Splits a command line into the steps of a chain at "&&", "||" and ";".
+ * A ";" may also end a word, and may end the line.
+ * Returns the number of steps with *steps allocated, 0 if cmd is a single
+ * command, or -1 if a step is empty. */
+int parseChain(const char *cmd, Chain_Step **steps){
+    char *words[MAXLINE];
+    char *cmdCopy = string_copy(cmd);
+    stringSplit(words, cmdCopy, " ");
+
+    int numWords = 0;
+    while(words[numWords] != NULL){
+        numWords++;
+    }
+    Chain_Step *found = calloc(numWords + 1, sizeof(Chain_Step));
+    char line[MAXLINE] = {0};
+    size_t len = 0;
+    int num = 0, op = CHAIN_SEQ, chained = 0, valid = 1;
+
+    for(int i = 0; i <= numWords && valid; i++){
+        char *word = words[i];
+        int ends = -1;  //Operator after the step, -1 if it goes on
+        if(word == NULL){
+            ends = CHAIN_SEQ;
+        }
+        else if(!strcmp(word, "&&")){ends = CHAIN_AND;}
+        else if(!strcmp(word, "||")){ends = CHAIN_OR;}
+        else if(!strcmp(word, ";")){ends = CHAIN_SEQ;}
+        else{
+            size_t wordLen = strlen(word);
+            if(wordLen > 1 && word[wordLen - 1] == ';'){
+                word[--wordLen] = '\0';
+                ends = CHAIN_SEQ;
+            }
+            len += snprintf(line + len, MAXLINE - len, "%s%s", len ? " " : "", word);
+        }
+        if(ends < 0){
+            continue;
+        }
+        chained |= word != NULL;
+
+        //Only the end of the line may follow a ";" with nothing
+        if(len == 0){
+            valid = word == NULL && num > 0 && op == CHAIN_SEQ;
+            break;
+        }
+        found[num].command = string_copy(line);
+        found[num].op = op;
+        num++;
+        op = ends;
+        len = 0;
+    }
+    free(cmdCopy);
+
+    if(!valid || !chained){
+        for(int i = 0; i < num; i++){
+            free(found[i].command);
+        }
+        free(found);
+        return valid ? 0 : -1;
+    }
+    *steps = found;
+    return num;
+}
+
+/* Command line the next launch of a task runs: its due step if it is a chain. */
+char* stepCommand(Process_Node *node){
+    return node -> steps != NULL ? node -> steps[node -> step].command : node -> command;
+}
+
 /* Finds the correct path to the file */
 void findPath(char *path, char *file){
     //Tests "./" location first
@@ -481,183 +1203,3099 @@ int handleExeErr(Process_Node *node, int taskNum){
     return 0;
 }
 
-/* Executes a command. 
- * Returns 0 on success, -1*/
-int execCmd(Process_Node *eNode, int BG, int pipefd[]){
+/* Parses a cpu list such as "0-3,8,10-11" into set.
+ * Returns 0 on success and -1 otherwise. */
+int parseCpuList(cpu_set_t *set, const char *list){
+    CPU_ZERO(set);
+    const char *p = list;
+    while(*p){
+        char *end;
+        long first = strtol(p, &end, 10);
+        if(end == p || first < 0 || first >= CPU_SETSIZE){
+            return -1;
+        }
+        long last = first;
+        p = end;
+
+        //Range of cpus
+        if(*p == '-'){
+            last = strtol(p + 1, &end, 10);
+            if(end == p + 1 || last < first || last >= CPU_SETSIZE){
+                return -1;
+            }
+            p = end;
+        }
+        for(long cpu = first; cpu <= last; cpu++){
+            CPU_SET(cpu, set);
+        }
 
-    Instruction *eInst = eNode -> inst;
+        //Lists read from sysfs end in a newline
+        if(*p == ','){
+            p++;
+        }
+        else if(*p == '\n'){
+            break;
+        }
+        else if(*p != '\0'){
+            return -1;
+        }
+    }
+    return CPU_COUNT(set) ? 0 : -1;
+}
 
-    //Splits the command attached to the instruction by " "
-    char *command[MAXARGS+1];
-    stringSplit(command, string_copy(eNode -> command), " ");
-    
-    actKey.sa_handler = key_handler;
+/* Reads a cpu list such as "0-3,8" from a sysfs file. Returns 0 on success
+ * and -1 otherwise. */
+int readCpuList(const char *path, cpu_set_t *set){
+    char list[4096] = {0};
+    FILE *file = fopen(path, "r");
+    if(file == NULL){
+        return -1;
+    }
+    int failed = fgets(list, sizeof(list), file) == NULL || parseCpuList(set, list);
+    fclose(file);
+    return failed ? -1 : 0;
+}
 
-    //Set up background specific elements of the process
-    //If background tast, use the bg_handler
-    if(BG){
-        actChild.sa_handler = bg_handler;
-        eNode -> backGround = LOG_BG;
-        
+/* Reads the cpus and NUMA layout used by the placement policy. Only the cpus
+ * in the controller's own affinity mask count, so tasks are never placed
+ * outside a cpuset or taskset it was started in. */
+void loadTopology(){
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed)){
+        CPU_ZERO(&allowed);
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for(int cpu = 0; cpu < online && cpu < CPU_SETSIZE; cpu++){
+            CPU_SET(cpu, &allowed);
+        }
     }
-    //Set up foreground specific elements of the process
-    //If foreground task and not using pipes, use fg_handler
-    else{
-        actChild.sa_handler = fg_handler;
-        currentTaskNum = eInst-> num;
-        eNode -> backGround = LOG_FG;
+    numCpus = 0;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+        if(CPU_ISSET(cpu, &allowed)){
+            usableCpus[numCpus++] = cpu;
+        }
     }
-
-    //Handler for if pipe
-    if(pipefd != NULL){
-        actChild.sa_handler = pipe_handler;
+    if(numCpus == 0){
+        usableCpus[numCpus++] = 0;
+        CPU_SET(0, &allowed);
     }
-    
-    //Assign handlers for signals
-    sigaction(SIGINT, &actKey, NULL);
-    sigaction(SIGTSTP, &actKey, NULL);
-    sigaction(SIGCHLD, &actChild, NULL);
 
+    //Each online NUMA node lists its cpus in sysfs; node ids can have gaps
+    numNumaNodes = 0;
+    cpu_set_t nodes;
+    if(readCpuList("/sys/devices/system/node/online", &nodes) == 0){
+        for(int i = 0; i < CPU_SETSIZE && numNumaNodes < MAXNUMA; i++){
+            char path[MAXLINE];
+            cpu_set_t cpus;
+            snprintf(path, MAXLINE, "/sys/devices/system/node/node%d/cpulist", i);
+            if(!CPU_ISSET(i, &nodes) || readCpuList(path, &cpus)){
+                continue;
+            }
+            //A node with none of our cpus is no place for a task
+            CPU_AND(&numaCpus[numNumaNodes], &cpus, &allowed);
+            if(CPU_COUNT(&numaCpus[numNumaNodes]) > 0){
+                numNumaNodes++;
+            }
+        }
+    }
 
-    //Display the current process as running 
-    log_kitc_status_change(eInst -> num, eNode -> pid, eNode -> backGround, eNode -> command, LOG_START);
-    eNode -> status = LOG_STATE_RUNNING;
+    //No NUMA information, treat the machine as one node
+    if(numNumaNodes == 0){
+        numaCpus[0] = allowed;
+        numNumaNodes = 1;
+    }
+}
 
-    //Fork process and store the child pid
-    pid_t child_pid = fork();
-    eNode -> pid = child_pid;
+/* Reads a memory size such as 512M, 2G or 64K (M if no unit) in KiB.
+ * Returns -1 if it is not one. */
+long parseMemKb(const char *value){
+    char *end;
+    double size = strtod(value, &end);
+    long unit = 1024;
+    if(*end == 'K' || *end == 'k'){unit = 1; end++;}
+    else if(*end == 'M' || *end == 'm'){unit = 1024; end++;}
+    else if(*end == 'G' || *end == 'g'){unit = 1024 * 1024; end++;}
+    if(end == value || *end || !(size >= 0) || size * unit > LONG_MAX / 2){
+        return -1;
+    }
+    return (long) (size * unit);
+}
 
-    if(!child_pid){
-        if(BG){
-            setpgid(0,0);
-        }
+/* Applies one place attribute (key=value) to a node.
+ * Returns 0 on success and -1 otherwise. */
+int setPlacement(Process_Node *node, char *attr){
+    char *value = strchr(attr, '=');
+    if(value == NULL){
+        return -1;
+    }
+    *value = '\0';
+    value++;
 
-        //Check if pipes used and setup the pipe redirection
-        if(pipefd != NULL){
-            //Background process is the writing side
-            if(eNode -> backGround){
-                //Close read end
-                close(pipefd[0]);
-                dup2(pipefd[1], STDOUT_FILENO); 
-            }
-            //Foreground process is the reading side
-            else{
-                dup2(pipefd[0], STDIN_FILENO);
-            }
+    if(!strcmp(attr, "cpus")){
+        if(parseCpuList(&node -> cpuSet, value)){
+            return -1;
         }
-
-        //If infile points to something
-        if(eInst -> infile){
-            int fdIn = open(eInst -> infile, O_RDONLY);     //Open file with read only
-            dup2(fdIn, STDIN_FILENO);   //Set the process's input to the file
+        node -> hasCpuSet = 1;
+    }
+    else if(!strcmp(attr, "nice")){
+        char *end;
+        long level = strtol(value, &end, 10);
+        if(end == value || *end || level < -20 || level > 19){
+            return -1;
         }
-
-        //if outfile points to something
-        if(eInst -> outfile){
-            //Opens the file with write only, create is file does not exist,
-            //and truncate if file already exists
-            int fdOut = open(eInst -> outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            dup2(fdOut, STDOUT_FILENO);     //Set the process's output to the file
+        node -> niceLevel = level;
+        node -> hasNice = 1;
+    }
+    else if(!strcmp(attr, "sched")){
+        if(!strcmp(value, "other")){node -> schedPolicy = SCHED_OTHER;}
+        else if(!strcmp(value, "batch")){node -> schedPolicy = SCHED_BATCH;}
+        else if(!strcmp(value, "idle")){node -> schedPolicy = SCHED_IDLE;}
+        else{return -1;}
+    }
+    else if(!strcmp(attr, "io")){
+        if(!strcmp(value, "be")){node -> ioClass = 2;}
+        else if(!strcmp(value, "idle")){node -> ioClass = 3;}
+        else{return -1;}
+    }
+    else if(!strcmp(attr, "cores")){
+        char *end;
+        double cores = strtod(value, &end);
+        if(end == value || *end || !(cores >= 0 && cores <= CPU_SETSIZE)){
+            return -1;
         }
-        //Create the proper path
-        char path[MAXLINE];
-        findPath(path, command[0]);
-        //Run the command
-        execv(path, command);
-        exit(0);
+        node -> needCores = cores;
     }
-
-    //Waits to reap process if it is a foreground process
-    if (!BG){
-        sleep(5);
-        if(waitpid(eNode -> pid, NULL, 0) != -1){
-            //Display process as terminated
-            log_kitc_status_change(eInst -> num, eNode -> pid, eNode -> backGround, eNode -> command, LOG_TERM);
-            eNode -> status = LOG_STATE_FINISHED;
+    else if(!strcmp(attr, "mem")){
+        long kb = parseMemKb(value);
+        if(kb < 0){
+            return -1;
         }
-        currentTaskNum = -1;
+        node -> needMemKb = kb;
+    }
+    else{
+        return -1;
     }
-
     return 0;
 }
 
-/* Handles the execution of commands with pipes. */
-void execPipe(int taskNum1, int taskNum2){
-
-    //Sets up node1 and node2
-    Process_Node *node1 = getTaskNode(taskNum1);
-    if(handleExeErr(node1, taskNum1)){
+/* Picks the least loaded cpu (spread) or NUMA node (numa) for a background task
+ * that has no cpus of its own. Load is the number of live background tasks
+ * already placed there. */
+void choosePlacement(Process_Node *node){
+    node -> placedSlot = -1;
+    if(placePolicy == PLACE_NONE || node -> hasCpuSet){
         return;
     }
-    Process_Node *node2 = getTaskNode(taskNum2);
-    if(handleExeErr(node2, taskNum2)){
-        return;
+
+    int slots = (placePolicy == PLACE_SPREAD) ? numCpus : numNumaNodes;
+    if(slots > CPU_SETSIZE){
+        slots = CPU_SETSIZE;
+    }
+    int load[slots];
+    memset(load, 0, sizeof(load));
+
+    //Count the live background tasks placed on each slot
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(current -> placedSlot < 0 || current -> placedSlot >= slots || current -> backGround != LOG_BG){
+            continue;
+        }
+        if(current -> status == LOG_STATE_RUNNING || current -> status == LOG_STATE_SUSPENDED){
+            load[current -> placedSlot]++;
+        }
+    }
+
+    int best = 0;
+    for(int i = 1; i < slots; i++){
+        if(load[i] < load[best]){
+            best = i;
+        }
+    }
+    node -> placedSlot = best;
+}
+
+/* Gets the cpus of a slot chosen by choosePlacement. */
+void slotCpus(int slot, cpu_set_t *set){
+    if(placePolicy == PLACE_NUMA){
+        *set = numaCpus[slot];
+    }
+    else{
+        CPU_ZERO(set);
+        CPU_SET(usableCpus[slot], set);
+    }
+}
+
+/* Applies the placement attributes of a node to the calling process.
+ * Called in the child before exec. Failures leave that attribute inherited. */
+void applyPlacement(Process_Node *node){
+    if(node -> hasCpuSet){
+        sched_setaffinity(0, sizeof(cpu_set_t), &node -> cpuSet);
+    }
+    else if(node -> placedSlot >= 0){
+        cpu_set_t set;
+        slotCpus(node -> placedSlot, &set);
+        sched_setaffinity(0, sizeof(cpu_set_t), &set);
+    }
+
+    if(node -> schedPolicy != SCHED_OTHER){
+        struct sched_param param = {0};
+        sched_setscheduler(0, node -> schedPolicy, &param);
+    }
+
+    //Nice after the policy since SCHED_IDLE ignores it anyway
+    if(node -> hasNice){
+        setpriority(PRIO_PROCESS, 0, node -> niceLevel);
+    }
+
+    if(node -> ioClass){
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, node -> ioClass << IOPRIO_CLASS_SHIFT);
+    }
+}
+
+/* Builds a short description of a node's placement for logging. */
+void describePlacement(Process_Node *node, char *buf, size_t size){
+    static const char *ioNames[] = {"none", "rt", "be", "idle"};
+    const char *sched = "other";
+    if(node -> schedPolicy == SCHED_BATCH){sched = "batch";}
+    else if(node -> schedPolicy == SCHED_IDLE){sched = "idle";}
+
+    int cpus = node -> hasCpuSet ? CPU_COUNT(&node -> cpuSet) : 0;
+    snprintf(buf, size, "cpus=%s%d nice=%d sched=%s io=%s",
+             cpus ? "" : "any/", cpus ? cpus : numCpus,
+             node -> hasNice ? node -> niceLevel : getpriority(PRIO_PROCESS, 0),
+             sched, ioNames[node -> ioClass & 3]);
+    if(node -> needCores >= 0){
+        snprintf(buf + strlen(buf), size - strlen(buf), " cores=%g", node -> needCores);
+    }
+    if(node -> needMemKb >= 0){
+        long kb = node -> needMemKb;
+        snprintf(buf + strlen(buf), size - strlen(buf), kb % 1024 ? " mem=%ldK" : " mem=%ldM", kb % 1024 ? kb : kb / 1024);
+    }
+}
+
+/* Waits in a pre-forked helper for one launch request from the controller,
+ * then becomes the task with fexecve() on the already opened executable, or
+ * by path for a #! script, whose interpreter cannot open the close-on-exec
+ * fd. Exits if the controller closes its end of the socket, and with 127
+ * if the task's stdio did not all arrive. */
+void poolHelper(int sock, int exeFd, const char *path){
+    //Terminal signals belong to the task, not the idle helper
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
+
+    Launch_Request req;
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do{
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    }while(n < 0 && errno == EINTR);
+    if(n != sizeof(req)){
+        exit(0);
+    }
+
+    //Stdin, stdout and stderr arrive as SCM_RIGHTS in the order given by targets;
+    //the task never runs with other stdio than it was given
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(req.errToOut){
+        dup2(STDOUT_FILENO, STDERR_FILENO);
+    }
+    if(req.numFds > 0){
+        if(cmsg == NULL || cmsg -> cmsg_type != SCM_RIGHTS || (msg.msg_flags & MSG_CTRUNC) ||
+           cmsg -> cmsg_len != CMSG_LEN(sizeof(int) * req.numFds)){
+            _exit(127);
+        }
+        int *fds = (int *) CMSG_DATA(cmsg);
+        for(int i = 0; i < req.numFds; i++){
+            if(dup2(fds[i], req.targets[i]) < 0){
+                _exit(127);
+            }
+        }
+    }
+
+    if(req.backGround){
+        setpgid(0,0);
+    }
+    applyPlacement(&req.place);
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+
+    char *command[MAXARGS+1];
+    stringSplit(command, req.command, " ");
+    extern char **environ;
+    metrics_observe(METRIC_SPAWN, metrics_now() - req.spawnStart);
+    trace_probe(exec, -1, getpid(), req.spawnStart, metrics_now());
+    fexecve(exeFd, command, environ);
+    if(errno == ENOENT){
+        execv(path, command);
+    }
+    exit(127);
+}
+
+/* Forks one helper into slot i of a pool.
+ * Returns 0 on success and -1 otherwise. */
+int spawnHelper(Warm_Pool *pool, int i){
+    int socks[2];
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, socks)){
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if(pid < 0){
+        close(socks[0]);
+        close(socks[1]);
+        return -1;
+    }
+
+    if(!pid){
+        control_child();
+        //Drop the controller's ends of every other helper so they see EOF
+        for(Warm_Pool *current = pools; current != NULL; current = current -> next){
+            for(int j = 0; j < current -> count; j++){
+                if(current -> socks[j] >= 0){
+                    close(current -> socks[j]);
+                }
+            }
+        }
+        close(socks[0]);
+        poolHelper(socks[1], pool -> exeFd, pool -> path);
+    }
+
+    close(socks[1]);
+    pool -> pids[i] = pid;
+    pool -> socks[i] = socks[0];
+    return 0;
+}
+
+/* Finds the pool that runs the given command name, or NULL if there is none. */
+Warm_Pool* getPool(const char *name){
+    for(Warm_Pool *current = pools; current != NULL; current = current -> next){
+        if(!strcmp(current -> name, name)){
+            return current;
+        }
+    }
+    return NULL;
+}
+
+/* Kills the helpers of a pool and frees it. */
+void freePool(Warm_Pool *pool){
+    for(int i = 0; i < pool -> count; i++){
+        if(pool -> pids[i] > 0){
+            kill(pool -> pids[i], SIGKILL);
+            close(pool -> socks[i]);
+        }
+    }
+    close(pool -> exeFd);
+    free(pool);
+}
+
+/* Removes the pool for a command name, if any. */
+void removePool(const char *name){
+    Warm_Pool **link = &pools;
+    while(*link != NULL){
+        if(!strcmp((*link) -> name, name)){
+            Warm_Pool *temp = *link;
+            *link = temp -> next;
+            freePool(temp);
+            return;
+        }
+        link = &(*link) -> next;
+    }
+}
+
+/* Frees every pool. */
+void freePools(){
+    while(pools != NULL){
+        Warm_Pool *temp = pools;
+        pools = pools -> next;
+        freePool(temp);
+    }
+}
+
+/* Creates (or resizes) the pool of helpers for the executable of a task.
+ * Returns 0 on success and -1 if the executable cannot be opened. */
+int setPool(Process_Node *node, int size){
+    char *command[MAXARGS+1];
+    char *cmdCopy = string_copy(node -> command);
+    stringSplit(command, cmdCopy, " ");
+
+    removePool(command[0]);
+    if(size <= 0){
+        free(cmdCopy);
+        return 0;
+    }
+    if(size > MAXPOOL){
+        size = MAXPOOL;
+    }
+
+    Warm_Pool *pool = malloc(sizeof(Warm_Pool));
+    snprintf(pool -> name, MAXLINE, "%s", command[0]);
+    findPath(pool -> path, command[0]);
+    free(cmdCopy);
+
+    pool -> exeFd = open(pool -> path, O_RDONLY | O_CLOEXEC);
+    if(pool -> exeFd < 0){
+        free(pool);
+        return -1;
+    }
+
+    pool -> count = size;
+    for(int i = 0; i < size; i++){
+        pool -> pids[i] = -1;
+        pool -> socks[i] = -1;
+    }
+    pool -> next = pools;
+    pools = pool;
+
+    for(int i = 0; i < size; i++){
+        spawnHelper(pool, i);
+    }
+    return 0;
+}
+
+int helperExited(pid_t pid){
+    for(Warm_Pool *current = pools; current != NULL; current = current -> next){
+        for(int i = 0; i < current -> count; i++){
+            if(current -> pids[i] == pid){
+                close(current -> socks[i]);
+                current -> pids[i] = -1;
+                current -> socks[i] = -1;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Refills empty helper slots. Called back at the prompt, off the launch path,
+ * where no pipe ends are open that a new helper could inherit. */
+void refillPools(){
+    for(Warm_Pool *current = pools; current != NULL; current = current -> next){
+        for(int i = 0; i < current -> count; i++){
+            if(current -> pids[i] < 0){
+                spawnHelper(current, i);
+            }
+        }
+    }
+}
+
+/* Launches a task through a warm helper instead of forking.
+ * The stdin/stdout/stderr the child would have set up are passed along.
+ * Returns the pid of the task, -1 if no helper could take it, and -2 with
+ * errno set if a redirected file it was given is not open, as the task
+ * would run with the wrong stdio. */
+pid_t poolLaunch(Process_Node *eNode, const char *name, int BG, int pipefd[]){
+    Warm_Pool *pool = getPool(name);
+    if(pool == NULL){
+        return -1;
+    }
+
+    //Any idle helper will do
+    int slot = -1;
+    for(int i = 0; i < pool -> count; i++){
+        if(pool -> pids[i] > 0){
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0){
+        return -1;
+    }
+
+    Launch_Request req;
+    memset(&req, 0, sizeof(req));
+    req.backGround = BG;
+    req.spawnStart = spawnStart;
+    req.place = *eNode;
+
+    //The helper forked before the policy may have changed, so send the cpus
+    if(!eNode -> hasCpuSet && eNode -> placedSlot >= 0){
+        slotCpus(eNode -> placedSlot, &req.place.cpuSet);
+        req.place.hasCpuSet = 1;
+    }
+    snprintf(req.command, MAXLINE, "%s", stepCommand(eNode));
+
+    //Same order as the fork path: pipe first, then files override it
+    int fds[3] = {-1, -1, -1};
+    if(pipefd != NULL){
+        fds[0] = pipefd[0];
+        fds[1] = pipefd[1];
+    }
+    for(int i = 0; i < 3; i++){
+        if(eNode -> redirFds[i] >= 0){
+            fds[i] = eNode -> redirFds[i];
+        }
+    }
+    //2>&1 named before any > FILE copies the stdout the task is given:
+    //the pipe here, or the helper's own
+    req.errToOut = eNode -> errToOut;
+    if(eNode -> errToOut && pipefd != NULL && pipefd[1] >= 0){
+        fds[2] = pipefd[1];
+        req.errToOut = 0;
+    }
+    if((eNode -> inst -> infile != NULL && eNode -> redirFds[STDIN_FILENO] < 0) ||
+       (eNode -> inst -> outfile != NULL && eNode -> redirFds[STDOUT_FILENO] < 0)){
+        errno = EBADF;
+        return -2;
+    }
+    for(int i = 0; i < 3; i++){
+        if(fds[i] >= 0 && fcntl(fds[i], F_GETFD) < 0){
+            return -2;
+        }
+    }
+
+    int send[3];
+    for(int i = 0; i < 3; i++){
+        if(fds[i] >= 0){
+            send[req.numFds] = fds[i];
+            req.targets[req.numFds] = i;
+            req.numFds++;
+        }
+    }
+
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if(req.numFds){
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * req.numFds);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg -> cmsg_level = SOL_SOCKET;
+        cmsg -> cmsg_type = SCM_RIGHTS;
+        cmsg -> cmsg_len = CMSG_LEN(sizeof(int) * req.numFds);
+        memcpy(CMSG_DATA(cmsg), send, sizeof(int) * req.numFds);
+    }
+
+    //The helper becomes the task, so its pid is the task's pid
+    pid_t pid = pool -> pids[slot];
+    eNode -> pid = pid;
+    ssize_t n = sendmsg(pool -> socks[slot], &msg, MSG_NOSIGNAL);
+
+    close(pool -> socks[slot]);
+    pool -> pids[slot] = -1;
+    pool -> socks[slot] = -1;
+
+    if(n != sizeof(req)){
+        eNode -> pid = 0;
+        return -1;
+    }
+    return pid;
+}
+
+/* Records the output of cached tasks that have finished since the last prompt,
+ * or the last lookup. */
+void storeCached(){
+    for(Process_Node *current = head; current != NULL && numRecording > 0; current = current -> next){
+        if(current -> cacheOut == NULL){
+            continue;
+        }
+        if(current -> status == LOG_STATE_FINISHED){
+            cache_store(current -> cacheKey, current -> cacheOut, current -> exitCode);
+        }
+        else if(current -> status != LOG_STATE_KILLED){
+            continue;
+        }
+        free(current -> cacheOut);
+        current -> cacheOut = NULL;
+        numRecording--;
+    }
+}
+
+/* Restores the output of a cached run of a task instead of running it.
+ * Only tasks with caching on, a truncated output file, no pipe and no chain are looked up.
+ * On a miss the key is kept so storeCached() can record the run.
+ * A hit is logged like a run that ended, as a foreground or background task.
+ * Returns 1 if the output was restored and 0 if the task must run. */
+int cacheRestore(Process_Node *eNode, char *name, int BG, int pipefd[]){
+    Instruction *eInst = eNode -> inst;
+    if(!eNode -> cached || pipefd != NULL || eInst -> outfile == NULL || eNode -> outAppend || eNode -> steps != NULL){
+        return 0;
+    }
+
+    //Runs that ended since the last prompt are stored first, so a script
+    //that runs a task again right after it ended finds it
+    blockSig(0);
+    storeCached();
+    blockSig(1);
+
+    char path[MAXLINE];
+    findPath(path, name);
+    if(cache_key(path, eNode -> command, eInst -> infile, eNode -> cacheKey)){
+        return 0;
+    }
+
+    int exitCode;
+    if(cache_lookup(eNode -> cacheKey, eInst -> outfile, &exitCode) == 1){
+        eNode -> exitCode = exitCode;
+        eNode -> backGround = BG ? LOG_BG : LOG_FG;
+        setStatus(eNode, LOG_STATE_FINISHED);
+        log_kitc_cache_hit(eInst -> num, eInst -> outfile, exitCode);
+        log_kitc_status_change(eInst -> num, eNode -> pid, eNode -> backGround, eNode -> command, LOG_TERM);
+        return 1;
+    }
+
+    if(eNode -> cacheOut == NULL){
+        numRecording++;
+    }
+    free(eNode -> cacheOut);
+    eNode -> cacheOut = string_copy(eInst -> outfile);
+    return 0;
+}
+
+/* If fd is one of the n in fds. */
+int inFds(int fds[], int n, int fd){
+    for(int i = 0; i < n; i++){
+        if(fds[i] == fd){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Closes the files openRedirects() opened, once the task has them. */
+void closeRedirects(Process_Node *eNode){
+    for(int i = 0; i < 3; i++){
+        if(eNode -> redirFds[i] >= 0){
+            close(eNode -> redirFds[i]);
+            eNode -> redirFds[i] = -1;
+        }
+    }
+    eNode -> outAppend = 0;
+    eNode -> errToOut = 0;
+}
+
+/* Opens the files an exec or bg command line redirects the task to:
+ * < FILE, > FILE, >> FILE (append), 2> FILE and 2>&1 (stderr follows stdout).
+ * They apply in order, as in the shell: 2>&1 > FILE leaves stderr on the
+ * stdout the task is launched with, > FILE 2>&1 sends both to FILE.
+ * Opening them here, before the launch, reports a bad file without a fork.
+ * > and 2> files are emptied only once all of them are open, so a bad path
+ * leaves every file as it was.
+ * Input files are read ahead sequentially so the task streams at disk speed.
+ * Returns 0 on success and -1, with the error logged and nothing left open, otherwise. */
+int openRedirects(Process_Node *eNode, char *eCommand[]){
+    Instruction *eInst = eNode -> inst;
+    int taskNum = eInst -> num;
+    int empty[MAXARGS];  //Fds of the files to empty, kept open until then
+    const char *emptyFiles[MAXARGS];
+    int numEmpty = 0;
+    const char *failed = NULL;
+
+    for(int i = 0; eCommand[i] != NULL; i++){
+        int target;
+        int flags;
+        if(!strcmp(eCommand[i], "2>&1")){
+            //Stderr goes where stdout goes so far: a file named before, or
+            //else the stdout the task is launched with
+            int out = eNode -> redirFds[STDOUT_FILENO];
+            if(eNode -> redirFds[STDERR_FILENO] >= 0 && !inFds(empty, numEmpty, eNode -> redirFds[STDERR_FILENO])){
+                close(eNode -> redirFds[STDERR_FILENO]);
+            }
+            eNode -> redirFds[STDERR_FILENO] = out >= 0 ? fcntl(out, F_DUPFD_CLOEXEC, 0) : -1;
+            eNode -> errToOut = out < 0;
+            continue;
+        }
+        else if(!strcmp(eCommand[i], "<")){
+            target = STDIN_FILENO;
+            flags = O_RDONLY;
+        }
+        else if(!strcmp(eCommand[i], ">")){
+            target = STDOUT_FILENO;
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+        }
+        else if(!strcmp(eCommand[i], ">>")){
+            target = STDOUT_FILENO;
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+        }
+        else if(!strcmp(eCommand[i], "2>")){
+            target = STDERR_FILENO;
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+        }
+        else{
+            continue;
+        }
+
+        const char *file = eCommand[++i];
+        int fd = file != NULL ? open(file, (flags & ~O_TRUNC) | O_CLOEXEC, 0644) : -1;
+        if(fd < 0){
+            failed = file != NULL ? file : "(none)";
+            break;
+        }
+        //A file named for the same stream before is replaced, but still emptied
+        if(eNode -> redirFds[target] >= 0 && !inFds(empty, numEmpty, eNode -> redirFds[target])){
+            close(eNode -> redirFds[target]);
+        }
+        eNode -> redirFds[target] = fd;
+        if(flags & O_TRUNC){
+            emptyFiles[numEmpty] = file;
+            empty[numEmpty++] = fd;
+        }
+
+        if(target == STDIN_FILENO){
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            posix_fadvise(fd, 0, READAHEAD, POSIX_FADV_WILLNEED);
+            free(eInst -> infile);
+            eInst -> infile = string_copy(file);
+            log_kitc_redir(taskNum, LOG_REDIR_IN, file);
+        }
+        else if(target == STDOUT_FILENO){
+            free(eInst -> outfile);
+            eInst -> outfile = string_copy(file);
+            eNode -> outAppend = (flags & O_APPEND) != 0;
+            log_kitc_redir(taskNum, LOG_REDIR_OUT, file);
+        }
+        else{
+            eNode -> errToOut = 0;
+            log_kitc_redir(taskNum, LOG_REDIR_ERR, file);
+        }
+    }
+
+    //Empty those that are regular files (not /dev/null, a fifo ...), then
+    //let go of the files replaced along the way
+    for(int i = 0; i < numEmpty; i++){
+        struct stat info;
+        if(failed == NULL && fstat(empty[i], &info) == 0 && S_ISREG(info.st_mode) && ftruncate(empty[i], 0)){
+            failed = emptyFiles[i];
+        }
+        if(!inFds(eNode -> redirFds, 3, empty[i])){
+            close(empty[i]);
+        }
+    }
+    if(failed != NULL){
+        log_kitc_file_error(taskNum, failed);
+        closeRedirects(eNode);
+        return -1;
+    }
+    return 0;
+}
+
+/* Adds fd to those the prompt waits on. Returns 0 on success and -1 otherwise. */
+int wakeOn(int fd){
+    if(wakeFd < 0){
+        wakeFd = epoll_create1(EPOLL_CLOEXEC);
+    }
+    struct epoll_event event = {EPOLLIN, {.fd = fd}};
+    if(wakeFd < 0 || (epoll_ctl(wakeFd, EPOLL_CTL_ADD, fd, &event) && errno != EEXIST)){
+        return -1;
+    }
+    return 0;
+}
+
+/* Adds the launch tokens earned since the last refill, up to the burst. */
+void refillTokens(){
+    long now = metrics_now();
+    launchTokens += (now - launchRefill) * launchRate / 1e9;
+    if(launchTokens > launchBurst){
+        launchTokens = launchBurst;
+    }
+    launchRefill = now;
+}
+
+/* Takes a launch token if one is left, or always with no limit.
+ * Returns 1 if one was taken and 0 otherwise. */
+int takeToken(){
+    if(launchRate <= 0){
+        return 1;
+    }
+    refillTokens();
+    if(launchTokens < 1){
+        return 0;
+    }
+    launchTokens--;
+    return 1;
+}
+
+/* When the next token comes, on the metrics_now() clock. */
+long nextToken(){
+    return launchRefill + (long) ((1 - launchTokens) * 1e9 / launchRate) + 1;
+}
+
+/* Sleeps for ns, through signals. */
+void pauseNs(long ns){
+    struct timespec pause = {ns / 1000000000L, ns % 1000000000L};
+    while(nanosleep(&pause, &pause) && errno == EINTR);
+}
+
+/* Cores and memory a run of a task needs, see below. */
+int taskNeeds(Process_Node *node, double *cores, long *memKb);
+
+/* Puts a task in the launch queue, at the front for a fork to retry, with
+ * its needs noted for packing. */
+void waitLaunch(Process_Node *node, int front){
+    node -> throttled = 1;
+    taskNeeds(node, &node -> waitCores, &node -> waitMemKb);
+    if(node -> waitStart == 0){
+        node -> waitStart = metrics_now();
+        metrics_count(METRIC_DEFERRED, 1);
+    }
+    if(front){
+        node -> nextWaiting = waitHead;
+        waitHead = node;
+        if(waitTail == NULL){
+            waitTail = node;
+        }
+    }
+    else{
+        node -> nextWaiting = NULL;
+        if(waitTail != NULL){
+            waitTail -> nextWaiting = node;
+        }
+        else{
+            waitHead = node;
+        }
+        waitTail = node;
+    }
+    numWaiting++;
+}
+
+void dropWaiting(Process_Node *node){
+    Process_Node **link = &waitHead;
+    Process_Node *prev = NULL;
+    while(*link != NULL && *link != node){
+        prev = *link;
+        link = &(*link) -> nextWaiting;
+    }
+    if(*link == NULL){
+        return;
+    }
+    *link = node -> nextWaiting;
+    if(waitTail == node){
+        waitTail = prev;
+    }
+    node -> nextWaiting = NULL;
+    node -> throttled = 0;
+    numWaiting--;
+}
+
+/* Cores and memory a run of a task needs: as place declared them, else as
+ * learned from past runs of its command, else one core and no memory.
+ * Returns NEEDS_DECLARED, NEEDS_LEARNED or NEEDS_GUESSED. */
+int taskNeeds(Process_Node *node, double *cores, long *memKb){
+    *cores = 1;
+    *memKb = 0;
+    int source = usage_estimate(node -> command, cores, memKb) ? NEEDS_LEARNED : NEEDS_GUESSED;
+    if(node -> needCores >= 0){
+        *cores = node -> needCores;
+        source = NEEDS_DECLARED;
+    }
+    if(node -> needMemKb >= 0){
+        *memKb = node -> needMemKb;
+        source = NEEDS_DECLARED;
+    }
+    return source;
+}
+
+/* Adds up the needs of the tasks running, and the memory of those suspended. */
+void packUsed(double *cores, long *memKb){
+    *cores = 0;
+    *memKb = 0;
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        //A launch on a launcher thread runs soon
+        if(current -> launching != NULL ||
+           (current -> pid > 0 && (current -> status == LOG_STATE_RUNNING || current -> status == LOG_STATE_SUSPENDED))){
+            double c;
+            long m;
+            taskNeeds(current, &c, &m);
+            *cores += current -> status != LOG_STATE_SUSPENDED ? c : 0;
+            *memKb += m;
+        }
+    }
+}
+
+/* If a task fits in the room running tasks leave. One too big for the
+ * whole machine fits once nothing else runs. */
+int packFits(double cores, long memKb, double usedCores, long usedMemKb){
+    return (usedCores + cores <= packCores + 1e-6 && (packMemKb <= 0 || usedMemKb + memKb <= packMemKb)) ||
+           (usedCores == 0 && usedMemKb == 0);
+}
+
+/* If a background launch made now would fit, when packing. */
+int packRoom(Process_Node *node){
+    double cores, usedCores;
+    long memKb, usedMemKb;
+    taskNeeds(node, &cores, &memKb);
+    packUsed(&usedCores, &usedMemKb);
+    return packFits(cores, memKb, usedCores, usedMemKb);
+}
+
+/* Picks the waiting launch to go next when packing, NULL if none can.
+ * Launches that have waited PACK_AGE go first, smallest first, and while
+ * the oldest does not fit none goes, so room comes free for it; otherwise
+ * the one that fills most of the room left goes (best fit). A fork retry
+ * not yet due is passed over, and the earliest due put in retryAt.
+ * Needs are those launchWaiting() noted on the waiting nodes. */
+Process_Node *packNext(double usedCores, long usedMemKb, long *retryAt){
+    long now = metrics_now();
+    Process_Node *best = NULL;
+    Process_Node *aged = NULL;
+    double bestSize = -1;
+    double agedSize = 0;
+    *retryAt = 0;
+    for(Process_Node *node = waitHead; node != NULL; node = node -> nextWaiting){
+        if(node -> retryAt > now){
+            if(*retryAt == 0 || node -> retryAt < *retryAt){
+                *retryAt = node -> retryAt;
+            }
+            continue;
+        }
+        double size = node -> waitCores / packCores + (packMemKb > 0 ? (double) node -> waitMemKb / packMemKb : 0);
+        int fits = packFits(node -> waitCores, node -> waitMemKb, usedCores, usedMemKb);
+        if(now - node -> waitStart >= PACK_AGE){
+            if(node == waitHead && !fits){
+                return NULL;
+            }
+            if(fits && (aged == NULL || size < agedSize)){
+                aged = node;
+                agedSize = size;
+            }
+        }
+        else if(fits && size > bestSize){
+            best = node;
+            bestSize = size;
+        }
+    }
+    return aged != NULL ? aged : best;
+}
+
+/* Memory available for new tasks, from /proc/meminfo, in KiB (0 if unknown). */
+long availableMemKb(){
+    FILE *meminfo = fopen("/proc/meminfo", "r");
+    char line[MAXLINE];
+    long kb = 0;
+    while(meminfo != NULL && fgets(line, sizeof(line), meminfo) != NULL){
+        if(sscanf(line, "MemAvailable: %ld kB", &kb) == 1){
+            break;
+        }
+    }
+    if(meminfo != NULL){
+        fclose(meminfo);
+    }
+    return kb;
+}
+
+/* Learns the use of the runs the reapers have noted since the last call. */
+void learnUsage(){
+    if(!usageDue){
+        return;
+    }
+    blockSig(0);
+    usageDue = 0;
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(current -> usageDue){
+            current -> usageDue = 0;
+            usage_record(current -> command, current -> usedCores, current -> usedRssKb);
+        }
+    }
+    blockSig(1);
+}
+
+/* Ends a launch whose forks kept failing. A step of a chain under way fails
+ * as a command that cannot be run would (exit code 127), and the chain goes
+ * on from there; any other task is left as it was. Called with SIGCHLD blocked.
+ * Returns 0 if a chain went on or ended, and -1 otherwise. */
+int spawnFailed(Process_Node *eNode){
+    metrics_count(METRIC_SPAWN_FAILURES, 1);
+    if(eNode -> steps == NULL || eNode -> status != LOG_STATE_RUNNING){
+        return -1;
+    }
+    if(!endStep(eNode, W_EXITCODE(127, 0))){
+        setStatus(eNode, LOG_STATE_FINISHED);
+        log_kitc_status_change(eNode -> inst -> num, eNode -> pid, eNode -> backGround, eNode -> command, LOG_TERM);
+    }
+    return 0;
+}
+
+/* Sets up and runs a task in a freshly forked child, or one sharing the
+ * memory of a launcher thread until it execs. Does not return.
+ * The controller has threads, and a launcher's child shares its memory, so
+ * nothing here may take a lock or touch the heap. What runs is system
+ * calls on the child itself (control_child() and the pipe and file
+ * dup2()s, sigprocmask() in blockSig(), setpgid(), and in applyPlacement()
+ * sched_setaffinity(), sched_setscheduler(), setpriority() and ioprio_set;
+ * a launcher's child gets its cpus already worked out, see submitLaunch()),
+ * clock_gettime() in metrics_now(), metrics_observe(), which only does
+ * atomic adds on the shared metrics segment, and execv() on the path
+ * findPath() found before the fork. */
+void childExec(void *arg){
+    Child_Args *args = arg;
+    Process_Node *eNode = args -> eNode;
+    int BG = args -> BG;
+    int *pipefd = args -> pipefd;
+    char **command = args -> command;
+
+    control_child();
+    blockSig(1);
+    if(BG){
+        setpgid(0,0);
+    }
+    applyPlacement(eNode);
+
+    //Check if pipes used and setup the pipe redirection
+    //Pipes are close-on-exec, so only the ends the task uses stay open
+    if(pipefd != NULL){
+        if(pipefd[0] >= 0){
+            dup2(pipefd[0], STDIN_FILENO);
+        }
+        if(pipefd[1] >= 0){
+            dup2(pipefd[1], STDOUT_FILENO);
+        }
+    }
+
+    //2>&1 named before any > FILE copies this stdout
+    if(eNode -> errToOut){
+        dup2(STDOUT_FILENO, STDERR_FILENO);
+    }
+
+    //Redirected files, already opened by the controller, override the pipe
+    for(int i = 0; i < 3; i++){
+        if(eNode -> redirFds[i] >= 0){
+            dup2(eNode -> redirFds[i], i);
+        }
+    }
+    //Run the command
+    metrics_observe(METRIC_SPAWN, metrics_now() - args -> spawnStart);
+    trace_probe(exec, args -> taskNum, getpid(), args -> spawnStart, metrics_now());
+    execv(args -> path, command);
+    _exit(127);
+}
+
+/* Counts a fork refused for want of processes or memory, and returns the
+ * backoff before the next try, doubled with each try up to the last. */
+long spawnBackoff(Process_Node *eNode){
+    metrics_count(METRIC_SPAWN_RETRIES, 1);
+    long backoff = SPAWN_BACKOFF << (eNode -> spawnTries < SPAWN_TRIES - 1 ? eNode -> spawnTries : SPAWN_TRIES - 1);
+    eNode -> spawnTries++;
+    return backoff;
+}
+
+/* Records the end of a launch begun at start: the task runs as child_pid,
+ * or, if it is -1, could not be spawned (see spawnFailed()).
+ * Returns 0 on success and -1 otherwise. */
+int launchDone(Process_Node *eNode, pid_t child_pid, long start){
+    eNode -> spawnTries = 0;
+    eNode -> retryAt = 0;
+    eNode -> waitStart = 0;
+    if(child_pid < 0){
+        return spawnFailed(eNode);
+    }
+    trace_probe(fork, eNode -> inst -> num, child_pid, start, metrics_now());
+
+    //Display the current process as running, once for all the steps of a chain
+    if(eNode -> status != LOG_STATE_RUNNING){
+        log_kitc_status_change(eNode -> inst -> num, child_pid, eNode -> backGround, eNode -> command, LOG_START);
+        trace_probe(state, eNode -> inst -> num, child_pid, eNode -> status, LOG_STATE_RUNNING, metrics_now());
+    }
+    eNode -> status = LOG_STATE_RUNNING;
+    eNode -> pid = child_pid;
+    eNode -> launchedAt = eNode -> steps == NULL ? start : 0;
+    if(eNode -> steps != NULL){
+        Chain_Step *step = &eNode -> steps[eNode -> step];
+        step -> pid = child_pid;
+        step -> status = LOG_STATE_RUNNING;
+        step -> start = start;
+    }
+    publishNode(eNode);
+    metrics_count(METRIC_SPAWNS, 1);
+    return 0;
+}
+
+/* Hands a background launch to a launcher thread, with pipe ends as for
+ * execCmd(). It comes back through finishLaunches(), which closes the
+ * copies of the pipe ends it keeps until then, so the caller can close its
+ * own right away. */
+void submitLaunch(Process_Node *eNode, int pipefd[]){
+    Launch *launch = malloc(sizeof(Launch));
+    for(int i = 0; i < 2; i++){
+        launch -> pipefd[i] = pipefd != NULL && pipefd[i] >= 0 ? fcntl(pipefd[i], F_DUPFD_CLOEXEC, 0) : -1;
+    }
+    launch -> node = *eNode;
+    launch -> eNode = eNode;
+    //The placement policy may change before the child runs, so send the cpus
+    if(!eNode -> hasCpuSet && eNode -> placedSlot >= 0){
+        slotCpus(eNode -> placedSlot, &launch -> node.cpuSet);
+        launch -> node.hasCpuSet = 1;
+    }
+    launch -> cmdCopy = string_copy(stepCommand(eNode));
+    stringSplit(launch -> command, launch -> cmdCopy, " ");
+    launch -> args = (Child_Args) {&launch -> node, eNode -> inst -> num, LOG_BG, pipefd != NULL ? launch -> pipefd : NULL,
+                                   launch -> command, spawnStart, ""};
+    findPath(launch -> args.path, launch -> command[0]);
+    launch -> job.child = childExec;
+    launch -> job.arg = &launch -> args;
+    eNode -> launching = launch;
+    numLaunching++;
+    launcher_submit(&launch -> job);
+}
+
+/* Takes the launches the launcher threads are done with: each task runs,
+ * or goes back to the front of the launch queue if its fork was refused
+ * for want of processes or memory, or fails to launch. A launch with pipe
+ * ends cannot wait in the queue without them, so a refused fork fails it.
+ * A task purged meanwhile has its child killed. */
+void finishLaunches(){
+    uint64_t count;
+    if(numLaunching == 0 || read(launcher_fd(), &count, sizeof(count)) < 0){
+        return;
+    }
+    blockSig(0);
+    launch_job *job;
+    while((job = launcher_done()) != NULL){
+        Launch *launch = (Launch *) job;
+        Process_Node *eNode = launch -> eNode;
+        numLaunching--;
+        if(eNode == NULL){
+            if(job -> pid > 0){
+                kill(job -> pid, SIGKILL);
+            }
+            closeRedirects(&launch -> node);
+        }
+        else{
+            eNode -> launching = NULL;
+            int firstStep = eNode -> steps != NULL && eNode -> status != LOG_STATE_RUNNING;
+            if(job -> pid < 0 && (job -> err == EAGAIN || job -> err == ENOMEM) && launch -> args.pipefd == NULL){
+                eNode -> retryAt = metrics_now() + spawnBackoff(eNode);
+                waitLaunch(eNode, 1);
+            }
+            else if(launchDone(eNode, job -> pid, launch -> args.spawnStart)){
+                numChains -= firstStep;
+                eNode -> runStart = 0;
+                log_kitc_exec_error(eNode -> command);
+                //Nothing will end it now
+                endWaits(eNode);
+            }
+            //The files given to bg stayed open for the launch
+            if(!eNode -> throttled &&
+               (eNode -> steps == NULL || (eNode -> status != LOG_STATE_RUNNING && eNode -> status != LOG_STATE_SUSPENDED))){
+                closeRedirects(eNode);
+            }
+        }
+        for(int i = 0; i < 2; i++){
+            if(launch -> pipefd[i] >= 0){
+                close(launch -> pipefd[i]);
+            }
+        }
+        free(launch -> cmdCopy);
+        free(launch);
+    }
+    blockSig(1);
+}
+
+/* Stops the launcher threads and takes the launches they spawned. Their
+ * children are the main thread's to reap from then on, so SIGCHLD stays
+ * blocked until every launch is taken and each child's pid is known. */
+void stopLaunchers(){
+    blockSig(0);
+    launcher_stop();
+    finishLaunches();
+    blockSig(1);
+}
+
+/* Waits in the foreground wait for a signal, taking the launches the
+ * launcher threads finish meanwhile, e.g. the writer of a pipe read by the
+ * foreground task. Called with SIGCHLD blocked, which it lets in. */
+void foregroundIdle(){
+    if(numLaunching == 0 || procBackend != &os_backend){
+        procBackend -> idle(5);
+        return;
+    }
+    sigset_t mask;
+    sigprocmask(SIG_BLOCK, NULL, &mask);
+    sigdelset(&mask, SIGCHLD);
+    struct pollfd done = {launcher_fd(), POLLIN, 0};
+    struct timespec limit = {5, 0};
+    if(ppoll(&done, 1, &limit, &mask) > 0){
+        finishLaunches();
+        blockSig(0);
+    }
+}
+
+/* Executes a command. pipefd, if not NULL, holds pipe ends to use as the
+ * task's stdin and stdout, -1 for either one to leave it alone.
+ * Returns 0 on success, -1*/
+int execCmd(Process_Node *eNode, int BG, int pipefd[]){
+
+    Instruction *eInst = eNode -> inst;
+
+    //Already on its way from a launcher thread
+    if(eNode -> launching != NULL){
+        return 0;
+    }
+
+    //Splits the command attached to the instruction, or the due step of a chain, by " "
+    char *command[MAXARGS+1];
+    stringSplit(command, string_copy(stepCommand(eNode)), " ");
+
+    if(cacheRestore(eNode, command[0], BG, pipefd)){
+        return 0;
+    }
+
+    //Background launches take a token or wait their turn in the launch
+    //queue, launched later by launchWaiting(); the others wait for one here,
+    //so the controller reads nothing meanwhile (at most 1/RATE s). A
+    //foreground task holds the terminal until it ends anyway, and the two
+    //halves of a pipe must start together, so neither is queued
+    int queued = BG && pipefd == NULL;
+    if(eNode -> throttled){
+        if(queued){
+            return 0;
+        }
+        dropWaiting(eNode);
+    }
+    if(queued && !tokenHeld && (waitHead != NULL || pressured || (packCores > 0 && !packRoom(eNode)) || !takeToken())){
+        waitLaunch(eNode, 0);
+        log_kitc_throttled(eInst -> num, numWaiting - 1);
+        return 0;
+    }
+    while(!queued && !takeToken()){
+        pauseNs(nextToken() - metrics_now());
+    }
+    
+    actKey.sa_handler = key_handler;
+
+    //Set up background specific elements of the process
+    //If background tast, use the bg_handler
+    if(BG){
+        actChild.sa_handler = bg_handler;
+        eNode -> backGround = LOG_BG;
+        choosePlacement(eNode);
+    }
+    //Set up foreground specific elements of the process
+    //If foreground task and not using pipes, use fg_handler
+    else{
+        actChild.sa_handler = fg_handler;
+        currentTaskNum = eInst-> num;
+        eNode -> backGround = LOG_FG;
+        eNode -> placedSlot = -1;
+    }
+
+    //Handler for if pipe
+    if(pipefd != NULL){
+        actChild.sa_handler = pipe_handler;
+    }
+    
+    //Assign handlers for signals
+    sigaction(SIGINT, &actKey, NULL);
+    sigaction(SIGTSTP, &actKey, NULL);
+    sigaction(SIGCHLD, &actChild, NULL);
+
+
+    //Hand the task to a warm helper if its executable is pooled,
+    //otherwise spawn it through the backend and store the child pid
+    //SIGCHLD stays blocked until the pid is stored, so a fast child
+    //cannot be reaped before its node can be found
+    blockSig(0);
+    spawnStart = metrics_now();
+    pid_t child_pid = -1;
+    int unopened = 0;
+    if(procBackend == &os_backend){
+        child_pid = poolLaunch(eNode, command[0], BG, pipefd);
+        unopened = child_pid == -2;
+    }
+    //Other background launches go to the launcher threads if they run,
+    //those writing to or reading from a pipe too; the foreground task
+    //stays here, where the controller waits for it anyway
+    if(child_pid < 0 && !unopened && BG && procBackend == &os_backend && launcher_threads() > 0){
+        submitLaunch(eNode, pipefd);
+        blockSig(1);
+        return 0;
+    }
+    //A fork refused for want of processes or memory is tried again after
+    //a backoff: here SPAWN_TRIES times at most, and from the launch queue
+    //for a background launch, until processes are freed
+    while(child_pid < 0 && !unopened){
+        Child_Args args = {eNode, eInst -> num, BG, pipefd, command, spawnStart, ""};
+        findPath(args.path, command[0]);
+        child_pid = procBackend -> spawn(stepCommand(eNode), childExec, &args);
+        if(child_pid >= 0 || (errno != EAGAIN && errno != ENOMEM) || (!queued && eNode -> spawnTries + 1 >= SPAWN_TRIES)){
+            break;
+        }
+        long backoff = spawnBackoff(eNode);
+        if(queued){
+            eNode -> retryAt = metrics_now() + backoff;
+            waitLaunch(eNode, 1);
+            blockSig(1);
+            return 0;
+        }
+        blockSig(1);
+        pauseNs(backoff);
+        blockSig(0);
+        spawnStart = metrics_now();
+    }
+    if(launchDone(eNode, unopened ? -1 : child_pid, spawnStart)){
+        blockSig(1);
+        if(!BG){
+            currentTaskNum = -1;
+        }
+        return -1;
+    }
+    blockSig(1);
+
+    //Waits for a foreground process to end or stop, or a chain step to end,
+    //which the handler records. SIGCHLD is held off between the check and
+    //the wait, which lets it in, so none can slip by in between
+    if (!BG){
+        blockSig(0);
+        while(eNode -> status == LOG_STATE_RUNNING && !eNode -> stepDue){
+            foregroundIdle();
+        }
+        blockSig(1);
+        currentTaskNum = -1;
+    }
+
+    return 0;
+}
+
+/* Runs a chain from its first step. A foreground chain is run here to its
+ * end, each step launched as soon as the one before it is reaped; the steps
+ * of a background chain are launched by the main loop (advanceChains()).
+ * Returns 0 on success, -1 otherwise. */
+int execChain(Process_Node *eNode, int BG){
+    //Already waiting to launch
+    if((eNode -> throttled || eNode -> launching != NULL) && BG){
+        return 0;
+    }
+    for(int i = 0; i < eNode -> numSteps; i++){
+        Chain_Step *step = &eNode -> steps[i];
+        step -> pid = 0;
+        step -> status = LOG_STATE_READY;
+        step -> exitCode = 0;
+        step -> start = 0;
+        step -> end = 0;
+    }
+    eNode -> step = 0;
+    eNode -> stepDue = 0;
+    eNode -> exitCode = 0;
+
+    blockSig(0);
+    numChains++;
+    blockSig(1);
+    if(execCmd(eNode, BG, NULL)){
+        numChains--;
+        return -1;
+    }
+    while(!BG && eNode -> stepDue){
+        eNode -> stepDue = 0;
+        if(execCmd(eNode, BG, NULL)){
+            failStep(eNode);
+        }
+    }
+    return 0;
+}
+
+/* Ends a chain whose due step could not be launched at all, as if that
+ * step had exited 127, and lets its redirections and waits go. */
+void failStep(Process_Node *node){
+    blockSig(0);
+    if(node -> status == LOG_STATE_RUNNING){
+        Chain_Step *step = &node -> steps[node -> step];
+        step -> status = LOG_STATE_FINISHED;
+        step -> exitCode = 127;
+        node -> exitCode = 127;
+        numChains--;
+        closeRedirects(node);
+        setStatus(node, LOG_STATE_FINISHED);
+        log_kitc_status_change(node -> inst -> num, node -> pid, node -> backGround, node -> command, LOG_TERM);
+    }
+    blockSig(1);
+}
+
+/* Launches the steps the reapers have left due, for chains in the background
+ * or suspended and resumed from the foreground. */
+void advanceChains(){
+    if(!chainsDue){
+        return;
+    }
+    chainsDue = 0;
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(current -> stepDue){
+            current -> stepDue = 0;
+            if(execCmd(current, LOG_BG, NULL)){
+                failStep(current);
+            }
+        }
+    }
+}
+
+/* Arms limitFd for at, on the metrics_now() clock. */
+void armLimit(long at){
+    if(limitFd < 0){
+        limitFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(limitFd < 0 || wakeOn(limitFd)){
+            return;
+        }
+    }
+    struct itimerspec when = {{0, 0}, {at / 1000000000L, at % 1000000000L}};
+    timerfd_settime(limitFd, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+/* Launches the tasks waiting in the launch queue, in order (or packed, see
+ * packNext()), as tokens and fork retries allow (and none under pressure),
+ * and arms limitFd for when the next one can go. */
+void launchWaiting(){
+    uint64_t expirations;
+    if(limitFd >= 0 && read(limitFd, &expirations, sizeof(expirations)) < 0){
+        expirations = 0;
+    }
+
+    //Command lines come first while they keep coming, so a burst of them
+    //is taken in quickly, with launches let through every LAUNCH_YIELD
+    long now = metrics_now();
+    if(waitHead == NULL || pressured || (inputWaiting() && now - launchBatch < LAUNCH_YIELD)){
+        return;
+    }
+    launchBatch = now;
+
+    //Room left when packing, used up by each launch made; a task ending
+    //frees some, and its SIGCHLD wakes the prompt to try again. The needs
+    //of the waiting launches are looked up once a drain, not once a pick
+    double usedCores = 0;
+    long usedMemKb = 0;
+    if(packCores > 0){
+        packUsed(&usedCores, &usedMemKb);
+        for(Process_Node *node = waitHead; node != NULL; node = node -> nextWaiting){
+            taskNeeds(node, &node -> waitCores, &node -> waitMemKb);
+        }
+    }
+
+    while(waitHead != NULL){
+        Process_Node *node = waitHead;
+        long at = node -> retryAt > metrics_now() ? node -> retryAt : 0;
+        if(packCores > 0){
+            node = packNext(usedCores, usedMemKb, &at);
+            if(node == NULL){
+                if(at){
+                    armLimit(at);
+                }
+                return;
+            }
+            at = 0;
+        }
+        if(at == 0 && !takeToken()){
+            at = nextToken();
+        }
+        if(at){
+            armLimit(at);
+            return;
+        }
+        if(packCores > 0){
+            usedCores += node -> waitCores;
+            usedMemKb += node -> waitMemKb;
+        }
+
+        dropWaiting(node);
+        int firstStep = node -> steps != NULL && node -> status != LOG_STATE_RUNNING;
+        tokenHeld = 1;
+        int failed = execCmd(node, LOG_BG, NULL);
+        tokenHeld = 0;
+        //Back to waiting, or finished by finishLaunches()
+        if(node -> throttled || node -> launching != NULL){
+            continue;
+        }
+        blockSig(0);
+        if(failed){
+            numChains -= firstStep;
+            node -> runStart = 0;
+            log_kitc_exec_error(node -> command);
+        }
+        //The files given to bg stayed open for the wait
+        if(node -> steps == NULL || (node -> status != LOG_STATE_RUNNING && node -> status != LOG_STATE_SUSPENDED)){
+            closeRedirects(node);
+        }
+        blockSig(1);
+    }
+}
+
+/* If task a matters less than task b: by scheduling policy, then nice
+ * level, then the later task. */
+int lessImportant(Process_Node *a, Process_Node *b){
+    int rankA = a -> schedPolicy == SCHED_IDLE ? 2 : a -> schedPolicy == SCHED_BATCH;
+    int rankB = b -> schedPolicy == SCHED_IDLE ? 2 : b -> schedPolicy == SCHED_BATCH;
+    if(rankA != rankB){
+        return rankA > rankB;
+    }
+    int niceA = a -> hasNice ? a -> niceLevel : 0;
+    int niceB = b -> hasNice ? b -> niceLevel : 0;
+    if(niceA != niceB){
+        return niceA > niceB;
+    }
+    return a -> inst -> num > b -> inst -> num;
+}
+
+/* The running background task that matters least, NULL if none. */
+Process_Node *shedNext(){
+    Process_Node *least = NULL;
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(current -> backGround == LOG_BG && current -> status == LOG_STATE_RUNNING && current -> pid > 0 && !current -> shed &&
+           (least == NULL || lessImportant(current, least))){
+            least = current;
+        }
+    }
+    return least;
+}
+
+/* The shed task that matters most, NULL if none. Tasks no longer suspended
+ * (resumed by hand, or ended) are no longer shed. */
+Process_Node *resumeNext(){
+    Process_Node *most = NULL;
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(!current -> shed){
+            continue;
+        }
+        if(current -> status != LOG_STATE_SUSPENDED){
+            current -> shed = 0;
+        }
+        else if(most == NULL || lessImportant(most, current)){
+            most = current;
+        }
+    }
+    return most;
+}
+
+/* Writes the stall of each watched resource against its limit into buf. */
+void describePressure(char *buf, size_t size){
+    buf[0] = '\0';
+    for(int r = 0; r < PSI_RESOURCES; r++){
+        if(pressureLimit[r] > 0){
+            snprintf(buf + strlen(buf), size - strlen(buf), "%s%s %.1f%% of %g%%", buf[0] ? ", " : "",
+                     psi_name(r), psi_stall(r), pressureLimit[r]);
+        }
+    }
+}
+
+/* Acts on each window of pressure sampled. Past any limit, background
+ * launches are held back in the launch queue, and while it lasts, if
+ * shedding, the running background task that matters least is suspended
+ * each window. Once every resource has stayed under half its limit for
+ * PRESSURE_HOLD, shed tasks are resumed a window apart, most important
+ * first, and then launches are let through again. */
+void runPressure(){
+    if(!pressureOn || !psi_poll()){
+        return;
+    }
+    int over = 0;
+    int calm = 1;
+    for(int r = 0; r < PSI_RESOURCES; r++){
+        if(pressureLimit[r] > 0){
+            over |= psi_stall(r) >= pressureLimit[r];
+            calm &= psi_stall(r) < pressureLimit[r] / 2;
+        }
+    }
+    char stalls[MAXLINE];
+    describePressure(stalls, sizeof(stalls));
+
+    blockSig(0);
+    if(over){
+        calmSince = 0;
+        if(!pressured){
+            pressured = 1;
+            log_kitc_pressure(stalls, LOG_PRESSURE_HOLD, -1);
+        }
+        else if(pressureShed){
+            Process_Node *node = shedNext();
+            if(node != NULL){
+                node -> shed = 1;
+                log_kitc_pressure(stalls, LOG_PRESSURE_SHED, node -> inst -> num);
+                metrics_count(METRIC_SHED, 1);
+                sendSig(node, SIGTSTP, 0);
+            }
+        }
+    }
+    else if(pressured && calm){
+        long now = metrics_now();
+        if(calmSince == 0){
+            calmSince = now;
+        }
+        if(now - calmSince >= PRESSURE_HOLD){
+            Process_Node *node = resumeNext();
+            if(node != NULL){
+                node -> shed = 0;
+                log_kitc_pressure(stalls, LOG_PRESSURE_RESUME, node -> inst -> num);
+                sendSig(node, SIGCONT, 0);
+            }
+            else{
+                pressured = 0;
+                calmSince = 0;
+                log_kitc_pressure(stalls, LOG_PRESSURE_RELEASE, -1);
+            }
+        }
+    }
+    else{
+        calmSince = 0;
+    }
+    blockSig(1);
+
+    //Triggers cannot say when pressure ends, so windows are sampled until it does
+    psi_sampling(pressured);
+}
+
+/* Turns admission control off, resuming any task it shed, and lets held
+ * back launches go. */
+void stopPressure(){
+    psi_stop();
+    for(int r = 0; r < PSI_RESOURCES; r++){
+        pressureLimit[r] = 0;
+    }
+    blockSig(0);
+    Process_Node *node;
+    while((node = resumeNext()) != NULL){
+        node -> shed = 0;
+        sendSig(node, SIGCONT, 0);
+    }
+    blockSig(1);
+    pressureOn = 0;
+    pressureShed = 0;
+    pressured = 0;
+    calmSince = 0;
+}
+
+/* Handles the execution of commands with pipes. */
+void execPipe(int taskNum1, int taskNum2){
+
+    //Sets up node1 and node2
+    Process_Node *node1 = getTaskNode(taskNum1);
+    if(handleExeErr(node1, taskNum1)){
+        return;
+    }
+    Process_Node *node2 = getTaskNode(taskNum2);
+    if(handleExeErr(node2, taskNum2)){
+        return;
+    }
+
+    //A chain has no single process to hand a pipe end to
+    if(node1 -> steps != NULL || node2 -> steps != NULL){
+        log_kitc_exec_error(node1 -> steps != NULL ? node1 -> command : node2 -> command);
+        return;
     }
 
     //Set up the pipe
     int pipefd[2];
-    if(pipe(pipefd)){
+    if(pipe2(pipefd, O_CLOEXEC)){
         log_kitc_file_error(taskNum1, LOG_FILE_PIPE);
         return;
     }
 
-    //Display message indicating pipe
-    log_kitc_pipe(taskNum1, taskNum2);
+    //Display message indicating pipe
+    log_kitc_pipe(taskNum1, taskNum2);
+
+    //Prepare node1 as a background task writing to the pipe
+    node1 -> backGround = LOG_BG;
+    int writeEnd[2] = {-1, pipefd[1]};
+    execCmd(node1, LOG_BG, writeEnd);
+    close(pipefd[1]);  //Close write end
+
+    //prepare node2 and run it as foreground task reading the pipe
+    node2 -> backGround = LOG_FG;
+    int readEnd[2] = {pipefd[0], -1};
+    execCmd(node2, LOG_FG, readEnd);
+
+    close(pipefd[0]);  //Close read end
+    return;
+
+}
+
+/* Closes every fd from low up, in a child before it execs or relays:
+ * with close_range(2) where the kernel has it (5.9 on), and one at a time
+ * up to the fd limit where it does not. */
+void closeFrom(int low){
+#ifdef SYS_close_range
+    if(syscall(SYS_close_range, low, ~0U, 0) == 0){
+        return;
+    }
+#endif
+    struct rlimit limit;
+    long top = getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY ? (long) limit.rlim_cur : 65536;
+    for(long fd = low; fd < top; fd++){
+        close(fd);
+    }
+}
+
+/* Runs a relay between task pipes in a child, which keeps only the pipe
+ * ends it uses: ins and outs. It dies with the controller. Its exit goes to
+ * the reapers as that of no task. Returns a pidfd on it, with its pid in
+ * pid, or -1 if it could not be started. */
+int startRelay(int mode, int ins[], int numIns, int outs[], int numOuts, pid_t *pid){
+    pid_t parent = getpid();
+    blockSig(0);
+    *pid = fork();
+    if(*pid == 0){
+        //Gone with the controller, even one that went before this ran
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if(getppid() != parent){
+            _exit(1);
+        }
+        control_child();
+        setpgid(0, 0);
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGPIPE, SIG_IGN);
+
+        //Move the ends to 3, 4, ... and close everything above them
+        int ends[2 * MAXARGS];
+        int numEnds = numIns + numOuts;
+        int top = 0;
+        for(int i = 0; i < numEnds; i++){
+            ends[i] = i < numIns ? ins[i] : outs[i - numIns];
+            if(ends[i] > top){
+                top = ends[i];
+            }
+        }
+        for(int i = 0; i < numEnds; i++){
+            ends[i] = fcntl(ends[i], F_DUPFD, top + 1);
+        }
+        for(int i = 0; i < numEnds; i++){
+            dup2(ends[i], 3 + i);
+            ends[i] = 3 + i;
+        }
+        closeFrom(3 + numEnds);
+
+        int ret;
+        if(mode == RELAY_MERGE){
+            ret = relay_merge(ends, numIns, ends[numIns]);
+        }
+        else if(mode == RELAY_COPY){
+            ret = relay_copy(ends[0], ends + 1, numOuts);
+        }
+        else{
+            ret = relay_tee(ends[0], ends + 1, numOuts);
+        }
+        _exit(ret ? 1 : 0);
+    }
+    //Not reaped before this, with SIGCHLD blocked
+    int pidfd = *pid > 0 ? syscall(SYS_pidfd_open, *pid, 0) : -1;
+    blockSig(1);
+    return pidfd;
+}
+
+void dropRelay(Process_Node *node){
+    if(node -> relayFd < 0){
+        return;
+    }
+    int serving = 0;
+    for(Process_Node *current = head; current != NULL && !serving; current = current -> next){
+        serving = current != node && current -> relayPid == node -> relayPid &&
+                  (current -> status == LOG_STATE_RUNNING || current -> status == LOG_STATE_SUSPENDED ||
+                   current -> launching != NULL);
+    }
+    if(!serving){
+        syscall(SYS_pidfd_send_signal, node -> relayFd, SIGKILL, NULL, 0);
+    }
+    close(node -> relayFd);
+    node -> relayFd = -1;
+    node -> relayPid = 0;
+}
+
+/* Runs tasks connected through a relay: the output of each task in from
+ * goes to every task in to, duplicated (tee and copy) or merged a line at a
+ * time (merge). Writers run in the background; so do readers but the last,
+ * which runs in the foreground like the reading side of pipe. */
+void execRelay(int mode, int from[], int numFrom, int to[], int numTo){
+    Process_Node *fromNodes[MAXARGS];
+    Process_Node *toNodes[MAXARGS];
+
+    //Every task must be ready to run, and appear only once
+    for(int i = 0; i < numFrom + numTo; i++){
+        int taskNum = i < numFrom ? from[i] : to[i - numFrom];
+        Process_Node *node = getTaskNode(taskNum);
+        if(handleExeErr(node, taskNum)){
+            return;
+        }
+        if(node -> steps != NULL){
+            log_kitc_exec_error(node -> command);
+            return;
+        }
+        for(int j = 0; j < i; j++){
+            if(taskNum == (j < numFrom ? from[j] : to[j - numFrom])){
+                log_kitc_pipe_error(taskNum);
+                return;
+            }
+        }
+        if(i < numFrom){
+            fromNodes[i] = node;
+        }
+        else{
+            toNodes[i - numFrom] = node;
+        }
+    }
+
+    //One pipe per task; the relay holds the other end of each
+    //Big pipes mean fewer wakeups for every side
+    int pipes[2 * MAXARGS][2];
+    int numPipes = numFrom + numTo;
+    int small = 0;  //Pipes left smaller, e.g. beyond /proc/sys/fs/pipe-max-size
+    for(int i = 0; i < numPipes; i++){
+        if(pipe2(pipes[i], O_CLOEXEC) == 0){
+            if(fcntl(pipes[i][1], F_SETPIPE_SZ, RELAY_PIPE) < 0){
+                small++;
+            }
+        }
+        else{
+            log_kitc_file_error(i < numFrom ? from[i] : to[i - numFrom], LOG_FILE_PIPE);
+            for(int j = 0; j < i; j++){
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            return;
+        }
+    }
+    int relayIns[MAXARGS];
+    int relayOuts[MAXARGS];
+    for(int i = 0; i < numFrom; i++){
+        relayIns[i] = pipes[i][0];
+    }
+    for(int i = 0; i < numTo; i++){
+        relayOuts[i] = pipes[numFrom + i][1];
+    }
+    if(small){
+        log_kitc_pipe_size(small, fcntl(pipes[0][1], F_GETPIPE_SZ), RELAY_PIPE);
+    }
+    pid_t relayPid;
+    int relayFd = startRelay(mode, relayIns, numFrom, relayOuts, numTo, &relayPid);
+    for(int i = 0; i < numFrom; i++){
+        close(pipes[i][0]);
+    }
+    for(int i = 0; i < numTo; i++){
+        close(pipes[numFrom + i][1]);
+    }
+
+    for(int i = 0; i < numFrom; i++){
+        for(int j = 0; j < numTo; j++){
+            log_kitc_pipe(from[i], to[j]);
+        }
+    }
+
+    //Every task keeps hold of the relay, so killing or purging the last of
+    //them still running stops it
+    for(int i = 0; i < numFrom + numTo; i++){
+        Process_Node *node = i < numFrom ? fromNodes[i] : toNodes[i - numFrom];
+        dropRelay(node);
+        if(relayFd >= 0){
+            node -> relayPid = relayPid;
+            node -> relayFd = fcntl(relayFd, F_DUPFD_CLOEXEC, 0);
+        }
+    }
+    if(relayFd >= 0){
+        close(relayFd);
+    }
+
+    //Writers, in the background
+    for(int i = 0; i < numFrom; i++){
+        fromNodes[i] -> backGround = LOG_BG;
+        int writeEnd[2] = {-1, pipes[i][1]};
+        execCmd(fromNodes[i], LOG_BG, writeEnd);
+        close(pipes[i][1]);
+    }
+
+    //Readers, the last in the foreground
+    for(int i = 0; i < numTo; i++){
+        int bg = i < numTo - 1 ? LOG_BG : LOG_FG;
+        toNodes[i] -> backGround = bg;
+        int readEnd[2] = {pipes[numFrom + i][0], -1};
+        execCmd(toNodes[i], bg, readEnd);
+        close(pipes[numFrom + i][0]);
+    }
+}
+
+/* Reads the task numbers of "T1 ... -> T2 ...", from args on, into from
+ * and to. Returns 0 on success and -1 otherwise. */
+int parseRelayTasks(char *args[], int from[], int *numFrom, int to[], int *numTo){
+    int *side = from;
+    int *count = numFrom;
+    int arrows = 0;
+    *numFrom = 0;
+    *numTo = 0;
+    for(int i = 0; args[i] != NULL; i++){
+        if(!strcmp(args[i], "->")){
+            side = to;
+            count = numTo;
+            arrows++;
+            continue;
+        }
+        char *end;
+        long taskNum = strtol(args[i], &end, 10);
+        if(*end != '\0' || end == args[i] || taskNum < 0 || *count >= MAXARGS){
+            return -1;
+        }
+        side[(*count)++] = taskNum;
+    }
+    if(arrows != 1 || *numFrom == 0 || *numTo == 0){
+        return -1;
+    }
+    return 0;
+}
+
+/* Signals a task through the process backend, or through its pidfd if it
+ * was adopted. No SIGCHLD comes for an adopted task, so its stop or
+ * continue is recorded here. */
+void signalTask(Process_Node *node, int sig){
+    if(node -> adoptFd < 0){
+        procBackend -> signal(node -> pid, sig);
+        return;
+    }
+    if(syscall(SYS_pidfd_send_signal, node -> adoptFd, sig, NULL, 0)){
+        return;
+    }
+    if(sig == SIGTSTP){
+        setStatus(node, LOG_STATE_SUSPENDED);
+        log_kitc_status_change(node -> inst -> num, node -> pid, LOG_BG, node -> command, LOG_SUSPEND);
+    }
+    else if(sig == SIGCONT){
+        setStatus(node, LOG_STATE_RUNNING);
+        log_kitc_status_change(node -> inst -> num, node -> pid, LOG_BG, node -> command, LOG_RESUME);
+    }
+}
+
+/* Uses the process backend to send signals. 
+ * Has flag kB to indicate if the keyboard commands were called (^C, ^Z).
+ * Only sends signals to foreground processes when keyboard commands are used. */
+void sendSig(Process_Node *node, int sig, int kB){
+    
+    switch(sig){
+
+        //Terminate Process
+        case SIGINT:
+            //If sent from keyboard
+            if(kB){
+                log_kitc_ctrl_c();
+                //Sends only to foreground processes
+                procBackend -> signal(-LOG_FG+1, sig);
+            }
+            else{
+                log_kitc_sig_sent(LOG_CMD_KILL, node -> inst -> num, node -> pid);
+                signalTask(node, sig);
+            }
+            metrics_count(METRIC_SIGINT, 1);
+            break;
+        case SIGTSTP:
+            if(kB){
+                log_kitc_ctrl_z();
+                //Sends only to foreground processes
+                procBackend -> signal(-LOG_FG+1, sig);
+            }
+            else{
+                log_kitc_sig_sent(LOG_CMD_SUSPEND, node -> inst -> num, node -> pid);
+                signalTask(node, sig);
+            }
+            metrics_count(METRIC_SIGTSTP, 1);
+            break;
+        case SIGCONT:
+            log_kitc_sig_sent(LOG_CMD_RESUME, node -> inst -> num, node -> pid);
+            signalTask(node, sig);
+            metrics_count(METRIC_SIGCONT, 1);
+            break;
+    }
+
+    return;
+}
+
+/* Puts a schedule on the wheel, in the slot of the tick it is due. */
+void wheelInsert(Schedule *sched){
+    Schedule **slot = &wheel[(sched -> due / WHEEL_TICK) % WHEEL_SLOTS];
+    sched -> prev = NULL;
+    sched -> next = *slot;
+    if(*slot != NULL){
+        (*slot) -> prev = sched;
+    }
+    *slot = sched;
+    sched -> armed = 1;
+    numSchedules++;
+}
+
+/* Takes a schedule off the wheel. */
+void wheelRemove(Schedule *sched){
+    if(!sched -> armed){
+        return;
+    }
+    if(sched -> prev != NULL){
+        sched -> prev -> next = sched -> next;
+    }
+    else{
+        wheel[(sched -> due / WHEEL_TICK) % WHEEL_SLOTS] = sched -> next;
+    }
+    if(sched -> next != NULL){
+        sched -> next -> prev = sched -> prev;
+    }
+    sched -> armed = 0;
+    numSchedules--;
+}
+
+/* Arms the timerfd for next, on the metrics_now() clock, or disarms it for 0. */
+void armWheelAt(long next){
+    struct itimerspec when = {{0, 0}, {0, 0}};
+    when.it_value.tv_sec = next / 1000000000L;
+    when.it_value.tv_nsec = next % 1000000000L;
+    timerfd_settime(wheelFd, TFD_TIMER_ABSTIME, &when, NULL);
+    wheelNext = next;
+}
+
+/* Arms the timerfd for the first run due within a turn of the wheel, or a
+ * turn ahead if none is, so an idle controller only wakes for a run or once
+ * a turn whatever the number of schedules. Nothing is left armed without one. */
+void armWheel(){
+    long next = 0;
+    if(numSchedules > 0){
+        long tick = metrics_now() / WHEEL_TICK;
+        next = (tick + WHEEL_SLOTS) * WHEEL_TICK;
+        int found = 0;
+        for(long t = tick; t < tick + WHEEL_SLOTS && !found; t++){
+            //A slot also holds runs of later turns, and late ones of earlier turns
+            for(Schedule *sched = wheel[t % WHEEL_SLOTS]; sched != NULL; sched = sched -> next){
+                if(sched -> due / WHEEL_TICK <= t && sched -> due < next){
+                    next = sched -> due;
+                    found = 1;
+                }
+            }
+        }
+    }
+    armWheelAt(next);
+}
+
+/* Starts a scheduled run of a task in the background. */
+void launchRun(Process_Node *node){
+    node -> runStart = metrics_now();
+    if(node -> steps != NULL ? execChain(node, LOG_BG) : execCmd(node, LOG_BG, NULL)){
+        node -> runStart = 0;
+        log_kitc_exec_error(node -> command);
+    }
+}
+
+/* Runs a schedule that has come due, and puts it back on the wheel for its
+ * next run. Runs missed meanwhile are not made up. A single run is freed
+ * once nothing waits for it. */
+void fireSchedule(Schedule *sched, long now){
+    Process_Node *node = sched -> node;
+    if(sched -> interval > 0){
+        sched -> due += sched -> interval;
+        if(sched -> due <= now){
+            sched -> due = now + sched -> interval - (now - sched -> due) % sched -> interval;
+        }
+        wheelInsert(sched);
+    }
+
+    //The last run is still going: skip this one, or queue it behind, killing the last one first
+    if(node -> status == LOG_STATE_RUNNING || node -> status == LOG_STATE_SUSPENDED){
+        if(sched -> overlap == OVERLAP_SKIP){
+            sched -> skipped++;
+        }
+        else{
+            if(sched -> overlap == OVERLAP_KILL && sched -> queued == 0){
+                sendSig(node, SIGINT, 0);
+                if(node -> status == LOG_STATE_SUSPENDED){
+                    signalTask(node, SIGCONT);
+                }
+            }
+            sched -> queued++;
+            numQueued++;
+        }
+    }
+    else{
+        launchRun(node);
+    }
+
+    if(!sched -> armed && sched -> queued == 0){
+        node -> schedule = NULL;
+        free(sched);
+    }
+}
+
+/* Runs the schedules due by now, from the slots of every tick since the
+ * last turn (the whole wheel once if that is more than a turn). */
+void turnWheel(){
+    long now = metrics_now();
+    long tick = now / WHEEL_TICK;
+    long from = tick - wheelTick >= WHEEL_SLOTS ? tick - WHEEL_SLOTS + 1 : wheelTick;
+
+    //Taken off first and run after, since runs go back on the wheel
+    Schedule *due = NULL;
+    for(long t = from; t <= tick; t++){
+        Schedule *sched = wheel[t % WHEEL_SLOTS];
+        while(sched != NULL){
+            Schedule *next = sched -> next;
+            if(sched -> due <= now){
+                wheelRemove(sched);
+                sched -> next = due;
+                due = sched;
+            }
+            sched = next;
+        }
+    }
+    wheelTick = tick;
+
+    while(due != NULL){
+        Schedule *next = due -> next;
+        fireSchedule(due, now);
+        due = next;
+    }
+}
+
+void launchWatched(Process_Node *node);
+
+/* Starts runs queued behind runs that have since ended, a change to a
+ * watched file before a scheduled run. */
+void launchQueued(){
+    runsDue = 0;
+    for(Process_Node *current = head; current != NULL && numQueued > 0; current = current -> next){
+        if(current -> status == LOG_STATE_RUNNING || current -> status == LOG_STATE_SUSPENDED){
+            continue;
+        }
+        if(current -> watch != NULL && current -> watch -> pending){
+            current -> watch -> pending = 0;
+            numQueued--;
+            launchWatched(current);
+            continue;
+        }
+        Schedule *sched = current -> schedule;
+        if(sched == NULL || sched -> queued == 0){
+            continue;
+        }
+        sched -> queued--;
+        numQueued--;
+        launchRun(current);
+        if(!sched -> armed && sched -> queued == 0){
+            current -> schedule = NULL;
+            free(sched);
+        }
+    }
+}
+
+/* Runs what the timer wheel has due, and what was queued behind ended runs. */
+void runSchedules(){
+    uint64_t expirations;
+    if(wheelFd >= 0 && read(wheelFd, &expirations, sizeof(expirations)) > 0){
+        turnWheel();
+        armWheel();
+    }
+    if(runsDue){
+        launchQueued();
+    }
+}
+
+/* Schedules a task every interval ns from due, or once at due if interval
+ * is 0, in place of any schedule it had. Returns 0 on success and -1 otherwise. */
+int scheduleTask(Process_Node *node, const char *when, long interval, long due, int overlap){
+    if(wheelFd < 0){
+        wheelFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(wheelFd < 0 || wakeOn(wheelFd)){
+            if(wheelFd >= 0){
+                close(wheelFd);
+                wheelFd = -1;
+            }
+            return -1;
+        }
+    }
+    if(node -> schedule != NULL){
+        unschedule(node);
+    }
+    if(numSchedules == 0){
+        wheelTick = metrics_now() / WHEEL_TICK;
+    }
+
+    Schedule *sched = calloc(1, sizeof(Schedule));
+    sched -> node = node;
+    snprintf(sched -> when, sizeof(sched -> when), "%s", when);
+    sched -> interval = interval;
+    sched -> due = due;
+    sched -> overlap = overlap;
+    node -> schedule = sched;
+    wheelInsert(sched);
+    //Only a run earlier than the one armed moves the timer
+    if(wheelNext == 0 || due < wheelNext){
+        armWheelAt(due);
+    }
+    return 0;
+}
+
+void unschedule(Process_Node *node){
+    Schedule *sched = node -> schedule;
+    wheelRemove(sched);
+    numQueued -= sched -> queued;
+    node -> schedule = NULL;
+    free(sched);
+}
+
+/* Reads a duration such as "500ms", "10s", "5m", "2h" or "1d" (seconds
+ * without a unit). Returns it in ns, or -1 if it is not one. */
+long parseInterval(const char *arg){
+    char *end;
+    double value = strtod(arg, &end);
+    double unit;
+    if(end == arg || !(value > 0)){
+        return -1;
+    }
+    if(!strcmp(end, "ms")){unit = 1e6;}
+    else if(!strcmp(end, "s") || *end == '\0'){unit = 1e9;}
+    else if(!strcmp(end, "m")){unit = 60e9;}
+    else if(!strcmp(end, "h")){unit = 3600e9;}
+    else if(!strcmp(end, "d")){unit = 86400e9;}
+    else{
+        return -1;
+    }
+    return (long) (value * unit);
+}
+
+/* Reads the time of an at: "+DURATION" from now, or "HH:MM[:SS]", next on
+ * the local clock. Returns it on the metrics_now() clock, or -1. */
+long parseAt(const char *arg){
+    if(arg[0] == '+'){
+        long delay = parseInterval(arg + 1);
+        return delay < 0 ? -1 : metrics_now() + delay;
+    }
+
+    int hour, min, sec = 0, used = 0;
+    if(sscanf(arg, "%2d:%2d%n:%2d%n", &hour, &min, &used, &sec, &used) < 2 || arg[used] != '\0' ||
+       hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 59){
+        return -1;
+    }
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    struct tm tm;
+    localtime_r(&real.tv_sec, &tm);
+    tm.tm_hour = hour;
+    tm.tm_min = min;
+    tm.tm_sec = sec;
+    tm.tm_isdst = -1;
+    time_t at = mktime(&tm);
+    if(at <= real.tv_sec){
+        tm.tm_mday++;
+        tm.tm_hour = hour;
+        tm.tm_min = min;
+        tm.tm_sec = sec;
+        tm.tm_isdst = -1;
+        at = mktime(&tm);
+    }
+    return metrics_now() + (at - real.tv_sec) * 1000000000L - real.tv_nsec;
+}
+
+/* Starts a run of a watched task in the background, with the files given
+ * to watch. */
+void launchWatched(Process_Node *node){
+    char *wCommand[MAXARGS+1];
+    char *args = string_copy(node -> watch -> args);
+    stringSplit(wCommand, args, " ");
+    node -> watch -> runs++;
+    if(openRedirects(node, wCommand) == 0){
+        launchRun(node);
+    }
+    blockSig(0);
+    if(!node -> throttled && node -> launching == NULL &&
+       (node -> steps == NULL || (node -> status != LOG_STATE_RUNNING && node -> status != LOG_STATE_SUSPENDED))){
+        closeRedirects(node);
+    }
+    blockSig(1);
+    free(node -> inst -> infile);
+    node -> inst -> infile = NULL;
+    free(node -> inst -> outfile);
+    node -> inst -> outfile = NULL;
+    free(args);
+}
+
+/* Re-runs the watched tasks whose files have changed. A task still running
+ * from before is re-run once when it ends, however many changes come. */
+void runWatches(){
+    if(numWatches == 0 || watch_poll() == 0){
+        return;
+    }
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        Watch *watch = current -> watch;
+        int changed = 0;
+        for(int i = 0; watch != NULL && i < watch -> numFiles && !changed; i++){
+            changed = watch_changed(watch -> files[i]);
+        }
+        if(!changed){
+            continue;
+        }
+        if(current -> status == LOG_STATE_RUNNING || current -> status == LOG_STATE_SUSPENDED){
+            if(!watch -> pending){
+                watch -> pending = 1;
+                numQueued++;
+            }
+        }
+        else{
+            launchWatched(current);
+        }
+    }
+}
+
+/* Watches the files a task reads: its input file (< FILE among args, the
+ * redirections each run gets) and the executables of its commands, in
+ * place of any watch it had. Returns 0 on success and -1, with the file that
+ * cannot be watched logged, otherwise. */
+int watchTask(Process_Node *node, const char *args){
+    Watch *watch = calloc(1, sizeof(Watch));
+    char *files[MAXARGS+1];
+    char paths[MAXARGS][MAXLINE];
+    int numFiles = 0;
+
+    //Executables, of every step of a chain
+    for(int i = 0; i < (node -> steps != NULL ? node -> numSteps : 1) && numFiles < MAXARGS; i++){
+        char name[MAXLINE];
+        snprintf(name, sizeof(name), "%s", node -> steps != NULL ? node -> steps[i].command : node -> command);
+        name[strcspn(name, " ")] = '\0';
+        findPath(paths[numFiles], name);
+        files[numFiles] = paths[numFiles];
+        numFiles++;
+    }
+
+    //The input file
+    char *wCommand[MAXARGS+1];
+    char *argsCopy = string_copy(args);
+    stringSplit(wCommand, argsCopy, " ");
+    for(int i = 0; wCommand[i] != NULL && wCommand[i + 1] != NULL && numFiles < MAXARGS; i++){
+        if(!strcmp(wCommand[i], "<")){
+            snprintf(paths[numFiles], MAXLINE, "%s", wCommand[i + 1]);
+            files[numFiles] = paths[numFiles];
+            numFiles++;
+        }
+    }
+    free(argsCopy);
+
+    for(int i = 0; i < numFiles; i++){
+        watch -> files[i] = watch_add(files[i]);
+        if(watch -> files[i] < 0 || wakeOn(watch_fd())){
+            log_kitc_file_error(node -> inst -> num, files[i]);
+            for(int j = 0; j <= i; j++){
+                watch_remove(watch -> files[j]);
+            }
+            free(watch);
+            return -1;
+        }
+        watch -> numFiles++;
+    }
+
+    if(node -> watch != NULL){
+        unwatch(node);
+    }
+    watch -> args = string_copy(args);
+    node -> watch = watch;
+    numWatches++;
+    return 0;
+}
+
+void unwatch(Process_Node *node){
+    Watch *watch = node -> watch;
+    for(int i = 0; i < watch -> numFiles; i++){
+        watch_remove(watch -> files[i]);
+    }
+    if(watch -> pending){
+        numQueued--;
+    }
+    free(watch -> args);
+    free(watch);
+    node -> watch = NULL;
+    numWatches--;
+}
+
+/* Wakes the prompt loop out of its read so periodic work can run. */
+void alarm_handler(int sig){
+    trace_probe(signal, sig, "alarm", metrics_now());
+}
+
+/* Sets the gauges that are read from the task table rather than counted. */
+void updateGauges(){
+    long states[5] = {0};
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(current -> status >= 0 && current -> status < 5){
+            states[current -> status]++;
+        }
+    }
+    for(int i = 0; i < 5; i++){
+        metrics_gauge(METRIC_TASKS_READY + i, states[i]);
+    }
+
+    //Bytes of scripted input waiting behind the current command
+    int queued = 0;
+    if(ioctl(STDIN_FILENO, FIONREAD, &queued)){
+        queued = 0;
+    }
+    metrics_gauge(METRIC_INPUT_BYTES, queued + stdinLen);
+    metrics_gauge(METRIC_LAUNCH_QUEUE, numWaiting);
+}
+
+/* Dumps the metrics if a periodic dump is set up and due. */
+void dumpMetrics(){
+    if(metricsTarget == NULL || metrics_now() < metricsDue){
+        return;
+    }
+    updateGauges();
+    metrics_dump(metricsTarget);
+    metricsDue = metrics_now() + metricsInterval;
+}
+
+/* Sets up (or, with target NULL, stops) the periodic metrics dump. */
+void setMetricsDump(const char *target, long seconds){
+    free(metricsTarget);
+    metricsTarget = NULL;
+
+    struct itimerval timer = {{0, 0}, {0, 0}};
+    if(target != NULL){
+        metricsTarget = string_copy(target);
+        metricsInterval = seconds * 1000000000L;
+        metricsDue = metrics_now();
+        timer.it_interval.tv_sec = seconds;
+        timer.it_value.tv_sec = seconds;
+    }
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/* One row of the top view. */
+typedef struct Top_Row{
+    Process_Node *node; // Task
+    proc_sample sample; // Its last sample
+}Top_Row;
+
+/* Orders top rows by cpu, highest first. */
+int topByCpu(const void *a, const void *b){
+    double x = ((const Top_Row *) a) -> sample.cpu;
+    double y = ((const Top_Row *) b) -> sample.cpu;
+    return (x < y) - (x > y);
+}
+
+/* Orders top rows by resident memory, highest first. */
+int topByMem(const void *a, const void *b){
+    long x = ((const Top_Row *) a) -> sample.rss_kb;
+    long y = ((const Top_Row *) b) -> sample.rss_kb;
+    return (x < y) - (x > y);
+}
+
+/* If a line, or the end of stdin, is held in stdinBuf already, where poll
+ * cannot see it. */
+int stdinBuffered(){
+    return stdinEnded || memchr(stdinBuf, '\n', stdinLen) != NULL;
+}
+
+/* Reads a line of stdin into line as fgets() does: up to size - 1 chars,
+ * ending with the '\n' if it fits, and stdinEnded set if the end came
+ * first. Returns NULL at the end with nothing read, or on an error (EINTR
+ * if a signal cut it short, with what was read so far kept). */
+char *stdinLine(char *line, int size){
+    while(1){
+        char *end = memchr(stdinBuf, '\n', stdinLen);
+        int len = end != NULL ? end - stdinBuf + 1 : stdinLen;
+        if(len > size - 1){
+            len = size - 1;
+        }
+        if(end != NULL || len == size - 1 || stdinEnded || stdinLen == sizeof(stdinBuf)){
+            if(len == 0){
+                return NULL;
+            }
+            memcpy(line, stdinBuf, len);
+            line[len] = '\0';
+            stdinLen -= len;
+            memmove(stdinBuf, stdinBuf + len, stdinLen);
+            return line;
+        }
+        ssize_t got = read(STDIN_FILENO, stdinBuf + stdinLen, sizeof(stdinBuf) - stdinLen);
+        if(got < 0){
+            return NULL;
+        }
+        if(got == 0){
+            stdinEnded = 1;
+        }
+        stdinLen += got;
+    }
+}
+
+/* Waits up to seconds, or with watch set until a line of input comes in,
+ * which is consumed. Returns 1 if a line came in. */
+int waitInput(double seconds, int watch){
+    long deadline = metrics_now() + (long) (seconds * 1e9);
+    while(1){
+        long left = (deadline - metrics_now()) / 1000000;
+        struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        int ready = watch && stdinBuffered() ? 1 : poll(&pfd, watch ? 1 : 0, left > 0 ? left : 0);
+        if(ready > 0){
+            char line[MAXLINE];
+            if(stdinLine(line, MAXLINE) == NULL){
+                stdinEnded = 0;
+            }
+            return 1;
+        }
+        //SIGCHLD cuts the wait short, carry on until the deadline
+        if(ready == 0 || errno != EINTR || left <= 0){
+            return 0;
+        }
+    }
+}
+
+/* Shows cpu and memory of running and suspended tasks, sorted by cpu or
+ * memory, redrawn in place every interval seconds. Stops after count
+ * frames, or with count 0 when a line of input comes in. */
+void runTop(int byMem, double interval, long count){
+    Top_Row *rows = NULL;
+    long capacity = 0;
+
+    //Frames fit the terminal when there is one
+    int tty = isatty(STDOUT_FILENO);
+    long height = 0;
+    struct winsize ws;
+    if(tty && !ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) && ws.ws_row > 3){
+        height = ws.ws_row - 3;
+    }
+
+    for(long frame = 0; count == 0 || frame < count; frame++){
+        if(frame > 0 && waitInput(interval, count == 0)){
+            break;
+        }
+
+        //Sample the running set; simulated tasks have no /proc entries
+        long numRows = 0, running = 0, suspended = 0;
+        procstat_begin();
+        for(Process_Node *current = head; current != NULL; current = current -> next){
+            if((current -> status != LOG_STATE_RUNNING && current -> status != LOG_STATE_SUSPENDED) || current -> pid <= 0){
+                continue;
+            }
+            if(numRows == capacity){
+                capacity = capacity ? capacity * 2 : 64;
+                rows = realloc(rows, capacity * sizeof(Top_Row));
+            }
+            Top_Row *row = &rows[numRows++];
+            row -> node = current;
+            memset(&row -> sample, 0, sizeof(proc_sample));
+            row -> sample.state = '-';
+            if(procBackend == &os_backend){
+                procstat_read(current -> pid, &row -> sample);
+            }
+            if(current -> status == LOG_STATE_RUNNING){running++;}
+            else{suspended++;}
+        }
+        procstat_end();
+        qsort(rows, numRows, sizeof(Top_Row), byMem ? topByMem : topByCpu);
+
+        if(tty && count != 1){
+            printf("\033[H\033[2J");
+        }
+        printf("top: %ld running, %ld suspended, by %s every %gs%s\n", running, suspended,
+               byMem ? "memory" : "cpu", interval, count == 0 ? " (Enter to stop)" : "");
+        printf("%6s %8s %s %6s %9s %9s  %s\n", "TASK", "PID", "S", "CPU%", "RSS MB", "VSZ MB", "COMMAND");
+        for(long i = 0; i < numRows && (height == 0 || i < height); i++){
+            proc_sample *sample = &rows[i].sample;
+            printf("%6d %8d %c %6.1f %9.1f %9.1f  %s\n", rows[i].node -> inst -> num, rows[i].node -> pid,
+                   sample -> state, sample -> cpu, sample -> rss_kb / 1024.0, sample -> vsz_kb / 1024.0, rows[i].node -> command);
+        }
+        fflush(stdout);
+    }
+    free(rows);
+}
+
+/* Arms waitFd for the first deadline of the waits in progress, or disarms it. */
+void armWaits(){
+    long first = 0;
+    for(Wait *wait = waits; wait != NULL; wait = wait -> next){
+        if(wait -> deadline && (first == 0 || wait -> deadline < first)){
+            first = wait -> deadline;
+        }
+    }
+    if(waitFd < 0){
+        if(first == 0){
+            return;
+        }
+        waitFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(waitFd < 0 || wakeOn(waitFd)){
+            return;
+        }
+    }
+    struct itimerspec when = {{0, 0}, {first / 1000000000L, first % 1000000000L}};
+    timerfd_settime(waitFd, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+/* Starts a wait for tasks (all of them, or any with any), timing out after
+ * timeout ns (0 for never), answered to the held response hold (0 for
+ * stdin, which is held back meanwhile). Tasks already ended count as
+ * ended. Called with SIGCHLD blocked. */
+void startWait(int *tasks, int numTasks, int any, long timeout, long hold){
+    Wait *wait = malloc(sizeof(Wait));
+    wait -> links = calloc(numTasks > 0 ? numTasks : 1, sizeof(Wait_Link));
+    wait -> numTasks = numTasks;
+    wait -> any = any;
+    wait -> left = numTasks;
+    wait -> first = -1;
+    wait -> due = numTasks == 0;
+    wait -> start = metrics_now();
+    wait -> deadline = timeout > 0 ? wait -> start + timeout : 0;
+    wait -> hold = hold;
+
+    for(int i = 0; i < numTasks; i++){
+        Process_Node *node = getTaskNode(tasks[i]);
+        Wait_Link *link = &wait -> links[i];
+        link -> wait = wait;
+        link -> task = tasks[i];
+        link -> next = node -> waiters;
+        node -> waiters = link;
+        if(node -> status == LOG_STATE_FINISHED || node -> status == LOG_STATE_KILLED){
+            Wait_Link *others = link -> next;
+            link -> next = NULL;
+            endWaits(node);
+            link -> next = others;
+        }
+    }
+
+    wait -> next = waits;
+    waits = wait;
+    numWaits++;
+    waitsDue |= wait -> due;
+    stdinHeld |= hold == 0;
+    armWaits();
+}
+
+/* Answers the waits that are over or timed out, with their exit status:
+ * that of the task that ended first for any, otherwise the first nonzero
+ * of the tasks in the order given (0 if all succeeded), and 124 on a
+ * timeout as timeout(1) has. */
+void finishWaits(){
+    uint64_t expirations;
+    int timedOut = waitFd >= 0 && read(waitFd, &expirations, sizeof(expirations)) > 0;
+    if(!waitsDue && !timedOut){
+        return;
+    }
+
+    blockSig(0);
+    waitsDue = 0;
+    long now = metrics_now();
+    Wait **prev = &waits;
+    while(*prev != NULL){
+        Wait *wait = *prev;
+        if(!wait -> due && (wait -> deadline == 0 || now < wait -> deadline)){
+            prev = &wait -> next;
+            continue;
+        }
+        *prev = wait -> next;
+        numWaits--;
+
+        int status = 0;
+        int failed = 0;
+        for(int i = 0; i < wait -> numTasks; i++){
+            Wait_Link *link = &wait -> links[i];
+            if(link -> ended && link -> exitCode != 0){
+                failed++;
+                if(status == 0 && !wait -> any){
+                    status = link -> exitCode;
+                }
+            }
 
-    //Prepare node1 as a background task
-    node1 -> backGround = LOG_BG;
-    //Use the execCmd to execute node1 with pipefd
-    execCmd(node1, LOG_BG, pipefd);
-    close(pipefd[1]);  //Close write end
+            //Unhook it from its task, if the task is still there
+            Process_Node *node = getTaskNode(link -> task);
+            for(Wait_Link **hook = node != NULL ? &node -> waiters : NULL; hook != NULL && *hook != NULL; hook = &(*hook) -> next){
+                if(*hook == link){
+                    *hook = link -> next;
+                    break;
+                }
+            }
+        }
+        int ended = wait -> numTasks - wait -> left;
+        int anyTask = wait -> any && wait -> first >= 0 ? wait -> links[wait -> first].task : -1;
+        if(anyTask >= 0){
+            status = wait -> links[wait -> first].exitCode;
+        }
+        if(!wait -> due){
+            status = 124;
+        }
 
-    //prepare node2 and run it as foreground task
-    node2 -> backGround = LOG_FG;
-    execCmd(node2, LOG_FG, pipefd);
+        if(wait -> hold == 0 || !control_resume(wait -> hold)){
+            log_kitc_wait((now - wait -> start) / 1e9, ended, wait -> numTasks, failed, anyTask, !wait -> due, status);
+            if(wait -> hold){
+                control_end();
+            }
+        }
+        if(wait -> hold == 0){
+            stdinHeld = 0;
+        }
+        free(wait -> links);
+        free(wait);
+    }
+    armWaits();
+    blockSig(1);
+}
 
-    close(pipefd[0]);  //Close read end
-    return;
+/* If the main loop has to come round between command lines: to commit
+ * task state changes to the journal, or for adopted tasks, chains, queued
+ * and scheduled runs, watches, launches held back or on launcher threads,
+ * pressure and wait timeouts, which come due with no line to read. */
+int needsWake(){
+    return journal_path() != NULL || numAdopted || numChains || numLaunching || numQueued ||
+           numSchedules || numWatches || numWaiting || numWaits || pressureOn;
+}
 
+/* If the wait for a line has to end every ADOPT_POLL_MS, for what can come
+ * due with nothing to wake it: adopted tasks send no SIGCHLD, and a chain
+ * step or queued run can come due just before the wait. */
+int needsPoll(){
+    return numAdopted || numChains || numQueued;
 }
 
-/* Uses kill() to send signals. 
- * Has flag kB to indicate if the keyboard commands were called (^C, ^Z).
- * Only sends signals to foreground processes when keyboard commands are used. */
-void sendSig(Process_Node *node, int sig, int kB){
-    
-    switch(sig){
+/* Waits for the next command line while the control socket is open.
+ * A client request is copied into cmdline; stdin is only found ready, for
+ * the caller to read. When both have a line waiting they take turns.
+ * Returns the client, -1 if stdin is ready, or -2 if a signal cut the wait
+ * short, or adopted tasks, chains, schedules, watches or held launches are
+ * due a check. */
+int nextRequest(char *cmdline){
+    static int stdinLast = 0;
+    while(1){
+        //Look without blocking first, so waiting requests are not held up.
+        //Stdin is left alone while a wait from it holds the script back
+        int inOpen = stdinOpen && !stdinHeld;
+        int inReady = inOpen && stdinBuffered();
+        if(control_wait(inOpen && !inReady ? STDIN_FILENO : -1, -1, 0) > 0){
+            inReady = 1;
+        }
 
-        //Terminate Process
-        case SIGINT:
-            //If sent from keyboard
-            if(kB){
-                log_kitc_ctrl_c();
-                //Sends only to foreground processes
-                kill(-LOG_FG+1, sig);
+        if(inReady && !stdinLast){
+            stdinLast = 1;
+            return -1;
+        }
+        int client = control_next(cmdline, MAXLINE);
+        if(client >= 0){
+            stdinLast = 0;
+            return client;
+        }
+        if(inReady){
+            stdinLast = 1;
+            return -1;
+        }
+
+        //Adopted tasks send no SIGCHLD, and one can come just before the
+        //wait when a chain step or queued run is due, so look in on them
+        //now and then. The timer wheel, file watches, launch limiter, pressure
+        //and wait timeouts wake the wait
+        if(chainsDue || runsDue || waitsDue){
+            return -2;
+        }
+        int ready = control_wait(inOpen ? STDIN_FILENO : -1, wakeFd, needsPoll() ? ADOPT_POLL_MS : -1);
+        if(ready < 0 || (ready == 0 && needsWake())){
+            return -2;
+        }
+    }
+}
+
+/* Detaches from the terminal to run as a daemon driven over the control
+ * socket at path. The parent exits once the socket is up, with status 1 if
+ * it cannot be. The daemon's output goes to the console log. */
+void daemonize(const char *path){
+    int ready[2];
+    if(pipe2(ready, O_CLOEXEC)){
+        exit(1);
+    }
+    pid_t pid = fork();
+    if(pid < 0){
+        exit(1);
+    }
+    if(pid > 0){
+        char ok = 0;
+        close(ready[1]);
+        if(read(ready[0], &ok, 1) != 1 || !ok){
+            fprintf(stderr, "taskctl: cannot listen on %s\n", path);
+            exit(1);
+        }
+        printf("taskctl %d running as a daemon on %s\n", (int) pid, path);
+        exit(0);
+    }
+
+    //Own session, so the terminal going away sends no SIGHUP to it or its tasks
+    close(ready[0]);
+    setsid();
+    signal(SIGHUP, SIG_IGN);
+    int devNull = open("/dev/null", O_RDWR);
+    dup2(devNull, STDIN_FILENO);
+    close(devNull);
+    stdinOpen = 0;
+
+    char ok = !control_open(path) && !control_log_open();
+    if(write(ready[1], &ok, 1) != 1 || !ok){
+        exit(1);
+    }
+    close(ready[1]);
+}
+
+/* If actual, len bytes of a /proc/PID/cmdline, is the argv the command
+ * line cmd is run with. */
+int argvMatches(const char *cmd, const char *actual, ssize_t len){
+    //cmdline holds argv with a NUL after each argument
+    char expect[MAXLINE + 1];
+    char *aCommand[MAXARGS+1];
+    char *cmdCopy = string_copy(cmd);
+    stringSplit(aCommand, cmdCopy, " ");
+    size_t expectLen = 0;
+    for(int i = 0; aCommand[i] != NULL && expectLen + strlen(aCommand[i]) < sizeof(expect); i++){
+        strcpy(expect + expectLen, aCommand[i]);
+        expectLen += strlen(aCommand[i]) + 1;
+    }
+    free(cmdCopy);
+    return len == (ssize_t) expectLen && !memcmp(actual, expect, expectLen);
+}
+
+/* Takes over the process of a restored task if it is still the task: its
+ * command line, or that of one of its chain's steps, must match. Returns a
+ * pidfd on it, or -1. */
+int adoptTask(Process_Node *node){
+    if(node -> pid <= 0){
+        return -1;
+    }
+    //The pidfd pins the process, so the command line read after is its own
+    int pidfd = syscall(SYS_pidfd_open, node -> pid, 0);
+    if(pidfd < 0){
+        return -1;
+    }
+
+    char path[64];
+    char actual[MAXLINE + 1];
+    ssize_t len = -1;
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", (int) node -> pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd >= 0){
+        len = read(fd, actual, sizeof(actual));
+        close(fd);
+    }
+
+    //A chain runs one step at a time, and which one is not journaled, so
+    //any of its steps will do. Redirections are opened by the controller
+    //and never in a command line, so the argv is the line split on spaces
+    int matched = 0;
+    if(node -> steps == NULL){
+        matched = argvMatches(node -> command, actual, len);
+    }
+    for(int i = 0; i < node -> numSteps && !matched; i++){
+        matched = argvMatches(node -> steps[i].command, actual, len);
+    }
+
+    //Still there after the read, so the pid was not reused in between
+    struct pollfd exited = {pidfd, POLLIN, 0};
+    if(!matched || poll(&exited, 1, 0) != 0){
+        close(pidfd);
+        return -1;
+    }
+    return pidfd;
+}
+
+/* Rebuilds a task read back from the journal at startup. They come in task
+ * number order, so each goes at the end of the list, after *last (the
+ * list's last node, kept up to date here). Tasks that were
+ * running or suspended are adopted if their process is still there, and
+ * are finished with an unknown exit code (-1) otherwise. */
+void restoreTask(const journal_task *task, void *arg){
+    Process_Node **last = arg;
+    char *argv[MAXARGS+1];
+    Instruction inst;
+    initialize_command(&inst, argv);
+    parse(task -> command, &inst, argv);
+
+    Instruction *newInst = malloc(sizeof(Instruction));
+    initialize_instruction(newInst);
+    cpyInst(inst, newInst);
+    free_command(&inst, argv);
+    newInst -> num = task -> task;
+
+    Process_Node *node = malloc(sizeof(Process_Node));
+    newNode(node, newInst, string_copy(task -> command));
+    node -> numSteps = parseChain(task -> command, &node -> steps);
+    if(node -> numSteps < 0){
+        node -> numSteps = 0;
+    }
+    node -> pid = task -> pid;
+    node -> status = task -> state;
+    node -> exitCode = task -> exit_code;
+    node -> backGround = LOG_BG;
+    if(node -> status == LOG_STATE_RUNNING || node -> status == LOG_STATE_SUSPENDED){
+        node -> adoptFd = adoptTask(node);
+        if(node -> adoptFd >= 0){
+            numAdopted++;
+        }
+        else{
+            node -> status = LOG_STATE_FINISHED;
+            node -> exitCode = -1;
+        }
+    }
+
+    if(*last == NULL){
+        head = node;
+    }
+    else{
+        (*last) -> next = node;
+    }
+    *last = node;
+    publishNode(node);
+}
+
+/* Finishes adopted tasks whose process has exited. Only a parent can collect
+ * an exit code, so theirs is unknown (-1). */
+void checkAdopted(){
+    if(numAdopted == 0){
+        return;
+    }
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(current -> adoptFd < 0){
+            continue;
+        }
+        struct pollfd exited = {current -> adoptFd, POLLIN, 0};
+        if(poll(&exited, 1, 0) > 0){
+            close(current -> adoptFd);
+            current -> adoptFd = -1;
+            numAdopted--;
+            current -> exitCode = -1;
+            setStatus(current, LOG_STATE_FINISHED);
+            log_kitc_status_change(current -> inst -> num, current -> pid, LOG_BG, current -> command, LOG_TERM);
+        }
+    }
+}
+
+/* Compacts the journal by writing the whole task table as its snapshot. */
+void writeSnapshot(){
+    journal_snapshot_begin();
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        journal_snapshot_task(current -> inst -> num, current -> pid, current -> status, current -> exitCode, current -> command);
+    }
+    journal_snapshot_end();
+}
+
+/* Sends sig to the process group of a live task for shutdown. Adopted
+ * tasks are signalled through their pidfd, and simulated ones alone. */
+void signalGroup(Process_Node *node, int sig){
+    if(node -> adoptFd >= 0){
+        syscall(SYS_pidfd_send_signal, node -> adoptFd, sig, NULL, 0);
+    }
+    else if(procBackend != &os_backend || procBackend -> signal(-node -> pid, sig)){
+        procBackend -> signal(node -> pid, sig);
+    }
+}
+
+/* Records the end of a task during shutdown: Finished if it exited,
+ * Killed if a signal ended it. */
+void endShutdown(Process_Node *node, int status){
+    if(node -> adoptFd >= 0){
+        close(node -> adoptFd);
+        node -> adoptFd = -1;
+        numAdopted--;
+    }
+    if(WIFSIGNALED(status)){
+        node -> exitCode = 128 + WTERMSIG(status);
+        setStatus(node, LOG_STATE_KILLED);
+        log_kitc_status_change(node -> inst -> num, node -> pid, LOG_BG, node -> command, LOG_TERM_SIG);
+    }
+    else{
+        node -> exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        setStatus(node, LOG_STATE_FINISHED);
+        log_kitc_status_change(node -> inst -> num, node -> pid, LOG_BG, node -> command, LOG_TERM);
+    }
+}
+
+/* If a task has a process that shutdown has to end. */
+int shutdownLive(Process_Node *node){
+    return node -> pid > 0 && (node -> status == LOG_STATE_RUNNING || node -> status == LOG_STATE_SUSPENDED);
+}
+
+/* Shuts the tasks down for quit, all at once: every running or suspended
+ * task's process group gets SIGCONT and SIGTERM, and they are reaped as
+ * they exit, whichever goes first. Those left after deadline seconds get
+ * SIGKILL, so the time taken is bounded by the deadline and not by the
+ * number of tasks. With detach they are left running instead, and SIGCHLD
+ * is unblocked again; otherwise it stays blocked. Ends with a summary of
+ * the final states. */
+void shutdownTasks(double deadline, int detach){
+    //Let the launcher threads spawn what they have, so it is shut down too
+    stopLaunchers();
+    blockSig(0);
+    long start = metrics_now();
+    int left = 0;
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        left += shutdownLive(current);
+    }
+    log_kitc_shutdown(left, deadline, detach);
+    if(detach){
+        blockSig(1);
+        return;
+    }
+    for(Process_Node *current = head; current != NULL; current = current -> next){
+        if(shutdownLive(current)){
+            signalGroup(current, SIGCONT);
+            signalGroup(current, SIGTERM);
+        }
+    }
+
+    //SIGCHLD stays blocked and is taken with sigtimedwait, so the reapers
+    //do not run (and chains do not go on to their next step)
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    long end = start + (long) (deadline * 1e9);
+    int exited = 0, terminated = 0, killed = 0, killSent = 0;
+    while(left > 0){
+        pid_t pid;
+        int status;
+        while(left > 0 && (pid = procBackend -> reap(-1, &status, WNOHANG, NULL)) > 0){
+            Process_Node *node = getPidNode(pid);
+            if(node == NULL || !shutdownLive(node) || !(WIFEXITED(status) || WIFSIGNALED(status))){
+                continue;
             }
-            else{
-                log_kitc_sig_sent(LOG_CMD_KILL, node -> inst -> num, node -> pid);
-                kill(node -> pid, sig);
+            endShutdown(node, status);
+            left--;
+            if(killSent){
+                killed++;
             }
-            
-            break;
-        case SIGTSTP:
-            if(kB){
-                log_kitc_ctrl_z();
-                //Sends only to foreground processes
-                kill(-LOG_FG+1, sig);
+            else if(WIFSIGNALED(status)){
+                terminated++;
             }
             else{
-                log_kitc_sig_sent(LOG_CMD_SUSPEND, node -> inst -> num, node -> pid);
-                kill(node -> pid, sig);
+                exited++;
             }
+        }
+
+        //Adopted tasks are not children, so only their pidfd tells, and
+        //not how they ended: they are taken as ended by the last signal sent
+        for(Process_Node *current = head; numAdopted && current != NULL; current = current -> next){
+            struct pollfd gone = {current -> adoptFd, POLLIN, 0};
+            if(current -> adoptFd >= 0 && poll(&gone, 1, 0) > 0){
+                endShutdown(current, W_EXITCODE(0, killSent ? SIGKILL : SIGTERM));
+                left--;
+                if(killSent){
+                    killed++;
+                }
+                else{
+                    terminated++;
+                }
+            }
+        }
+
+        long now = metrics_now();
+        if(left == 0 || (killSent && now >= end)){
             break;
-        case SIGCONT:
-            log_kitc_sig_sent(LOG_CMD_RESUME, node -> inst -> num, node -> pid);
-            kill(node -> pid, sig);
-            break;
+        }
+        if(now >= end){
+            for(Process_Node *current = head; current != NULL; current = current -> next){
+                if(shutdownLive(current)){
+                    signalGroup(current, SIGKILL);
+                }
+            }
+            killSent = 1;
+            end = now + SHUTDOWN_KILL_WAIT;
+            continue;
+        }
+        long wait = end - now;
+        if(numAdopted && wait > ADOPT_POLL_MS * 1000000L){
+            wait = ADOPT_POLL_MS * 1000000L;
+        }
+        struct timespec timeout = {wait / 1000000000L, wait % 1000000000L};
+        sigtimedwait(&chld, NULL, &timeout);
     }
+    log_kitc_shutdown_stats((metrics_now() - start) / 1e9, exited, terminated, killed, left);
+}
 
-    return;
+/* If another command line is waiting, on stdin or from a client. */
+int inputWaiting(){
+    int queued = 0;
+    if(stdinOpen && (stdinBuffered() || (ioctl(STDIN_FILENO, FIONREAD, &queued) == 0 && queued > 0))){
+        return 1;
+    }
+    return control_path() != NULL && control_pending();
 }
 
 void contLoop(char *cmd, char *argv[], Instruction *inst){
@@ -666,20 +4304,84 @@ void contLoop(char *cmd, char *argv[], Instruction *inst){
     free_command(inst, argv);
 }
 
-/* The entry of your task controller program */
-int main() {
+/* The entry of your task controller program
+ * taskctl [-d SOCKET] [-j JOURNAL]: with -d, runs as a daemon on the control
+ * socket SOCKET; with -j, restores the task table kept in JOURNAL and keeps it there */
+int main(int argc, char *argv[]) {
+
+    //Tasks are read from stdin unless running as a daemon
+    stdinOpen = 1;
+    char *daemonPath = NULL;
+    char *journalArg = NULL;
+    char *recordArg = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "d:j:r:")) != -1){
+        if(opt == 'd'){
+            daemonPath = optarg;
+        }
+        else if(opt == 'j'){
+            journalArg = optarg;
+        }
+        else if(opt == 'r'){
+            recordArg = optarg;
+        }
+        else{
+            fprintf(stderr, "usage: %s [-d SOCKET] [-j JOURNAL] [-r RECORDING]\n", argv[0]);
+            exit(2);
+        }
+    }
+    if(daemonPath != NULL){
+        daemonize(daemonPath);
+    }
 
     //Initialized global variable used for signal handling
     currentTaskNum = -1;
 
     //create sigaction to handle SIGCHLD
+    //restart reads so a stream of child exits cannot cut up a command line
     memset(&actChild, 0, sizeof(actChild));
     actChild.sa_handler = bg_handler;
+    actChild.sa_flags = SA_RESTART;
 
     memset(&actKey, 0, sizeof(actKey));
 
+    //Tasks are real processes until the simulator is chosen
+    procBackend = &os_backend;
+
+    //Background tasks run wherever the kernel puts them until placement is set
+    placePolicy = PLACE_NONE;
+    loadTopology();
+
+    //Metrics storage is shared so children can record spawn latency
+    metrics_init();
+
+    //Task table published for external monitors such as taskctl-top
+    status_open();
+
+    //Tasks from before a restart, with the running ones taken over
+    if(journalArg != NULL){
+        Process_Node *last = NULL;
+        long restored = journal_open(journalArg, restoreTask, &last);
+        if(restored < 0){
+            fprintf(stderr, "taskctl: cannot open journal %s\n", journalArg);
+            exit(1);
+        }
+        log_kitc_restored(restored, journalArg);
+    }
+
+    //The session recorded from the first line
+    if(recordArg != NULL && session_record_open(recordArg)){
+        fprintf(stderr, "taskctl: cannot record to %s\n", recordArg);
+        exit(1);
+    }
+    struct sigaction actAlarm;
+    memset(&actAlarm, 0, sizeof(actAlarm));
+    actAlarm.sa_handler = alarm_handler;
+    sigaction(SIGALRM, &actAlarm, NULL);
+
     char cmdline[MAXLINE];        /* Command line */
     char *cmd = NULL;
+    int prompted = 0;             /* If the prompt is up for the pending read */
 
     /* Inital Prompt and Welcome */
     log_kitc_intro();
@@ -691,21 +4393,117 @@ int main() {
         char *argv[MAXARGS+1];        /* Argument list */
         Instruction inst;           /* Instruction structure: check parse.h */
 
-        /* Print prompt */
-        log_kitc_prompt();
+        /* Finish adopted tasks that have exited */
+        checkAdopted();
+
+        /* Launch the next steps of chains */
+        advanceChains();
+
+        /* Launch scheduled runs that are due */
+        runSchedules();
+
+        /* Re-run watched tasks whose files have changed */
+        runWatches();
+
+        /* Learn the resource use of runs reaped since */
+        learnUsage();
+
+        /* Hold back or shed load while resources are under pressure */
+        runPressure();
 
-        /* Read a line */
-        // note: fgets will keep the ending '\n'
-	errno = 0;
-        if (fgets(cmdline, MAXLINE, stdin) == NULL) {
-            if (errno == EINTR) {
+        /* Take the launches the launcher threads are done with */
+        finishLaunches();
+
+        /* Launch background tasks the launch limiter has held back */
+        launchWaiting();
+
+        /* Make task table changes durable, a group at a time while input keeps coming */
+        if(journal_commit(inputWaiting(), 0)){
+            writeSnapshot();
+        }
+
+        /* Answer the control client whose request ran last */
+        control_end();
+
+        /* Answer the waits whose tasks have ended, or that timed out */
+        finishWaits();
+
+        /* Record output of cached tasks finished since the last prompt */
+        storeCached();
+
+        /* Replace helpers used by the last instruction */
+        if(pools != NULL){
+            blockSig(0);
+            refillPools();
+            blockSig(1);
+        }
+
+        /* Periodic metrics dump */
+        dumpMetrics();
+
+        /* Print prompt, unless it is still up from an interrupted read or a wait holds stdin */
+        if(!prompted && stdinOpen && !stdinHeld){
+            log_kitc_prompt();
+            prompted = 1;
+        }
+
+        /* Read a line, from a control client if one is first */
+        int client = -1;
+        if(control_path() != NULL){
+            client = nextRequest(cmdline);
+            if(client == -2){
                 continue;
             }
-            exit(-1);
         }
+        if(client >= 0){
+            control_begin(client);
+        }
+        else{
+            //A wait from stdin holds the script back until its tasks end or
+            //it times out, which the reapers or waitFd wake this for; SIGCHLD
+            //is let in only for the poll, so an end cannot slip in before it
+            if (stdinHeld) {
+                sigset_t mask;
+                blockSig(0);
+                sigprocmask(SIG_BLOCK, NULL, &mask);
+                sigdelset(&mask, SIGCHLD);
+                struct pollfd wake = {wakeFd, POLLIN, 0};
+                struct timespec poll = {0, ADOPT_POLL_MS * 1000000L};
+                if (!waitsDue && !chainsDue && !runsDue) {
+                    ppoll(&wake, wakeFd >= 0 ? 1 : 0, needsPoll() ? &poll : NULL, &mask);
+                }
+                blockSig(1);
+                continue;
+            }
+
+            //Wait where a task state change or anything else needsWake()
+            //covers can wake us, rather than in the read
+            if (needsWake() && !stdinBuffered() && !chainsDue && !runsDue) {
+                struct pollfd in[2] = {{STDIN_FILENO, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+                if (poll(in, wakeFd >= 0 ? 2 : 1, needsPoll() ? ADOPT_POLL_MS : -1) <= 0 ||
+                    !in[0].revents) {
+                    continue;
+                }
+            }
+
+            // note: stdinLine will keep the ending '\n'
+	    errno = 0;
+            if (stdinLine(cmdline, MAXLINE) == NULL) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                //Clients can still drive the controller
+                if (control_path() != NULL) {
+                    stdinOpen = 0;
+                    continue;
+                }
+                exit(-1);
+            }
+            prompted = 0;
 
-        if (feof(stdin)) {  /* ctrl-d will exit text processor */
-          exit(0);
+            if (stdinEnded) {  /* ctrl-d will exit text processor */
+              exit(0);
+            }
         }
 
         /* Parse command line */
@@ -720,7 +4518,14 @@ int main() {
         /* Bail if command is only whitespace */
         if(!is_whitespace(cmd)) {
             initialize_command(&inst, argv);    /* initialize arg lists and instruction */
+            long parseStart = metrics_now();
             parse(cmd, &inst, argv);            /* call provided parse() */
+            metrics_observe(METRIC_PARSE, metrics_now() - parseStart);
+
+            //Every line goes to the recording but those that start or end it
+            if(strcmp(inst.instruct, instructions[33])){
+                session_record(cmdline);
+            }
 
             if (DEBUG) {  /* display parse result, redefine DEBUG to turn it off */
                 debug_print_parse(cmd, &inst, argv, "main (after parse)");
@@ -730,7 +4535,41 @@ int main() {
             /*================================================*/
             
             if(!strcmp(inst.instruct, instructions[0])){ /* quit */
+                //quit [deadline=SECONDS], or quit --detach to leave the tasks running
+                char *qCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(qCommand, cmdCopy, " ");
+                int detach = 0;
+                double deadline = SHUTDOWN_DEADLINE;
+                const char *badArg = NULL;
+                for(int i = 1; qCommand[i] != NULL && badArg == NULL; i++){
+                    char *end = NULL;
+                    if(!strcmp(qCommand[i], "--detach")){
+                        detach = 1;
+                    }
+                    else if(strncmp(qCommand[i], "deadline=", 9) ||
+                            (deadline = strtod(qCommand[i] + 9, &end), end == qCommand[i] + 9 || *end != '\0' || deadline < 0)){
+                        badArg = qCommand[i];
+                    }
+                }
+                if(badArg != NULL){
+                    log_kitc_arg_error(badArg);
+                    free(cmdCopy);
+                    contLoop(cmd, argv, &inst);
+                    continue;
+                }
+                free(cmdCopy);
+
+                shutdownTasks(deadline, detach);
                 log_kitc_quit();  /* Display quit information */
+                //Leave a snapshot, so the next start has nothing to replay,
+                //or adopts the tasks left running if detached
+                if(journal_path() != NULL){
+                    writeSnapshot();
+                    journal_close();
+                }
+                control_end();
+                freePools();
                 freeList(head);
                 exit(0);  /* Exit the process */
             }
@@ -749,8 +4588,53 @@ int main() {
                 for(int i = 0; i < listSize(head); i++){
                     current = getNode(i); // Gets node at position i
                     //Displays the retrieved node
-                    log_kitc_task_info(current -> inst -> num, current -> status, 0, current -> pid, current -> command);
-                    
+                    log_kitc_task_info(current -> inst -> num, current -> status, current -> exitCode, current -> pid, current -> command);
+
+                    //Steps of a chain, with the last run of each
+                    for(int j = 0; j < current -> numSteps; j++){
+                        Chain_Step *step = &current -> steps[j];
+                        log_kitc_chain_step(j + 1, step -> op, step -> status, step -> exitCode, step -> pid,
+                                            step -> end > step -> start ? (step -> end - step -> start) / 1e6 : 0, step -> command);
+                    }
+
+                    //Schedule, and the last scheduled runs
+                    Schedule *sched = current -> schedule;
+                    if(sched != NULL){
+                        log_kitc_schedule_info(sched -> when, overlaps[sched -> overlap],
+                                               sched -> armed ? (sched -> due > metrics_now() ? (sched -> due - metrics_now()) / 1e9 : 0) : -1, sched -> queued, sched -> skipped);
+                    }
+                    long firstRun = current -> numRuns > RUNS_KEPT ? current -> numRuns - RUNS_KEPT : 0;
+                    for(long run = firstRun; run < current -> numRuns; run++){
+                        Run_Record *record = &current -> runs[run % RUNS_KEPT];
+                        log_kitc_run(run + 1, record -> status, record -> exitCode, record -> duration / 1e6);
+                    }
+
+                    //Watched files
+                    Watch *watch = current -> watch;
+                    if(watch != NULL){
+                        char files[MAXARGS * MAXLINE] = {0};
+                        for(int j = 0; j < watch -> numFiles; j++){
+                            snprintf(files + strlen(files), sizeof(files) - strlen(files), "%s%s", j ? ", " : "", watch_path(watch -> files[j]));
+                        }
+                        log_kitc_watch_info(files, watch -> runs, watch -> pending);
+                    }
+
+                    //Launch held back by the limiter, pressure or a failed fork
+                    if(current -> throttled){
+                        log_kitc_throttle_info((metrics_now() - current -> waitStart) / 1e6, current -> spawnTries);
+                    }
+                    if(current -> shed){
+                        log_kitc_shed_info();
+                    }
+
+                    //What packing counts it as needing
+                    if(packCores > 0){
+                        static const char *sources[] = {"guessed", "learned", "declared"};
+                        double cores;
+                        long memKb;
+                        int source = taskNeeds(current, &cores, &memKb);
+                        log_kitc_needs_info(cores, memKb, sources[source]);
+                    }
                 }
             }
             
@@ -774,6 +4658,8 @@ int main() {
                         log_kitc_status_error(taskNum, retStatus);
                         break;
                     default:
+                        status_remove(taskNum);
+                        journal_purge(taskNum);
                         log_kitc_purge(taskNum);
                         break;
                 }
@@ -792,36 +4678,27 @@ int main() {
                 stringSplit(eCommand, cmdCopy, " ");
                 int taskNum = inst.num;    //Task Number called with exec
 
-                //Node with instruction to be executed
-                Process_Node *eNode = getTaskNode(taskNum);  
-
-                if(handleExeErr(eNode, taskNum)){
-                    	contLoop(cmd, argv, &inst);
-                        continue;
-                }
-
-                Instruction *eInst = eNode -> inst;     //Instruction within the node
-
-                //Searches through command line args for "<" or ">" to indicate file redirection
-                for(int i = 0; eCommand[i] != NULL; i++){
-
-                    //Check for <
-                    if(!strcmp(eCommand[i], "<")){
-                        eInst -> infile = string_copy(eCommand[i+1]);
-                        log_kitc_redir(taskNum, LOG_REDIR_IN, eInst -> infile);
-
-                    }
+                //Node with instruction to be executed
+                Process_Node *eNode = getTaskNode(taskNum);  
 
-                    //Check for >
-                    if(!strcmp(eCommand[i], ">")){
-                        eInst -> outfile = string_copy(eCommand[i+1]);
-                        log_kitc_redir(taskNum, LOG_REDIR_OUT, eInst -> outfile);
-                    }
+                if(handleExeErr(eNode, taskNum)){
+                    	contLoop(cmd, argv, &inst);
+                        continue;
                 }
 
-                if(execCmd(eNode, bg, NULL)){
+                //Open the redirected files first, so a bad one costs no fork
+                if(openRedirects(eNode, eCommand) == 0 &&
+                   (eNode -> steps != NULL ? execChain(eNode, bg) : execCmd(eNode, bg, NULL))){
                     log_kitc_exec_error(eNode -> command);
                 }
+                //Every step of a chain gets the same files, so they stay open until it ends,
+                //and a launch waiting for the limiter or a launcher thread keeps them for when it goes
+                blockSig(0);
+                if(!eNode -> throttled && eNode -> launching == NULL &&
+                   (eNode -> steps == NULL || (eNode -> status != LOG_STATE_RUNNING && eNode -> status != LOG_STATE_SUSPENDED))){
+                    closeRedirects(eNode);
+                }
+                blockSig(1);
 
                 //Frees no longer need in and out files
                 free(eNode -> inst -> infile);
@@ -867,13 +4744,767 @@ int main() {
 
                 //Sends specified signal
                 sendSig(kNode, sig, 0);
+                if(sig == SIGINT){
+                    dropRelay(kNode);
+                }
             }
 
             else if(!strcmp(inst.instruct, instructions[9])){ /* pipe */
                 execPipe(inst.num, inst.num2);
             }
 
+            /* Pipe one task to several, or several tasks to one. */
+            else if(!strcmp(inst.instruct, instructions[23]) || !strcmp(inst.instruct, instructions[24])){ /* tee and merge */
+                char *rCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(rCommand, cmdCopy, " ");
+
+                int mode = !strcmp(inst.instruct, instructions[23]) ? RELAY_TEE : RELAY_MERGE;
+                int first = 1;
+                if(mode == RELAY_TEE && rCommand[1] != NULL && !strcmp(rCommand[1], "copy")){
+                    mode = RELAY_COPY;
+                    first = 2;
+                }
+                int from[MAXARGS], to[MAXARGS];
+                int numFrom, numTo;
+                if(parseRelayTasks(rCommand + first, from, &numFrom, to, &numTo)
+                   || (mode == RELAY_MERGE ? numTo : numFrom) != 1){
+                    const char *args = cmd + strlen(inst.instruct);
+                    while(*args == ' '){
+                        args++;
+                    }
+                    log_kitc_arg_error(*args ? args : "(none)");
+                }
+                else{
+                    execRelay(mode, from, numFrom, to, numTo);
+                }
+                free(cmdCopy);
+            }
+
+            /* Run a task every interval or once at a time, or stop. */
+            else if(!strcmp(inst.instruct, instructions[25]) || !strcmp(inst.instruct, instructions[26])){ /* every and at */
+                char *sCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(sCommand, cmdCopy, " ");
+
+                //every INTERVAL TASK [skip|queue|kill], at TIME TASK [...], or every|at off TASK
+                int every = !strcmp(inst.instruct, instructions[25]);
+                char *end = NULL;
+                long taskNum = sCommand[1] != NULL && sCommand[2] != NULL ? strtol(sCommand[2], &end, 10) : -1;
+                Process_Node *sNode = NULL;
+                int overlap = OVERLAP_SKIP;
+                if(sCommand[3] != NULL){
+                    for(overlap = OVERLAP_KILL; overlap >= 0 && strcmp(sCommand[3], overlaps[overlap]); overlap--);
+                }
+                if(end == NULL || *end != '\0' || end == sCommand[2]){
+                    log_kitc_arg_error(sCommand[1] != NULL ? sCommand[1] : "(none)");
+                }
+                else if((sNode = getTaskNode(taskNum)) == NULL){
+                    log_kitc_task_num_error(taskNum);
+                }
+                else if(!strcmp(sCommand[1], "off")){
+                    if(sNode -> schedule != NULL){
+                        unschedule(sNode);
+                    }
+                    log_kitc_schedule(taskNum, NULL, NULL);
+                }
+                else if(overlap < 0){
+                    log_kitc_arg_error(sCommand[3]);
+                }
+                else{
+                    long interval = every ? parseInterval(sCommand[1]) : 0;
+                    long due = every ? metrics_now() + interval : parseAt(sCommand[1]);
+                    char when[32];
+                    snprintf(when, sizeof(when), "%s %s", inst.instruct, sCommand[1]);
+                    if(interval < 0 || (every && interval < WHEEL_TICK) || due < 0){
+                        log_kitc_arg_error(sCommand[1]);
+                    }
+                    else if(scheduleTask(sNode, when, interval, due, overlap)){
+                        log_kitc_exec_error(sNode -> command);
+                    }
+                    else{
+                        log_kitc_schedule(taskNum, when, overlaps[overlap]);
+                    }
+                }
+                free(cmdCopy);
+            }
+
+            /* Re-run a task when a file it reads changes, or stop, or show the counters. */
+            else if(!strcmp(inst.instruct, instructions[27])){ /* watch */
+                char *wCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(wCommand, cmdCopy, " ");
+
+                //watch TASK [redirections], watch off TASK, or watch alone
+                int off = wCommand[1] != NULL && !strcmp(wCommand[1], "off");
+                char *taskArg = wCommand[1] != NULL ? wCommand[1 + off] : NULL;
+                char *end = NULL;
+                long taskNum = taskArg != NULL ? strtol(taskArg, &end, 10) : -1;
+                Process_Node *wNode = NULL;
+                if(wCommand[1] == NULL){
+                    long files, dirs, events, checks, changes;
+                    watch_stats(&files, &dirs, &events, &checks, &changes);
+                    log_kitc_watch_stats(files, dirs, events, checks, changes);
+                }
+                else if(end == NULL || *end != '\0' || end == taskArg){
+                    log_kitc_arg_error(wCommand[1]);
+                }
+                else if((wNode = getTaskNode(taskNum)) == NULL){
+                    log_kitc_task_num_error(taskNum);
+                }
+                else if(off){
+                    if(wNode -> watch != NULL){
+                        unwatch(wNode);
+                    }
+                    log_kitc_watch(taskNum, 0);
+                }
+                //The redirections are what follows the task number
+                else if(watchTask(wNode, cmd + (end - cmdCopy)) == 0){
+                    log_kitc_watch(taskNum, wNode -> watch -> numFiles);
+                }
+                free(cmdCopy);
+            }
+
+            /* Limit the rate of launches, or lift the limit, or show it. */
+            else if(!strcmp(inst.instruct, instructions[28])){ /* limit */
+                char *lCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(lCommand, cmdCopy, " ");
+
+                //limit RATE [BURST], limit off, or limit alone; the burst is
+                //a tenth of a second of launches unless given
+                char *rateEnd = NULL;
+                char *burstEnd = NULL;
+                double rate = lCommand[1] != NULL ? strtod(lCommand[1], &rateEnd) : 0;
+                long burst = lCommand[2] != NULL ? strtol(lCommand[2], &burstEnd, 10) : (rate >= 20 ? (long) (rate / 10) : 1);
+                if(lCommand[1] == NULL){
+                    if(launchRate > 0){
+                        refillTokens();
+                    }
+                    log_kitc_limit_stats(launchRate, launchBurst, launchTokens, numWaiting);
+                }
+                else if(!strcmp(lCommand[1], "off")){
+                    launchRate = 0;
+                    log_kitc_limit(0, 0);
+                }
+                else if(rateEnd == lCommand[1] || *rateEnd != '\0' || !(rate > 0)){
+                    log_kitc_arg_error(lCommand[1]);
+                }
+                else if(lCommand[2] != NULL && (burstEnd == lCommand[2] || *burstEnd != '\0' || burst < 1 || burst > INT_MAX)){
+                    log_kitc_arg_error(lCommand[2]);
+                }
+                else{
+                    launchRate = rate;
+                    launchBurst = burst;
+                    launchTokens = burst;
+                    launchRefill = metrics_now();
+                    log_kitc_limit(launchRate, launchBurst);
+                }
+                free(cmdCopy);
+            }
+
+            /* Hold back launches under pressure, or stop, or show it. */
+            else if(!strcmp(inst.instruct, instructions[29])){ /* pressure */
+                char *pCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(pCommand, cmdCopy, " ");
+
+                //pressure RESOURCE=PCT... [shed], pressure off, or pressure alone
+                double limits[PSI_RESOURCES] = {0};
+                int shed = 0;
+                char *bad = NULL;
+                for(int i = 1; pCommand[i] != NULL && bad == NULL && strcmp(pCommand[1], "off"); i++){
+                    if(!strcmp(pCommand[i], "shed")){
+                        shed = 1;
+                        continue;
+                    }
+                    int r = 0;
+                    size_t len = strcspn(pCommand[i], "=");
+                    while(r < PSI_RESOURCES && (strlen(psi_name(r)) != len || strncmp(pCommand[i], psi_name(r), len))){
+                        r++;
+                    }
+                    char *pctEnd = NULL;
+                    double pct = r < PSI_RESOURCES && pCommand[i][len] == '=' ? strtod(pCommand[i] + len + 1, &pctEnd) : 0;
+                    if(pctEnd == NULL || pctEnd == pCommand[i] + len + 1 || *pctEnd != '\0' || !(pct > 0 && pct <= 100)){
+                        bad = pCommand[i];
+                    }
+                    else{
+                        limits[r] = pct;
+                    }
+                }
+
+                if(pCommand[1] == NULL){
+                    if(!pressureOn){
+                        log_kitc_pressure_set(NULL, 0);
+                    }
+                    else{
+                        char stalls[MAXLINE];
+                        describePressure(stalls, sizeof(stalls));
+                        int triggers = 1;
+                        int numShed = 0;
+                        for(int r = 0; r < PSI_RESOURCES; r++){
+                            triggers &= pressureLimit[r] == 0 || psi_triggered(r);
+                        }
+                        for(Process_Node *current = head; current != NULL; current = current -> next){
+                            numShed += current -> shed;
+                        }
+                        log_kitc_pressure_stats(stalls, triggers, pressured, numWaiting, numShed);
+                    }
+                }
+                else if(!strcmp(pCommand[1], "off")){
+                    stopPressure();
+                    log_kitc_pressure_set(NULL, 0);
+                }
+                else if(bad != NULL){
+                    log_kitc_arg_error(bad);
+                }
+                else if(limits[PSI_CPU] == 0 && limits[PSI_MEMORY] == 0 && limits[PSI_IO] == 0){
+                    log_kitc_arg_error(pCommand[1]);
+                }
+                else{
+                    //Resources the kernel cannot report on are not watched
+                    char set[MAXLINE] = {0};
+                    for(int r = 0; r < PSI_RESOURCES; r++){
+                        if(limits[r] > 0 && psi_watch(r, limits[r])){
+                            log_kitc_arg_error(psi_name(r));
+                            limits[r] = 0;
+                        }
+                        if(limits[r] == 0){
+                            psi_unwatch(r);
+                        }
+                        else{
+                            snprintf(set + strlen(set), sizeof(set) - strlen(set), "%s%s %g%%", set[0] ? ", " : "", psi_name(r), limits[r]);
+                        }
+                        pressureLimit[r] = limits[r];
+                    }
+                    if(set[0] == '\0' || wakeOn(psi_fd())){
+                        stopPressure();
+                        log_kitc_pressure_set(NULL, 0);
+                    }
+                    else{
+                        pressureOn = 1;
+                        pressureShed = shed;
+                        log_kitc_pressure_set(set, shed);
+                    }
+                }
+                free(cmdCopy);
+            }
+
+            /* Wait for tasks to end, or any of them, or every live one. */
+            else if(!strcmp(inst.instruct, instructions[31])){ /* wait */
+                char *wCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(wCommand, cmdCopy, " ");
+
+                //wait [any] TASK... [timeout=SECONDS], or wait all [timeout=SECONDS]
+                int any = wCommand[1] != NULL && !strcmp(wCommand[1], "any");
+                int all = wCommand[1] != NULL && !strcmp(wCommand[1], "all");
+                double timeout = 0;
+                int bad = wCommand[1] == NULL;
+                if(bad){
+                    log_kitc_arg_error("(none)");
+                }
+
+                blockSig(0);
+                int numLive = 0;
+                for(Process_Node *current = head; all && current != NULL; current = current -> next){
+                    numLive++;
+                }
+                int *tasks = malloc((all ? numLive + 1 : MAXARGS) * sizeof(int));
+                int numTasks = 0;
+                for(int i = 1 + any + all; wCommand[i] != NULL && !bad; i++){
+                    char *end = NULL;
+                    if(!strncmp(wCommand[i], "timeout=", 8)){
+                        timeout = strtod(wCommand[i] + 8, &end);
+                        bad = end == wCommand[i] + 8 || *end != '\0' || !(timeout > 0);
+                        if(bad){
+                            log_kitc_arg_error(wCommand[i]);
+                        }
+                        continue;
+                    }
+                    long taskNum = strtol(wCommand[i], &end, 10);
+                    Process_Node *wNode = all || end == wCommand[i] || *end != '\0' ? NULL : getTaskNode(taskNum);
+                    if(all || end == wCommand[i] || *end != '\0'){
+                        log_kitc_arg_error(wCommand[i]);
+                        bad = 1;
+                    }
+                    else if(wNode == NULL){
+                        log_kitc_task_num_error(taskNum);
+                        bad = 1;
+                    }
+                    //One never launched would never end
+                    else if(wNode -> status == LOG_STATE_READY && !wNode -> throttled && wNode -> launching == NULL){
+                        log_kitc_status_error(taskNum, LOG_STATE_READY);
+                        bad = 1;
+                    }
+                    else{
+                        tasks[numTasks++] = taskNum;
+                    }
+                }
+                if(!bad && !all && numTasks == 0){
+                    log_kitc_arg_error("(none)");
+                    bad = 1;
+                }
+
+                //Every task running, suspended or waiting to launch
+                for(Process_Node *current = head; all && !bad && current != NULL; current = current -> next){
+                    if(current -> status == LOG_STATE_RUNNING || current -> status == LOG_STATE_SUSPENDED ||
+                       current -> throttled || current -> launching != NULL){
+                        tasks[numTasks++] = current -> inst -> num;
+                    }
+                }
+                if(!bad){
+                    startWait(tasks, numTasks, any, (long) (timeout * 1e9), control_hold());
+                }
+                blockSig(1);
+                free(tasks);
+                free(cmdCopy);
+            }
+
+            /* Pack launches onto the machine's room, or stop, or show it. */
+            else if(!strcmp(inst.instruct, instructions[30])){ /* pack */
+                char *pCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(pCommand, cmdCopy, " ");
+
+                //pack [cores=N] [mem=SIZE], pack off, or pack alone; the room
+                //is every cpu and the memory available now unless given, and
+                //memory is not limited if neither says how much there is
+                double cores = numCpus;
+                long memKb = availableMemKb();
+                char *bad = NULL;
+                for(int i = 1; pCommand[i] != NULL && bad == NULL && strcmp(pCommand[1], "off"); i++){
+                    char *end = NULL;
+                    if(!strncmp(pCommand[i], "cores=", 6)){
+                        cores = strtod(pCommand[i] + 6, &end);
+                        if(end == pCommand[i] + 6 || *end != '\0' || !(cores > 0)){
+                            bad = pCommand[i];
+                        }
+                    }
+                    else if(!strncmp(pCommand[i], "mem=", 4)){
+                        memKb = parseMemKb(pCommand[i] + 4);
+                        if(memKb <= 0){
+                            bad = pCommand[i];
+                        }
+                    }
+                    else{
+                        bad = pCommand[i];
+                    }
+                }
+
+                if(pCommand[1] == NULL){
+                    double usedCores = 0;
+                    long usedMemKb = 0;
+                    blockSig(0);
+                    packUsed(&usedCores, &usedMemKb);
+                    blockSig(1);
+                    log_kitc_pack_stats(packCores, packMemKb, usedCores, usedMemKb, numWaiting, usage_commands());
+                }
+                else if(!strcmp(pCommand[1], "off")){
+                    packCores = 0;
+                    packMemKb = 0;
+                    log_kitc_pack(0, 0);
+                }
+                else if(bad != NULL){
+                    log_kitc_arg_error(bad);
+                }
+                else{
+                    packCores = cores;
+                    packMemKb = memKb;
+                    log_kitc_pack(packCores, packMemKb);
+                }
+                free(cmdCopy);
+            }
+
+            /* Spawn background launches on launcher threads, or stop, or show them. */
+            else if(!strcmp(inst.instruct, instructions[32])){ /* launchers */
+                char *lCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(lCommand, cmdCopy, " ");
+
+                char *end = NULL;
+                long threads = lCommand[1] != NULL ? strtol(lCommand[1], &end, 10) : 0;
+                if(lCommand[1] == NULL){
+                    log_kitc_launcher_stats(launcher_threads(), numLaunching);
+                }
+                else if(!strcmp(lCommand[1], "off")){
+                    //What was handed out is spawned first
+                    stopLaunchers();
+                    log_kitc_launchers(0);
+                }
+                else if(end == lCommand[1] || *end != '\0' || threads <= 0){
+                    log_kitc_arg_error(lCommand[1]);
+                }
+                else{
+                    //Threads that could not be started leave launches inline;
+                    //a new number of threads replaces the old ones
+                    if(launcher_threads() > 0 && threads != launcher_threads()){
+                        stopLaunchers();
+                    }
+                    if(launcher_start(threads) || wakeOn(launcher_fd())){
+                        stopLaunchers();
+                    }
+                    log_kitc_launchers(launcher_threads());
+                }
+                free(cmdCopy);
+            }
+
+            /* Set placement attributes of a task. */
+            else if(!strcmp(inst.instruct, instructions[10])){ /* place */
+                int taskNum = inst.num;
+                Process_Node *pNode = getTaskNode(taskNum);
+                if(handleExeErr(pNode, taskNum)){
+                    contLoop(cmd, argv, &inst);
+                    continue;
+                }
+
+                char *pCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(pCommand, cmdCopy, " ");
+
+                //Attributes follow "place TASK"
+                for(int i = 2; pCommand[1] != NULL && pCommand[i] != NULL; i++){
+                    char *attr = string_copy(pCommand[i]);
+                    if(setPlacement(pNode, attr)){
+                        log_kitc_arg_error(pCommand[i]);
+                    }
+                    free(attr);
+                }
+
+                char attrs[MAXLINE];
+                describePlacement(pNode, attrs, MAXLINE);
+                log_kitc_placement(taskNum, attrs);
+                free(cmdCopy);
+            }
+
+            /* Set the placement policy for background tasks. */
+            else if(!strcmp(inst.instruct, instructions[11])){ /* placement */
+                char *pCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(pCommand, cmdCopy, " ");
+
+                if(pCommand[1] == NULL){
+                    log_kitc_arg_error("(none)");
+                }
+                else if(!strcmp(pCommand[1], "none")){placePolicy = PLACE_NONE;}
+                else if(!strcmp(pCommand[1], "spread")){placePolicy = PLACE_SPREAD;}
+                else if(!strcmp(pCommand[1], "numa")){placePolicy = PLACE_NUMA;}
+                else{
+                    log_kitc_arg_error(pCommand[1]);
+                    pCommand[1] = NULL;
+                }
+
+                if(pCommand[1] != NULL){
+                    log_kitc_policy("placement policy", pCommand[1]);
+                }
+                free(cmdCopy);
+            }
+
+            /* Keep pre-forked helpers warm for a task's executable. */
+            else if(!strcmp(inst.instruct, instructions[12])){ /* pool */
+                int taskNum = inst.num;
+                Process_Node *pNode = getTaskNode(taskNum);
+                if(pNode == NULL){
+                    log_kitc_task_num_error(taskNum);
+                    contLoop(cmd, argv, &inst);
+                    continue;
+                }
+
+                //Helpers fork from the controller, keep SIGCHLD out meanwhile
+                blockSig(0);
+                if(setPool(pNode, inst.num2)){
+                    log_kitc_exec_error(pNode -> command);
+                }
+                else{
+                    log_kitc_pool(taskNum, inst.num2 < MAXPOOL ? inst.num2 : MAXPOOL);
+                }
+                blockSig(1);
+            }
+
+            /* Turn output caching for a task on or off, or show cache counters. */
+            else if(!strcmp(inst.instruct, instructions[13])){ /* cache */
+                char *cCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(cCommand, cmdCopy, " ");
+
+                if(cCommand[1] == NULL){
+                    long hits, misses, entries, bytes;
+                    cache_stats(&hits, &misses, &entries, &bytes);
+                    log_kitc_cache_stats(hits, misses, entries, bytes);
+                }
+                else{
+                    Process_Node *cNode = getTaskNode(inst.num);
+                    if(cNode == NULL){
+                        log_kitc_task_num_error(inst.num);
+                    }
+                    else{
+                        cNode -> cached = !(cCommand[2] != NULL && !strcmp(cCommand[2], "off"));
+                        log_kitc_cache(inst.num, cNode -> cached);
+                    }
+                }
+                free(cmdCopy);
+            }
+
+            /* Drop cached output for a task's current inputs, or all of it. */
+            else if(!strcmp(inst.instruct, instructions[14])){ /* invalidate */
+                char *cCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(cCommand, cmdCopy, " ");
+
+                if(cCommand[1] == NULL){
+                    cache_invalidate(NULL);
+                    log_kitc_invalidate(-1);
+                }
+                else{
+                    Process_Node *cNode = getTaskNode(inst.num);
+                    if(cNode == NULL){
+                        log_kitc_task_num_error(inst.num);
+                    }
+                    else{
+                        //Key of the last recorded or restored run
+                        if(cNode -> cacheKey[0]){
+                            cache_invalidate(cNode -> cacheKey);
+                        }
+                        log_kitc_invalidate(inst.num);
+                    }
+                }
+                free(cmdCopy);
+            }
+
+            /* Print the metrics, or set up their periodic dump. */
+            else if(!strcmp(inst.instruct, instructions[15])){ /* metrics */
+                char *mCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(mCommand, cmdCopy, " ");
+
+                if(mCommand[1] == NULL){
+                    static char text[16384];
+                    updateGauges();
+                    metrics_format(text, sizeof(text));
+                    printf("%s", text);
+                    fflush(stdout);
+                }
+                else if(!strcmp(mCommand[1], "dump") && mCommand[2] != NULL && !strcmp(mCommand[2], "off")){
+                    setMetricsDump(NULL, 0);
+                    log_kitc_policy("metrics dump", "off");
+                }
+                else if(!strcmp(mCommand[1], "dump") && mCommand[2] != NULL){
+                    long seconds = mCommand[3] ? strtol(mCommand[3], NULL, 10) : 10;
+                    if(seconds <= 0){
+                        log_kitc_arg_error(mCommand[3]);
+                    }
+                    else{
+                        setMetricsDump(mCommand[2], seconds);
+                        log_kitc_policy("metrics dump", mCommand[2]);
+                    }
+                }
+                else{
+                    log_kitc_arg_error(mCommand[1]);
+                }
+                free(cmdCopy);
+            }
+
+            /* Choose how tasks are spawned, signalled and reaped. */
+            else if(!strcmp(inst.instruct, instructions[16])){ /* backend */
+                char *bCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(bCommand, cmdCopy, " ");
+
+                proc_backend *chosen = NULL;
+                if(bCommand[1] == NULL){
+                    log_kitc_arg_error("(none)");
+                }
+                else if(!strcmp(bCommand[1], "os")){chosen = &os_backend;}
+                else if(!strcmp(bCommand[1], "sim")){chosen = &sim_backend;}
+                else{
+                    log_kitc_arg_error(bCommand[1]);
+                }
+
+                //Tasks still running belong to the backend that started them
+                Process_Node *busy = head;
+                while(busy != NULL && busy -> status != LOG_STATE_RUNNING && busy -> status != LOG_STATE_SUSPENDED){
+                    busy = busy -> next;
+                }
+                if(chosen != NULL && busy != NULL){
+                    log_kitc_status_error(busy -> inst -> num, busy -> status);
+                }
+                else if(chosen != NULL){
+                    if(chosen == &sim_backend){
+                        sim_reset();
+                    }
+                    procBackend = chosen;
+                    log_kitc_policy("process backend", chosen -> name);
+                }
+                free(cmdCopy);
+            }
+
+            /* Move the simulator's virtual time. */
+            else if(!strcmp(inst.instruct, instructions[17])){ /* sim */
+                char *sCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(sCommand, cmdCopy, " ");
+
+                //Without arguments only the clock is shown
+                if(sCommand[1] != NULL && !strcmp(sCommand[1], "advance") && sCommand[2] != NULL){
+                    sim_advance(strtol(sCommand[2], NULL, 10));
+                }
+                else if(sCommand[1] != NULL && !strcmp(sCommand[1], "run")){
+                    //Chains in the background go on until their last step
+                    sim_run();
+                    while(chainsDue){
+                        advanceChains();
+                        sim_run();
+                    }
+                }
+                else if(sCommand[1] != NULL){
+                    log_kitc_arg_error(sCommand[1]);
+                }
+
+                long now, running, stopped;
+                sim_stats(&now, &running, &stopped);
+                log_kitc_sim(now, running, stopped);
+                free(cmdCopy);
+            }
+
+            /* Show cpu and memory of running and suspended tasks. */
+            else if(!strcmp(inst.instruct, instructions[18])){ /* top */
+                char *tCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(tCommand, cmdCopy, " ");
+
+                //top [cpu|mem] [SECONDS] [COUNT]; scripted input and clients get one frame
+                int byMem = 0, numbers = 0, valid = 1;
+                double interval = 1;
+                long count = isatty(STDIN_FILENO) && control_current() < 0 ? 0 : 1;
+                for(int i = 1; tCommand[i] != NULL && valid; i++){
+                    char *end;
+                    if(!strcmp(tCommand[i], "cpu")){byMem = 0;}
+                    else if(!strcmp(tCommand[i], "mem")){byMem = 1;}
+                    else if(numbers == 0 && (interval = strtod(tCommand[i], &end)) > 0 && *end == '\0'){numbers++;}
+                    else if(numbers == 1 && (count = strtol(tCommand[i], &end, 10)) >= 0 && *end == '\0'){numbers++;}
+                    else{
+                        log_kitc_arg_error(tCommand[i]);
+                        valid = 0;
+                    }
+                }
+                if(valid){
+                    runTop(byMem, interval, count);
+                }
+                free(cmdCopy);
+            }
+
+            /* Open or close the control socket, or show it. */
+            else if(!strcmp(inst.instruct, instructions[19])){ /* control */
+                char *cCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(cCommand, cmdCopy, " ");
+
+                if(cCommand[1] == NULL){
+                    log_kitc_control(control_path(), control_clients());
+                }
+                else if(!strcmp(cCommand[1], "off") && !stdinOpen){
+                    //With no stdin (a daemon, or a script that ended) the socket
+                    //is all the input left: closing it would orphan the tasks.
+                    //quit shuts them down instead
+                    log_kitc_arg_error(cCommand[1]);
+                }
+                else if(!strcmp(cCommand[1], "off")){
+                    //A client that asked still gets its answer
+                    log_kitc_policy("control socket", "off");
+                    control_end();
+                    control_close();
+                }
+                else if(control_open(cCommand[1])){
+                    log_kitc_arg_error(cCommand[1]);
+                }
+                else{
+                    log_kitc_policy("control socket", cCommand[1]);
+                }
+                free(cmdCopy);
+            }
+
+            /* Become the console of a daemon, or stop being it. */
+            else if(!strcmp(inst.instruct, instructions[20]) || !strcmp(inst.instruct, instructions[21])){ /* attach and detach */
+                int attach = !strcmp(inst.instruct, instructions[20]);
+                if(attach ? control_attach(control_current()) : control_detach(control_current())){
+                    log_kitc_arg_error(inst.instruct);
+                }
+                else{
+                    log_kitc_console(attach);
+                }
+            }
+
+            /* Keep the task table in a journal, stop, or show it. */
+            else if(!strcmp(inst.instruct, instructions[22])){ /* journal */
+                char *jCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(jCommand, cmdCopy, " ");
+
+                if(jCommand[1] == NULL){
+                    long tasks, records, bytes, commits;
+                    journal_stats(&tasks, &records, &bytes, &commits);
+                    log_kitc_journal(journal_path(), tasks, records, bytes, commits);
+                }
+                else if(!strcmp(jCommand[1], "off")){
+                    if(journal_path() != NULL){
+                        writeSnapshot();
+                        journal_close();
+                    }
+                    log_kitc_policy("journal", "off");
+                }
+                else{
+                    //The current table replaces whatever the journal held
+                    blockSig(0);
+                    if(journal_path() != NULL){
+                        writeSnapshot();
+                    }
+                    int failed = journal_open(jCommand[1], NULL, NULL) < 0;
+                    if(!failed){
+                        writeSnapshot();
+                    }
+                    blockSig(1);
+                    if(failed){
+                        log_kitc_arg_error(jCommand[1]);
+                    }
+                    else{
+                        log_kitc_policy("journal", jCommand[1]);
+                    }
+                }
+                free(cmdCopy);
+            }
+
+            /* Record the session for taskctl-replay, or stop, or show it. */
+            else if(!strcmp(inst.instruct, instructions[33])){ /* record */
+                char *rCommand[MAXARGS+1];
+                char *cmdCopy = string_copy(cmd);
+                stringSplit(rCommand, cmdCopy, " ");
+
+                if(rCommand[1] == NULL){
+                    log_kitc_recording(session_record_path(), session_record_lines(), session_record_seconds());
+                }
+                else if(!strcmp(rCommand[1], "off")){
+                    session_record_close();
+                    log_kitc_policy("record", "off");
+                }
+                else if(session_record_open(rCommand[1])){
+                    log_kitc_arg_error(rCommand[1]);
+                }
+                else{
+                    log_kitc_policy("record", rCommand[1]);
+                }
+                free(cmdCopy);
+            }
+
             else{ /* New user command */
+                //A chain is split into its steps now, so a bad one is never added
+                Chain_Step *steps = NULL;
+                int numSteps = parseChain(cmd, &steps);
+                if(numSteps < 0){
+                    log_kitc_arg_error(cmd);
+                    contLoop(cmd, argv, &inst);
+                    continue;
+                }
+
                 blockSig(0);
                 
                 //Allocate space for new instruction to be added to list
@@ -889,7 +5520,13 @@ int main() {
                 }
 
                 addNode(newInst, string_copy(cmd));
+                Process_Node *added = getTaskNode(newInst -> num);
+                added -> steps = steps;
+                added -> numSteps = numSteps;
+                journal_add(newInst -> num, cmd);
+                status_update(newInst -> num, 0, LOG_STATE_READY, 0, cmd);
                 log_kitc_task_init(newInst -> num, cmd);
+                trace_probe(task_create, newInst -> num, -1, metrics_now());
                 blockSig(1);
             }
 
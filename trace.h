@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "metrics.h"
+
+/* Static probes on the controller's hot paths, for perf and bpftrace.
+ *
+ * Where <sys/sdt.h> is available (systemtap-sdt-dev), each probe is a USDT
+ * probe of provider kitc: a single nop in the code and a note in the ELF
+ * that tells a tracer where it is and how to find its arguments, so a probe
+ * nobody has attached to costs the nop and the arguments it reads.  Without
+ * the header, or built with -DKITC_NO_PROBES, probes compile to nothing and
+ * their arguments are not evaluated.
+ *
+ * Every probe carries the task number and pid it is about (-1 where there
+ * is none) and a timestamp in ns from metrics_now() (CLOCK_MONOTONIC):
+ *
+ *   task_create(task, pid, ts)          a task was added
+ *   fork(task, pid, start, ts)          a launch begun at start spawned pid
+ *   exec(task, pid, start, ts)          the child is about to exec
+ *   reap(task, pid, status, ts)         a child was reaped, status as wait(2)
+ *   signal(sig, handler, ts)            a signal handler was entered
+ *   state(task, pid, old, new, ts)      a task changed state (LOG_STATE_*)
+ *   status_log(task, pid, transition, ts)  log_kitc_status_change() output
+ *
+ * e.g.  bpftrace -e 'usdt:./taskctl:kitc:reap { @[arg0] = count(); }'
+ * and bench/flame.sh for a spawn-to-reap flame graph.
+ */
+
+#if defined(__has_include) && !defined(KITC_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define KITC_PROBES 1
+#endif
+#endif
+
+#ifdef KITC_PROBES
+#define trace_probe(name, ...) STAP_PROBEV(kitc, name, __VA_ARGS__)
+#else
+#define trace_probe(name, ...) ((void) 0)
+#endif
+
+#endif /*TRACE_H*/
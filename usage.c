@@ -0,0 +1,84 @@
+/* Resource use of past runs, see usage.h */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "usage.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+/* A learned command, a free slot if cmd is NULL */
+typedef struct usage_entry {
+    char *cmd;
+    double cores;
+    long rss_kb;
+    long runs;
+} usage_entry;
+
+/* Open addressing with linear probing, grown at half full */
+static usage_entry *table;
+static long capacity;
+static long used;
+
+static unsigned long long hash(const char *s) {
+    unsigned long long h = FNV_OFFSET;
+    for (; *s; s++) {
+        h ^= (unsigned char) *s;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+/* The slot of cmd, or the free slot where it would go. */
+static usage_entry *find(usage_entry *slots, long size, const char *cmd) {
+    long i = hash(cmd) & (size - 1);
+    while (slots[i].cmd && strcmp(slots[i].cmd, cmd)) {
+        i = (i + 1) & (size - 1);
+    }
+    return &slots[i];
+}
+
+/* Doubles the table. Returns 0 on success and -1 otherwise. */
+static int grow(void) {
+    long size = capacity ? capacity * 2 : 256;
+    usage_entry *slots = calloc(size, sizeof(usage_entry));
+    if (!slots) { return -1; }
+    for (long i = 0; i < capacity; i++) {
+        if (table[i].cmd) { *find(slots, size, table[i].cmd) = table[i]; }
+    }
+    free(table);
+    table = slots;
+    capacity = size;
+    return 0;
+}
+
+void usage_record(const char *cmd, double cores, long rss_kb) {
+    if (!cmd || ((used + 1) * 2 > capacity && grow())) { return; }
+    usage_entry *e = find(table, capacity, cmd);
+    if (!e->cmd) {
+        if (!(e->cmd = strdup(cmd))) { return; }
+        e->cores = cores;
+        e->rss_kb = rss_kb;
+        used++;
+    }
+    else {
+        e->cores += USAGE_WEIGHT * (cores - e->cores);
+        e->rss_kb += USAGE_WEIGHT * (rss_kb - e->rss_kb);
+        if (e->rss_kb < rss_kb) { e->rss_kb = rss_kb; }
+    }
+    e->runs++;
+}
+
+long usage_estimate(const char *cmd, double *cores, long *rss_kb) {
+    if (!cmd || !capacity) { return 0; }
+    usage_entry *e = find(table, capacity, cmd);
+    if (!e->cmd) { return 0; }
+    *cores = e->cores;
+    *rss_kb = e->rss_kb;
+    return e->runs;
+}
+
+long usage_commands(void) {
+    return used;
+}
@@ -0,0 +1,26 @@
+#ifndef USAGE_H
+#define USAGE_H
+
+/* Resource use of past runs, learned per command line.
+ *
+ * Each run reaped with its rusage is recorded against its command line as
+ * the cores it kept busy (cpu time over wall time) and its peak resident
+ * memory.  The estimate of a command is a moving average of its runs,
+ * each run weighing USAGE_WEIGHT; memory is never estimated below the
+ * last run, since packing a task into less than it used overcommits.
+ */
+
+#define USAGE_WEIGHT 0.5   /* weight of the latest run in the estimate */
+
+/* Records a run of cmd that kept cores busy and peaked at rss_kb. */
+void usage_record(const char *cmd, double cores, long rss_kb);
+
+/* Estimates the cores and peak memory of a run of cmd.
+ * Returns the number of runs it is learned from, 0 if none (and the
+ * outputs are left alone). */
+long usage_estimate(const char *cmd, double *cores, long *rss_kb);
+
+/* Number of commands learned. */
+long usage_commands(void);
+
+#endif /*USAGE_H*/
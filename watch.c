@@ -0,0 +1,293 @@
+/* Files watched for changes, see watch.h */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+
+#include "watch.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+#define HASH_CHUNK 65536
+#define EVENT_BUF  65536
+
+/* What is asked of each directory: anything that can change a file in it */
+#define DIR_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+/* A watched directory, shared by the files in it */
+typedef struct watch_dir {
+    int wd;
+    int refs;
+} watch_dir;
+
+/* A watched file, a free slot if path is NULL */
+typedef struct watch_file {
+    char *path;
+    const char *name;    /* last component, within path */
+    int wd;              /* watch of its directory */
+    int refs;
+    int exists;
+    struct timespec mtime;
+    off_t size;
+    unsigned long long hash;
+    int pending;         /* if an event came since the last check */
+    int changed;         /* if the last check found it changed */
+} watch_file;
+
+static int epoll_fd = -1;
+static int inotify_fd = -1;
+static int timer_fd = -1;
+
+static watch_file *files;
+static int num_files;       /* slots, used or not */
+static watch_dir *dirs;
+static int num_dirs;
+
+/* Buffers for file content and inotify events, too big for the stack of
+ * the caller; the watch_* functions are only called from one thread */
+static unsigned char hash_buf[HASH_CHUNK];
+static char event_buf[EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+static long first_event;    /* when the first pending event came, 0 if none */
+static long stat_files, stat_events, stat_checks, stat_changes;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* FNV-1a of the content of path. Returns 0 on success and -1 otherwise. */
+static int hash_file(const char *path, unsigned long long *hash) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return -1; }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    unsigned long long h = FNV_OFFSET;
+    ssize_t n;
+    while ((n = read(fd, hash_buf, sizeof(hash_buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            h ^= hash_buf[i];
+            h *= FNV_PRIME;
+        }
+    }
+    close(fd);
+    if (n < 0) { return -1; }
+    *hash = h;
+    return 0;
+}
+
+/* Reads the mtime, size and hash of a file into f.
+ * Returns 0 on success and -1 if it is gone or cannot be read. */
+static int read_state(watch_file *f) {
+    struct stat st;
+    if (stat(f->path, &st) || hash_file(f->path, &f->hash)) { return -1; }
+    f->mtime = st.st_mtim;
+    f->size = st.st_size;
+    return 0;
+}
+
+/* Checks a file against its last state, which it then replaces. A file that
+ * is gone is not changed (a run could not read it), but its return is.
+ * Returns 1 if it changed and 0 otherwise. */
+static int check_file(watch_file *f) {
+    struct stat st;
+    stat_checks++;
+    if (stat(f->path, &st)) {
+        f->exists = 0;
+        return 0;
+    }
+    if (f->exists && st.st_size == f->size &&
+        st.st_mtim.tv_sec == f->mtime.tv_sec && st.st_mtim.tv_nsec == f->mtime.tv_nsec) {
+        return 0;
+    }
+
+    // touched or rewritten: only a different content counts
+    unsigned long long hash = f->hash;
+    int existed = f->exists;
+    f->exists = !read_state(f);
+    int changed = f->exists && (!existed || f->hash != hash);
+    stat_changes += changed;
+    return changed;
+}
+
+/* Sets up inotify, the check timer and the epoll fd over both. */
+static int open_fds(void) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event in = { .events = EPOLLIN, .data.fd = inotify_fd };
+    struct epoll_event timer = { .events = EPOLLIN, .data.fd = timer_fd };
+    if (inotify_fd < 0 || timer_fd < 0 || epoll_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &in) ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer)) {
+        if (inotify_fd >= 0) { close(inotify_fd); }
+        if (timer_fd >= 0) { close(timer_fd); }
+        if (epoll_fd >= 0) { close(epoll_fd); }
+        inotify_fd = timer_fd = epoll_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int watch_fd(void) {
+    return epoll_fd;
+}
+
+int watch_add(const char *path) {
+    char resolved[PATH_MAX];
+    if (!path || !realpath(path, resolved)) { return -1; }
+    if (epoll_fd < 0 && open_fds()) { return -1; }
+
+    int slot = -1;
+    for (int i = 0; i < num_files; i++) {
+        if (files[i].path && !strcmp(files[i].path, resolved)) {
+            files[i].refs++;
+            return i;
+        }
+        if (!files[i].path && slot < 0) { slot = i; }
+    }
+    if (slot < 0) {
+        watch_file *grown = realloc(files, (num_files + 1) * sizeof(watch_file));
+        if (!grown) { return -1; }
+        files = grown;
+        slot = num_files++;
+        files[slot].path = NULL;
+    }
+
+    // the directory: inotify hands back the same wd for one already watched
+    char *dir = strdup(resolved);
+    char *cut = dir ? strrchr(dir, '/') : NULL;
+    if (!cut) {
+        free(dir);
+        return -1;
+    }
+    cut[cut == dir ? 1 : 0] = '\0';
+    int wd = inotify_add_watch(inotify_fd, dir, DIR_EVENTS);
+    free(dir);
+    if (wd < 0) { return -1; }
+    int d = 0;
+    while (d < num_dirs && dirs[d].wd != wd) { d++; }
+    if (d == num_dirs) {
+        watch_dir *grown = realloc(dirs, (num_dirs + 1) * sizeof(watch_dir));
+        if (!grown) {
+            inotify_rm_watch(inotify_fd, wd);
+            return -1;
+        }
+        dirs = grown;
+        dirs[num_dirs++] = (watch_dir) { wd, 0 };
+    }
+    dirs[d].refs++;
+
+    watch_file *f = &files[slot];
+    memset(f, 0, sizeof(*f));
+    f->path = strdup(resolved);
+    f->name = strrchr(f->path, '/') + 1;
+    f->wd = wd;
+    f->refs = 1;
+    f->exists = !read_state(f);
+    stat_files++;
+    return slot;
+}
+
+void watch_remove(int id) {
+    if (id < 0 || id >= num_files || !files[id].path || --files[id].refs > 0) { return; }
+    watch_file *f = &files[id];
+    for (int d = 0; d < num_dirs; d++) {
+        if (dirs[d].wd == f->wd && --dirs[d].refs == 0) {
+            inotify_rm_watch(inotify_fd, f->wd);
+            dirs[d] = dirs[--num_dirs];
+            break;
+        }
+    }
+    free(f->path);
+    f->path = NULL;
+    stat_files--;
+}
+
+/* Marks the files an event is about as pending. Returns how many. */
+static int mark(const struct inotify_event *ev) {
+    int marked = 0;
+    for (int i = 0; i < num_files; i++) {
+        watch_file *f = &files[i];
+        if (!f->path) { continue; }
+        // a lost event could be about any file, and a lost directory about all of its own
+        if ((ev->mask & IN_Q_OVERFLOW) || (f->wd == ev->wd &&
+            ((ev->mask & IN_IGNORED) || (ev->len && !strcmp(ev->name, f->name))))) {
+            f->pending = 1;
+            marked++;
+        }
+    }
+    return marked;
+}
+
+int watch_poll(void) {
+    if (epoll_fd < 0) { return 0; }
+    for (int i = 0; i < num_files; i++) {
+        files[i].changed = 0;
+    }
+
+    ssize_t len;
+    int marked = 0;
+    while ((len = read(inotify_fd, event_buf, sizeof(event_buf))) > 0) {
+        for (char *p = event_buf; p < event_buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *) p;
+            stat_events++;
+            marked += mark(ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    // each event puts the check off again, up to WATCH_MAXWAIT after the first
+    if (marked) {
+        long now = now_ns();
+        if (!first_event) { first_event = now; }
+        long at = now + WATCH_DEBOUNCE;
+        if (at > first_event + WATCH_MAXWAIT) { at = first_event + WATCH_MAXWAIT; }
+        struct itimerspec when = { { 0, 0 }, { at / 1000000000L, at % 1000000000L } };
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &when, NULL);
+        return 0;
+    }
+
+    uint64_t expirations;
+    if (!first_event || read(timer_fd, &expirations, sizeof(expirations)) <= 0) { return 0; }
+    first_event = 0;
+    int changed = 0;
+    for (int i = 0; i < num_files; i++) {
+        watch_file *f = &files[i];
+        if (f->path && f->pending) {
+            f->pending = 0;
+            f->changed = check_file(f);
+            changed += f->changed;
+        }
+    }
+    return changed;
+}
+
+int watch_changed(int id) {
+    return id >= 0 && id < num_files && files[id].path && files[id].changed;
+}
+
+const char *watch_path(int id) {
+    return id >= 0 && id < num_files ? files[id].path : NULL;
+}
+
+void watch_stats(long *files_out, long *dirs_out, long *events, long *checks, long *changes) {
+    *files_out = stat_files;
+    *dirs_out = num_dirs;
+    *events = stat_events;
+    *checks = stat_checks;
+    *changes = stat_changes;
+}
@@ -0,0 +1,47 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Files watched for changes, so tasks can be re-run when their inputs change.
+ *
+ * A file is watched through its directory with inotify, so one replaced by
+ * a rename (as editors and linkers save) is still seen, and each file and
+ * directory is watched once however many tasks share it.  Events only mark
+ * a file pending.  Once no event has come for WATCH_DEBOUNCE (or
+ * WATCH_MAXWAIT after the first of a burst), pending files are checked: one
+ * whose mtime and size are unchanged is left alone, and one whose content
+ * hashes as before was only touched.  The rest have changed.
+ *
+ * watch_fd() is readable whenever watch_poll() has something to do.
+ */
+
+#define WATCH_DEBOUNCE 50000000L      /* ns of quiet after an event before files are checked */
+#define WATCH_MAXWAIT 1000000000L     /* most ns a stream of events holds the check off */
+
+/* An epoll fd readable when events or a check are waiting, -1 before the
+ * first file is watched. */
+int watch_fd(void);
+
+/* Watches path, recording its current state as unchanged.
+ * Returns the file's id, shared with any other watch of the same file, or
+ * -1 if it cannot be watched. */
+int watch_add(const char *path);
+
+/* Drops one watch of a file added by watch_add(). */
+void watch_remove(int id);
+
+/* Reads waiting events and checks the pending files once they are quiet.
+ * Returns the number of files found changed, which watch_changed() then
+ * reports until the next call. */
+int watch_poll(void);
+
+/* If file id changed in the last watch_poll(). */
+int watch_changed(int id);
+
+/* Resolved path of file id. */
+const char *watch_path(int id);
+
+/* Files and directories watched, events read, files checked, and of those
+ * the ones that had changed. */
+void watch_stats(long *files, long *dirs, long *events, long *checks, long *changes);
+
+#endif /*WATCH_H*/
@@ -0,0 +1,197 @@
+/* A synthetic workload program provided as local executable.
+ * - Each argument is one step, run in order:
+ *     cpu=MS        burn the cpu for MS milliseconds
+ *     sleep=MS      sleep for MS milliseconds
+ *     out=BYTES     write BYTES to stdout in lines of `line` bytes
+ *     in=BYTES      read BYTES from stdin, or until EOF if BYTES is 0
+ *     rss=MB        grow resident memory to MB megabytes (touching every page)
+ *     stop          stop itself once with SIGTSTP
+ *     exit=CODE     exit with CODE, or a random code in A-B with exit=A-B
+ * - Settings apply to the steps after them:
+ *     rate=BPS      pace out/in at BPS bytes per second (default 0, unpaced)
+ *     line=BYTES    line length for out (default 64)
+ *     stopevery=MS  stop itself with SIGTSTP every MS milliseconds during
+ *                   cpu, sleep, out and in steps (default 0, never)
+ *     seed=N        seed for exit=A-B (default 1, so runs are reproducible)
+ *     loop=N        run all the steps N times (default 1)
+ * - Without arguments it exits 0 straight away.
+ *
+ * e.g. workload rss=64 rate=4096 out=65536 cpu=200 stopevery=500 exit=0-3
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#define PAGE 4096
+
+static long rate = 0;
+static long lineLen = 64;
+static long stopEvery = 0;
+static long lastStop = 0;
+static unsigned int seed = 1;
+static char *memory = NULL;
+static long memoryMB = 0;
+
+/* Monotonic clock in milliseconds */
+static long now_ms(void){
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(long ms){
+   struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+   while (nanosleep(&ts, &ts) == -1)
+	;
+}
+
+/* Stops with SIGTSTP if stopevery has passed since the last stop */
+static void maybe_stop(void){
+   if (stopEvery <= 0)
+	return;
+   long t = now_ms();
+   if (t - lastStop >= stopEvery){
+	raise(SIGTSTP);
+	lastStop = now_ms();
+   }
+}
+
+/* Sleeps as needed so that `done` bytes since `start` stay at or under rate */
+static void pace(long start, long done){
+   if (rate <= 0)
+	return;
+   long due = start + done * 1000 / rate;
+   long t = now_ms();
+   if (due > t)
+	sleep_ms(due - t);
+}
+
+static void burn(long ms){
+   volatile unsigned long x = 0;
+   long end = now_ms() + ms;
+   while (now_ms() < end){
+	for (int i = 0; i < 100000; i++)
+	     x += i * i;
+	maybe_stop();
+   }
+}
+
+static void nap(long ms){
+   long end = now_ms() + ms;
+   long t;
+   while ((t = now_ms()) < end){
+	long chunk = end - t;
+	if (stopEvery > 0 && chunk > stopEvery)
+	     chunk = stopEvery;
+	sleep_ms(chunk);
+	maybe_stop();
+   }
+}
+
+static void output(long bytes){
+   char line[lineLen + 1];
+   memset(line, 'x', lineLen);
+   line[lineLen - 1] = '\n';
+   long start = now_ms();
+   long done = 0;
+   while (done < bytes){
+	long n = bytes - done < lineLen ? bytes - done : lineLen;
+	if (fwrite(line + lineLen - n, 1, n, stdout) != (size_t) n)
+	     exit(1);
+	done += n;
+	if (rate > 0){
+	     fflush(stdout);
+	     pace(start, done);
+	}
+	maybe_stop();
+   }
+   fflush(stdout);
+}
+
+static void input(long bytes){
+   char buf[PAGE];
+   long start = now_ms();
+   long done = 0;
+   while (bytes == 0 || done < bytes){
+	long want = sizeof(buf);
+	if (bytes && bytes - done < want)
+	     want = bytes - done;
+	if (rate > 0 && rate < want)
+	     want = rate;
+	ssize_t n = read(STDIN_FILENO, buf, want);
+	if (n <= 0)
+	     break;
+	done += n;
+	pace(start, done);
+	maybe_stop();
+   }
+}
+
+static void grow(long mb){
+   if (mb <= memoryMB)
+	return;
+   char *grown = realloc(memory, mb * 1024 * 1024);
+   if (!grown)
+	exit(1);
+   memory = grown;
+   for (long off = memoryMB * 1024 * 1024; off < mb * 1024 * 1024; off += PAGE)
+	memory[off] = 1;
+   memoryMB = mb;
+}
+
+static void finish(const char *code){
+   int lo, hi;
+   if (sscanf(code, "%d-%d", &lo, &hi) == 2 && hi >= lo){
+	srand(seed);
+	exit(lo + rand() % (hi - lo + 1));
+   }
+   exit(atoi(code));
+}
+
+/* Runs one step or applies one setting; returns 0 if arg was not understood */
+static int step(const char *arg){
+   const char *eq = strchr(arg, '=');
+   long value = eq ? atol(eq + 1) : 0;
+   size_t keyLen = eq ? (size_t) (eq - arg) : strlen(arg);
+
+#define IS(key) (keyLen == strlen(key) && !strncmp(arg, key, keyLen))
+   if (IS("cpu"))            burn(value);
+   else if (IS("sleep"))     nap(value);
+   else if (IS("out"))       output(value);
+   else if (IS("in"))        input(value);
+   else if (IS("rss"))       grow(value);
+   else if (IS("stop"))      raise(SIGTSTP);
+   else if (IS("exit"))      finish(eq ? eq + 1 : "0");
+   else if (IS("rate"))      rate = value;
+   else if (IS("line"))      lineLen = value > 1 ? value : 1;
+   else if (IS("stopevery")) stopEvery = value;
+   else if (IS("seed"))      seed = value;
+   else if (IS("loop"))      ;
+   else                      return 0;
+#undef IS
+   return 1;
+}
+
+int main(int argc, char *argv[]){
+   int loops = 1;
+   for (int i = 1; i < argc; i++){
+	if (!strncmp(argv[i], "loop=", 5))
+	     loops = atoi(argv[i] + 5);
+   }
+
+   lastStop = now_ms();
+   for (int l = 0; l < loops; l++){
+	for (int i = 1; i < argc; i++){
+	     if (!step(argv[i])){
+		  fprintf(stderr, "workload: unknown step %s\n", argv[i]);
+		  return 2;
+	     }
+	}
+   }
+
+   return 0;
+}